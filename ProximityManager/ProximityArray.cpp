@@ -0,0 +1,388 @@
+/*
+ * ProximityArray.cpp
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ */
+
+#include "ProximityArray.h"
+
+
+//------------------------------------------------------------------------------------
+//--- PRIVATE TYPES ------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+#define DEBUG_TRACE(format, ...)    if(_debug){ _debug->printf(format, ##__VA_ARGS__);}
+
+
+//------------------------------------------------------------------------------------
+//-- PUBLIC METHODS IMPLEMENTATION ---------------------------------------------------
+//------------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------------
+ProximityArray::ProximityArray(bool run_thread){
+    _ready = false;
+    _debug = 0;
+    _count = 0;
+    _curr = 0;
+    _running = false;
+    _echo_high = false;
+    _deferred = false;
+    _echo_ts = 0;
+    _cycle_ts = 0;
+    _lapse_us = 0;
+    _timeout_us = 0;
+    _guard_us = DefaultGuardUs;
+    _ring_head = 0;
+    _ring_tail = 0;
+    memset(_sensor, 0, sizeof(_sensor));
+    memset(&_stats, 0, sizeof(ArrayStats));
+    _msg = (char*)Heap::memAlloc(32);
+    _sub_topic = 0;
+    _pub_topic_unique = 0;
+    _publCb = callback(this, &ProximityArray::publicationCb);
+    _subscrCb = callback(this, &ProximityArray::subscriptionCb);
+
+    // Inicializa parmetros del hilo de ejecucin propio si corresponde
+    if(run_thread){
+        _th.start(callback(this, &ProximityArray::task));
+        return;
+    }
+    _ready = true;
+}
+
+
+//------------------------------------------------------------------------------------
+int8_t ProximityArray::add(PinName trig, PinName echo, const char* pub_topic){
+    if(_count >= MaxSensors || _running){
+        return -1;
+    }
+    uint8_t id = _count;
+    Sensor_t* s = &_sensor[id];
+    s->trig = new DigitalOut(trig, 0);
+    s->echo = new InterruptIn(echo);
+    s->pub_topic = pub_topic;
+    s->max_dist = 0;
+    s->approach = 0;
+    s->goaway = 0;
+    s->dist = -1;
+    s->notified = -1;
+    s->err_notified = false;
+    if(!_pub_topic_unique){
+        _pub_topic_unique = (char*)Heap::memAlloc(MQ::MQClient::getMaxTopicLen());
+    }
+    _count = id + 1;
+    return id;
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::config(uint8_t id, uint16_t max_dist_cm, uint16_t approach_cm, uint16_t goaway_cm){
+    if(id >= _count){
+        return;
+    }
+    Sensor_t* s = &_sensor[id];
+    s->max_dist = max_dist_cm;
+    s->approach = approach_cm;
+    s->goaway = goaway_cm;
+    s->notified = -1;
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::start(uint32_t lapse_ms, uint32_t timeout_ms){
+    if(!_count){
+        return;
+    }
+    stop();
+    _lapse_us = lapse_ms * 1000;
+    _timeout_us = ((timeout_ms)? timeout_ms : DefaultTimeoutMs) * 1000;
+    _curr = 0;
+    _deferred = false;
+    _running = true;
+    fire();
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::stop(){
+    core_util_critical_section_enter();
+    if(_running){
+        _running = false;
+        _tmo.detach();
+        _sensor[_curr].echo->rise(Callback<void()>());
+        _sensor[_curr].echo->fall(Callback<void()>());
+    }
+    core_util_critical_section_exit();
+}
+
+
+//------------------------------------------------------------------------------------
+bool ProximityArray::getDistance(uint8_t id, int16_t* dist_cm){
+    if(id >= _count || _sensor[id].dist < 0){
+        return false;
+    }
+    *dist_cm = _sensor[id].dist;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::job(uint32_t signals){
+    if((signals & SampleEventFlag) != 0){
+        uint32_t tail = _ring_tail;
+        while(tail != _ring_head){
+            // la medida se lee despus de head y se copia antes de liberar su posicin
+            __DMB();
+            Sample_t s = _ring[tail & (SampleRingSize - 1)];
+            __DMB();
+            _ring_tail = ++tail;
+            sensorStep(s);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::setSubscriptionBase(const char* sub_topic) {
+    if(_sub_topic){
+        DEBUG_TRACE("\r\nProximityArray: ERROR_SUB ya hecha!\r\n");
+        return;
+    }
+
+    _sub_topic = (char*)sub_topic;
+
+    // Se suscribe a $sub_topic/#
+    char* suscr = (char*)Heap::memAlloc(strlen(sub_topic) + strlen("/#")+1);
+    if(suscr){
+        sprintf(suscr, "%s/#", _sub_topic);
+        MQ::MQClient::subscribe(suscr, &_subscrCb);
+        DEBUG_TRACE("\r\nProximityArray: Suscrito a %s/#\r\n", sub_topic);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+//- PROTECTED CLASS IMPL. ------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::task(){
+    _ready = true;
+    for(;;){
+        osEvent evt = _th.signal_wait(0, osWaitForever);
+        if(evt.status == osEventSignal){
+            uint32_t sig = evt.value.signals;
+            job(sig);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::fire(){
+    if(!_running){
+        return;
+    }
+    Sensor_t* s = &_sensor[_curr];
+    // el sensor ignorara el trigger mientras mantiene el echo anterior: se dispara en su flanco de bajada o, si no
+    // llega, al vencer la espera mxima
+    if(!_deferred && s->echo->read()){
+        _deferred = true;
+        _stats.deferred++;
+        s->echo->fall(callback(this, &ProximityArray::fire));
+        _tmo.attach_us(callback(this, &ProximityArray::fire), EchoBusyMaxUs);
+        if(s->echo->read()){
+            return;
+        }
+        // el echo ha finalizado mientras se instalaba la espera
+    }
+    _deferred = false;
+    if(_curr == 0){
+        _cycle_ts = us_ticker_read();
+    }
+    // slo el sensor en curso tiene habilitadas las interrupciones de echo
+    _echo_high = false;
+    s->echo->rise(callback(this, &ProximityArray::isrEchoRiseCb));
+    s->echo->fall(callback(this, &ProximityArray::isrEchoFallCb));
+    _tmo.attach_us(callback(this, &ProximityArray::isrTimeoutCb), _timeout_us);
+    s->trig->write(1);
+    wait_us(TriggerPulseUs);
+    s->trig->write(0);
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::next(int16_t dist){
+    Sensor_t* s = &_sensor[_curr];
+    s->echo->rise(Callback<void()>());
+    s->echo->fall(Callback<void()>());
+    _tmo.detach();
+
+    // registra la medida para la tarea
+    uint32_t head = _ring_head;
+    if((head - _ring_tail) >= SampleRingSize){
+        _stats.overflows++;
+    }
+    else{
+        Sample_t* smp = &_ring[head & (SampleRingSize - 1)];
+        smp->id = _curr;
+        smp->dist = dist;
+        // la medida se completa antes de publicarla a la tarea
+        __DMB();
+        _ring_head = head + 1;
+    }
+    _th.signal_set(SampleEventFlag);
+
+    if(!_running){
+        return;
+    }
+
+    // programa el siguiente disparo tras el tiempo de guarda, o al cumplir el periodo de ciclo al completar la vuelta
+    uint32_t delay = _guard_us;
+    _curr = (_curr + 1) % _count;
+    if(_curr == 0){
+        uint32_t elapsed = us_ticker_read() - _cycle_ts;
+        _stats.cycles++;
+        _stats.cycle_us = elapsed;
+        if(_lapse_us > elapsed && (_lapse_us - elapsed) > delay){
+            delay = _lapse_us - elapsed;
+        }
+    }
+    if(delay){
+        _tmo.attach_us(callback(this, &ProximityArray::fire), delay);
+    }
+    else{
+        fire();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::isrEchoRiseCb(){
+    _echo_ts = us_ticker_read();
+    _echo_high = true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::isrEchoFallCb(){
+    if(!_echo_high){
+        return;
+    }
+    uint32_t width = us_ticker_read() - _echo_ts;
+    _stats.samples++;
+    next((int16_t)(width / EchoUsPerCm));
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::isrTimeoutCb(){
+    _stats.timeouts++;
+    next(-1);
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::sensorStep(const Sample_t& smp){
+    Sensor_t* s = &_sensor[smp.id];
+
+    // un timeout se notifica una nica vez hasta la siguiente medida vlida
+    if(smp.dist < 0){
+        s->dist = -1;
+        if(!s->err_notified){
+            s->err_notified = true;
+            publish(smp.id, 2, 0);
+        }
+        return;
+    }
+    s->err_notified = false;
+
+    // fuera de rango no se tiene en cuenta
+    if(s->max_dist && smp.dist > s->max_dist){
+        s->dist = -1;
+        return;
+    }
+    s->dist = smp.dist;
+
+    // eventos de acercamiento y alejamiento respecto de la ltima distancia notificada (la primera se notifica como
+    // acercamiento)
+    if(s->notified < 0 || (s->approach && (s->notified - smp.dist) >= s->approach)){
+        s->notified = smp.dist;
+        publish(smp.id, 0, smp.dist);
+    }
+    else if(s->goaway && (smp.dist - s->notified) >= s->goaway){
+        s->notified = smp.dist;
+        publish(smp.id, 1, smp.dist);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::publish(uint8_t id, uint8_t ev, int16_t dist){
+    if(!_pub_topic_unique || !_sensor[id].pub_topic){
+        return;
+    }
+    sprintf(_pub_topic_unique, "%s/dist", _sensor[id].pub_topic);
+    sprintf(_msg, "%d,%d", ev, dist);
+    MQ::MQClient::publish(_pub_topic_unique, _msg, strlen(_msg)+1, &_publCb);
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::subscriptionCb(const char* topic, void* msg, uint16_t msg_len){
+    // si es un comando para ajustar eventos S,D(cm),I(cm),O(cm)
+    if(MQ::MQClient::isTopicToken(topic, "/config")){
+        DEBUG_TRACE("\r\nProximityArray: Topic:%s msg:%s\r\n", topic, msg);
+        char* data = (char*)Heap::memAlloc(msg_len);
+        if(data){
+            strcpy(data, (char*)msg);
+            char* arg = strtok(data, ",");
+            uint8_t id = atoi(arg);
+            arg = strtok(0, ",");
+            uint16_t max_dist = (arg)? atoi(arg) : 0;
+            arg = strtok(0, ",");
+            uint16_t approach_dist = (arg)? atoi(arg) : 0;
+            arg = strtok(0, ",");
+            uint16_t goaway_dist = (arg)? atoi(arg) : 0;
+            Heap::memFree(data);
+            config(id, max_dist, approach_dist, goaway_dist);
+        }
+        return;
+    }
+
+    // si es un comando para iniciar la captura T(ms),t(ms),G(us)
+    if(MQ::MQClient::isTopicToken(topic, "/start")){
+        DEBUG_TRACE("\r\nProximityArray: Topic:%s msg:%s\r\n", topic, msg);
+        char* data = (char*)Heap::memAlloc(msg_len);
+        if(data){
+            strcpy(data, (char*)msg);
+            char* arg = strtok(data, ",");
+            uint32_t lapse_ms = atoi(arg);
+            arg = strtok(0, ",");
+            uint32_t timeout_ms = (arg)? atoi(arg) : 0;
+            arg = strtok(0, ",");
+            if(arg){
+                setGuard(atoi(arg));
+            }
+            Heap::memFree(data);
+            start(lapse_ms, timeout_ms);
+        }
+        return;
+    }
+
+    // si es un comando para detener la captura
+    if(MQ::MQClient::isTopicToken(topic, "/stop")){
+        DEBUG_TRACE("\r\nProximityArray: Topic:%s msg:%s\r\n", topic, msg);
+        stop();
+        return;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityArray::publicationCb(const char* topic, int32_t result){
+}
+
@@ -0,0 +1,313 @@
+/*
+ * ProximityArray.h
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  ProximityArray gestiona un conjunto de sensores HC-SR04 (hasta MaxSensors) desde un nico thread, disparndolos por
+ *  turno rotatorio de forma que nunca hay dos sensores midiendo a la vez (sin interferencias entre ellos).
+ *
+ *  Cada sensor requiere un par de gpios (salida digital de trigger y entrada de interrupcin del echo) y se aade con
+ *  add(), indicando su topic de publicacin. A diferencia de ProximityManager, el array no utiliza el driver HCSR04 (que
+ *  dispara cada sensor con su propia cadencia), sino que genera el trigger y mide la duracin del echo de cada sensor:
+ *
+ *  Planificacin:
+ *      Al finalizar el echo de un sensor (flanco de bajada) o vencer su timeout de medida, el siguiente sensor se dispara
+ *      desde la propia ISR, tras un tiempo de guarda (setGuard, DefaultGuardUs por defecto) que deja extinguirse los ecos
+ *      residuales del disparo anterior. As, la tasa de medidas agregada es la mxima que permiten las distancias
+ *      medidas, en lugar de la impuesta por el timeout. Slo el sensor en curso tiene habilitadas sus interrupciones de
+ *      echo, por lo que el sensor que origina cada flanco queda identificado sin ms comprobaciones. Al completar una
+ *      vuelta, si se ha configurado un periodo de ciclo (start), la siguiente vuelta espera hasta cumplirlo.
+ *
+ *      Sin obstculo, el HC-SR04 mantiene el echo activo unos 38ms y no atiende un nuevo trigger hasta liberarlo. Si al
+ *      llegar su turno un sensor an mantiene el echo de su medida anterior (timeout de medida menor, o un nico
+ *      sensor), su disparo se aplaza hasta el flanco de bajada del echo, con una espera mxima de EchoBusyMaxUs.
+ *
+ *      Cada medida se registra en la ISR, con el sensor que la origina, en una cola circular sin bloqueos que vaca el
+ *      thread, donde se evalan los eventos de cada sensor y se publican en su topic.
+ *
+ *  Se puede configurar un topic base para la suscripcin $(sub_topic). Las rdenes que acepta el mdulo son:
+ *
+ *  Suscripcin:
+ *      $(sub_topic)/config S,D,I,O
+ *      Ajusta los parmetros del sensor S (ndice devuelto por add):
+ *      D: Rango de deteccin mxima en cm. Por encima de ese valor, no lo tendr en cuenta.
+ *      I: Diferencia en cm con la ltima distancia notificada para notificar evento de acercamiento.
+ *      O: Diferencia en cm con la ltima distancia notificada para notificar evento de alejamiento.
+ *
+ *      $(sub_topic)/start T,t,G
+ *      Inicia la captura con un periodo de ciclo mnimo de T(ms) (0: sin espera entre vueltas), un timeout de medida
+ *      de t(ms) (0: DefaultTimeoutMs) y, opcionalmente, un tiempo de guarda entre disparos de G(us).
+ *
+ *      $(sub_topic)/stop 0
+ *      Detiene la captura
+ *
+ *  Publicacin (en el topic de cada sensor):
+ *      $(pub_topic)/dist E,D
+ *      Con el mismo formato que ProximityManager: E(tipo de evento: 0 si se acerca, 1 si se aleja, 2 error en medida) y
+ *      D(distancia en cm). El error (timeout sin echo) se notifica una nica vez hasta la siguiente medida vlida.
+ *
+ *  Las estadsticas de planificacin (ArrayStats) se obtienen con getStats().
+ */
+
+#ifndef __ProximityArray__H
+#define __ProximityArray__H
+
+#include "mbed.h"
+#include "MQLib.h"
+#include "Logger.h"
+#include "Heap.h"
+
+
+
+class ProximityArray{
+  public:
+
+    /** Nmero mximo de sensores en un array */
+    static const uint8_t MaxSensors = 8;
+
+    /** Tiempo de guarda por defecto entre el final de una medida y el siguiente disparo (us) */
+    static const uint32_t DefaultGuardUs = 2000;
+
+    /** Timeout de medida por defecto (ms): el del propio HC-SR04 sin obstculo (echo de ~38ms), de forma que el sensor
+     *  ya puede atender un nuevo trigger cuando vuelve a llegar su turno */
+    static const uint32_t DefaultTimeoutMs = 38;
+
+
+    /** Estadsticas de planificacin */
+    struct ArrayStats{
+        uint32_t cycles;                    /// Vueltas completas a todos los sensores
+        uint32_t samples;                   /// Medidas vlidas (echo completo)
+        uint32_t timeouts;                  /// Medidas finalizadas por timeout
+        uint32_t overflows;                 /// Medidas descartadas por cola llena
+        uint32_t deferred;                  /// Disparos aplazados por un sensor con el echo anterior an activo
+        uint32_t cycle_us;                  /// Duracin de la ltima vuelta (us)
+    };
+
+
+    /** Constructor
+     *  @param run_thread Flag para indicar si debe iniciarse como un thread o no
+     */
+    ProximityArray(bool run_thread = true);
+
+
+	/** add()
+     *  Aade un sensor al array. Debe invocarse con la captura detenida
+     *  @param trig Pin de salida digital (trigger)
+     *  @param echo Pin de entrada con el echo devuelto
+     *  @param pub_topic Topic base para la publicacin de los eventos del sensor
+     *  @return ndice en el array o -1 si el array est completo
+     */
+    int8_t add(PinName trig, PinName echo, const char* pub_topic);
+
+
+	/** config()
+     *  Ajusta los parmetros de deteccin de un sensor
+     *  @param id ndice del sensor
+     *  @param max_dist_cm Rango de deteccin mxima en cm
+     *  @param approach_cm Diferencia en cm para notificar evento de acercamiento
+     *  @param goaway_cm Diferencia en cm para notificar evento de alejamiento
+     */
+    void config(uint8_t id, uint16_t max_dist_cm, uint16_t approach_cm, uint16_t goaway_cm);
+
+
+	/** start()
+     *  Inicia la captura por turno rotatorio desde el primer sensor
+     *  @param lapse_ms Periodo mnimo de cada vuelta en ms (0: la siguiente vuelta comienza sin espera)
+     *  @param timeout_ms Timeout de medida de cada sensor en ms (0: DefaultTimeoutMs)
+     */
+    void start(uint32_t lapse_ms, uint32_t timeout_ms);
+
+
+	/** stop()
+     *  Detiene la captura
+     */
+    void stop();
+
+
+	/** setGuard()
+     *  Ajusta el tiempo de guarda entre el final de una medida y el siguiente disparo
+     *  @param guard_us Tiempo de guarda en us
+     */
+    void setGuard(uint32_t guard_us){ _guard_us = guard_us; }
+
+
+	/** getDistance()
+     *  Obtiene la ltima distancia medida por un sensor
+     *  @param id ndice del sensor
+     *  @param dist_cm Recibe la distancia en cm
+     *  @return True si la ltima medida del sensor es vlida y dentro de rango
+     */
+    bool getDistance(uint8_t id, int16_t* dist_cm);
+
+
+	/** ready()
+     *  Devuelve el estado de ejecucin
+     *  @return True, False
+     */
+    bool ready() {return _ready; }
+
+
+	/** setDebugChannel()
+     *  Instala canal de depuracin
+     *  @param dbg Logger
+     */
+    void setDebugChannel(Logger* dbg){ _debug = dbg; }
+
+
+	/** getStats()
+     *  Obtiene las estadsticas de planificacin
+     *  @param stats Recibe las estadsticas
+     */
+    void getStats(ArrayStats* stats){ *stats = _stats; }
+
+
+    /** @fn job
+     *  @brief Rutina de ejecucin para procesar eventos de forma asncrona, suele utilizarse
+     *  en threads de control externos que se encargan de lanzar trabajos a otros mdulos que
+     *  carecen de thread propio.
+     *  @param signals Flags activos
+     */
+    void job(uint32_t signals);
+
+
+	/** setSubscriptionBase()
+     *  Registra el topic base a los que se suscribir el mdulo
+     *  @param sub_topic Topic base para la suscripcin
+     */
+    void setSubscriptionBase(const char* sub_topic);
+
+
+  protected:
+
+    static const uint8_t  SampleRingSize = 16;      /// Medidas de la cola de la ISR (potencia de 2)
+    static const uint32_t TriggerPulseUs = 10;      /// Duracin del pulso de trigger
+    static const uint32_t EchoUsPerCm = 58;         /// Duracin del echo por cm de distancia (ida y vuelta)
+    static const uint32_t EchoBusyMaxUs = 40000;    /// Espera mxima al echo anterior de un sensor antes de dispararlo
+
+    /** Flags de tarea */
+    enum SigEventFlags{
+        SampleEventFlag = (1<<0),       /// Flag para notificar medidas pendientes en la cola
+    };
+
+    /** Medida registrada en la ISR */
+    struct Sample_t{
+        uint8_t id;                     /// Sensor que la origina
+        int16_t dist;                   /// Distancia en cm (< 0: timeout)
+    };
+
+    /** Datos de cada sensor */
+    struct Sensor_t{
+        DigitalOut* trig;               /// Salida de trigger
+        InterruptIn* echo;              /// Entrada de echo
+        const char* pub_topic;          /// Topic base para la publicacin
+        uint16_t max_dist;              /// Rango de deteccin mxima (cm)
+        uint16_t approach;              /// Diferencia para evento de acercamiento (cm)
+        uint16_t goaway;                /// Diferencia para evento de alejamiento (cm)
+        int16_t dist;                   /// ltima distancia medida (< 0: no vlida)
+        int16_t notified;               /// ltima distancia notificada (< 0: ninguna)
+        bool err_notified;              /// Flag de error notificado
+    };
+
+	Thread      _th;                    /// Hilo de ejecucin asociado
+    Sensor_t    _sensor[MaxSensors];    /// Sensores del array
+    uint8_t     _count;                 /// Nmero de sensores
+    volatile uint8_t _curr;             /// Sensor en curso de medida
+    volatile bool _running;             /// Flag de captura en marcha
+    volatile bool _echo_high;           /// Flag de echo en curso (flanco de subida recibido)
+    bool        _deferred;              /// Flag de disparo aplazado hasta el final del echo anterior del sensor
+    uint32_t    _echo_ts;               /// Instante del flanco de subida del echo
+    uint32_t    _cycle_ts;              /// Instante de inicio de la vuelta en curso
+    uint32_t    _lapse_us;              /// Periodo mnimo de cada vuelta (0: sin espera)
+    uint32_t    _timeout_us;            /// Timeout de medida
+    uint32_t    _guard_us;              /// Tiempo de guarda entre disparos
+    Timeout     _tmo;                   /// Timeout de medida y temporizacin del siguiente disparo
+    Sample_t    _ring[SampleRingSize];  /// Cola de medidas
+    volatile uint32_t _ring_head;       /// Medidas insertadas (slo escrito en ISR)
+    volatile uint32_t _ring_tail;       /// Medidas extradas (slo escrito en la tarea)
+    ArrayStats  _stats;                 /// Estadsticas de planificacin
+    char*       _sub_topic;             /// Topic base para la suscripcin
+    char*       _pub_topic_unique;      /// Topic para publicar
+    char*       _msg;
+    bool        _ready;                 /// Flag de estado disponible
+    Logger*     _debug;                 /// Canal de depuracin
+    MQ::PublishCallback   _publCb;      /// Callback de publicacin en topics
+    MQ::SubscribeCallback _subscrCb;    /// Callback de suscripcin en topics
+
+
+    /** @fn task
+     *  @brief Hilo de ejecucin asociado al array
+     */
+    void task();
+
+
+	/** fire()
+     *  Dispara el sensor en curso y arma su timeout de medida, o aplaza el disparo si el sensor an mantiene el echo de
+     *  su medida anterior (ISR)
+     */
+    void fire();
+
+
+	/** next()
+     *  Finaliza la medida del sensor en curso y programa el disparo del siguiente (ISR)
+     *  @param dist Distancia medida en cm (< 0: timeout)
+     */
+    void next(int16_t dist);
+
+
+	/** isrEchoRiseCb()
+     *  Flanco de subida del echo del sensor en curso
+     */
+    void isrEchoRiseCb();
+
+
+	/** isrEchoFallCb()
+     *  Flanco de bajada del echo del sensor en curso
+     */
+    void isrEchoFallCb();
+
+
+	/** isrTimeoutCb()
+     *  Vencimiento del timeout de medida del sensor en curso
+     */
+    void isrTimeoutCb();
+
+
+	/** sensorStep()
+     *  Evala una medida de un sensor y publica sus eventos
+     *  @param s Medida
+     */
+    void sensorStep(const Sample_t& s);
+
+
+	/** publish()
+     *  Publica un evento en el topic de un sensor
+     *  @param id ndice del sensor
+     *  @param ev Tipo de evento
+     *  @param dist Distancia en cm
+     */
+    void publish(uint8_t id, uint8_t ev, int16_t dist);
+
+
+	/** publicationCb()
+     *  Callback invocada al finalizar una publicacin
+     *  @param topic Identificador del topic
+     *  @param result Resultado de la publicacin
+     */
+    void publicationCb(const char* topic, int32_t result);
+
+
+	/** subscriptionCb()
+     *  Callback invocada tras recibir una suscripcin
+     *  @param topic Identificador del topic
+     *  @param msg Mensaje
+     *  @param msg_len Tamao del mensaje
+     */
+    void subscriptionCb(const char* topic, void* msg, uint16_t msg_len);
+};
+
+#endif /*__ProximityArray__H */
+
+/**** END OF FILE ****/
+
+
@@ -41,6 +41,24 @@ ProximityManager::ProximityManager(PinName trig, PinName echo, bool run_thread)
     // Inicia callback de recepcin de eventos
     _distCb = callback(this, &ProximityManager::distEventCb);
     
+    // Etapa de filtrado desactivada
+    _ring_head = 0;
+    _ring_tail = 0;
+    _ring_overflows = 0;
+    _filter_cfg.median_len = 0;
+    _filter_cfg.noise_cm = 0;
+    _filter_cfg.accel_cms2 = 0;
+    _filter_on = false;
+    _med_len = 0;
+    _med_count = 0;
+    _med_pos = 0;
+    _kf_noise = 0;
+    _kf_accel = 0;
+    _kf.init = false;
+    _track_valid = false;
+    _track_dist = 0;
+    _track_speed = 0;
+    
     // Inicializa parmetros del hilo de ejecucin propio si corresponde
     if(run_thread){
         _th.start(callback(this, &ProximityManager::task));    
@@ -75,6 +93,15 @@ void ProximityManager::job(uint32_t signals){
             MQ::MQClient::publish(_pub_topic_unique, _msg, strlen(_msg)+1, &_publCb);
         }       
     }        
+    
+    // la nueva configuracin se aplica antes de procesar las medidas pendientes
+    if((signals & FilterConfigFlag) != 0){        
+        filterApply();
+    }        
+    
+    if((signals & SampleEventFlag) != 0){        
+        filterStep();
+    }        
 }
 
 
@@ -107,6 +134,29 @@ void ProximityManager::setPublicationBase(const char* pub_topic) {
 
 
 
+//------------------------------------------------------------------------------------
+void ProximityManager::setFilter(uint8_t median_len, uint16_t noise_cm, uint16_t accel_cms2) {
+    median_len = (median_len > MaxMedianLen)? MaxMedianLen : median_len;
+    core_util_critical_section_enter();
+    _filter_cfg.median_len = (median_len > 1)? median_len : 0;
+    _filter_cfg.noise_cm = noise_cm;
+    _filter_cfg.accel_cms2 = accel_cms2;
+    core_util_critical_section_exit();
+    // las medidas se registran desde ya, el estado de los filtros slo lo modifica la tarea
+    _filter_on = (_filter_cfg.median_len || noise_cm)? true : false;
+    _th.signal_set(FilterConfigFlag);
+}   
+
+
+//------------------------------------------------------------------------------------
+bool ProximityManager::getTrack(int16_t* dist_cm, int16_t* speed_cms) {
+    *dist_cm = _track_dist;
+    *speed_cms = _track_speed;
+    return _track_valid;
+}   
+
+
+
 //------------------------------------------------------------------------------------
 //- PROTECTED CLASS IMPL. ------------------------------------------------------------
 //- ProximityManager Class -------------------------------------------------------------
@@ -128,6 +178,22 @@ void ProximityManager::task(){
 
 //------------------------------------------------------------------------------------
 void ProximityManager::distEventCb(HCSR04::DistanceEvent ev, int16_t dist){
+    // con la etapa de filtrado activa, registra cada medida instantnea con su instante
+    if(_filter_on){
+        uint32_t head = _ring_head;
+        if((head - _ring_tail) >= SampleRingSize){
+            _ring_overflows++;
+        }
+        else{
+            Sample_t* s = &_ring[head & (SampleRingSize - 1)];
+            s->dist = (ev == HCSR04::MeasureError)? -1 : ((ev == HCSR04::NoEvents)? HCSR04::_filter.dist_cm[HCSR04::_filter.curr] : dist);
+            s->ts = us_ticker_read();
+            // la medida se completa antes de publicarla al consumidor
+            __DMB();
+            _ring_head = head + 1;
+        }
+        _th.signal_set(SampleEventFlag);
+    }
     switch(ev){
         case HCSR04::NoEvents:{
             _th.signal_set(InvalidDistEventFlag);
@@ -192,6 +258,24 @@ void ProximityManager::subscriptionCb(const char* topic, void* msg, uint16_t msg
         return;
     }
 
+    // si es un comando para configurar la etapa de filtrado M,N,A
+    if(MQ::MQClient::isTopicToken(topic, "/filter")){
+        DEBUG_TRACE("\r\nProximityManager: Topic:%s msg:%s\r\n", topic, msg);
+        char* data = (char*)Heap::memAlloc(msg_len);
+        if(data){
+            strcpy(data, (char*)msg);
+            char* arg = strtok(data, ",");
+            uint8_t median_len = atoi(arg);
+            arg = strtok(0, ",");
+            uint16_t noise_cm = (arg)? atoi(arg) : 0;
+            arg = strtok(0, ",");
+            uint16_t accel_cms2 = (arg)? atoi(arg) : 0;
+            Heap::memFree(data);
+            setFilter(median_len, noise_cm, accel_cms2);
+        }
+        return;
+    }
+
     // si es un comando para detener el movimiento
     if(MQ::MQClient::isTopicToken(topic, "/stop")){
         DEBUG_TRACE("\r\nProximityManager: Topic:%s msg:%s\r\n", topic, msg);
@@ -201,6 +285,123 @@ void ProximityManager::subscriptionCb(const char* topic, void* msg, uint16_t msg
 }
 
 
+//------------------------------------------------------------------------------------
+void ProximityManager::filterApply(){
+    core_util_critical_section_enter();
+    FilterConfig_t cfg = _filter_cfg;
+    core_util_critical_section_exit();
+    _med_len = cfg.median_len;
+    _med_count = 0;
+    _med_pos = 0;
+    _kf_noise = cfg.noise_cm;
+    _kf_accel = cfg.accel_cms2;
+    _kf.init = false;
+    _track_valid = false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityManager::filterStep(){
+    // descarta las medidas registradas antes de aplicar la desactivacin de los filtros
+    if(!_med_len && !_kf_noise){
+        _ring_tail = _ring_head;
+        return;
+    }
+    uint32_t tail = _ring_tail;
+    while(tail != _ring_head){
+        // la medida se lee despus de head y se copia antes de liberar su posicin
+        __DMB();
+        Sample_t s = _ring[tail & (SampleRingSize - 1)];
+        __DMB();
+        _ring_tail = ++tail;
+        // un error de medida reinicia la estimacin de la velocidad
+        if(s.dist < 0){
+            _kf.init = false;
+            continue;
+        }
+        int16_t dist = (_med_len)? medianPush(s.dist) : s.dist;
+        if(_kf_noise){
+            kalmanStep(dist, s.ts);
+            _track_dist = (int16_t)((_kf.x + 128) >> 8);
+            _track_speed = (int16_t)(-((_kf.v + 128) >> 8));
+        }
+        else{
+            _track_dist = dist;
+            _track_speed = 0;
+        }
+        _track_valid = true;
+        if(_pub_topic_unique){
+            sprintf(_pub_topic_unique, "%s/track", _pub_topic);
+            sprintf(_msg, "%d,%d", _track_dist, _track_speed);
+            MQ::MQClient::publish(_pub_topic_unique, _msg, strlen(_msg)+1, &_publCb);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+int16_t ProximityManager::medianPush(int16_t dist){
+    _med_win[_med_pos] = dist;
+    _med_pos = (_med_pos + 1) % _med_len;
+    if(_med_count < _med_len){
+        _med_count++;
+    }
+    // ordenacin por insercin de la ventana (como mximo MaxMedianLen muestras)
+    int16_t sorted[MaxMedianLen];
+    for(uint8_t i = 0; i < _med_count; i++){
+        int16_t v = _med_win[i];
+        int8_t j = i - 1;
+        while(j >= 0 && sorted[j] > v){
+            sorted[j + 1] = sorted[j];
+            j--;
+        }
+        sorted[j + 1] = v;
+    }
+    return sorted[(_med_count - 1) / 2];
+}
+
+
+//------------------------------------------------------------------------------------
+void ProximityManager::kalmanStep(int16_t dist, uint32_t ts){
+    int64_t z = (int64_t)dist << 8;
+    int64_t r = ((int64_t)_kf_noise * _kf_noise) << 8;
+    uint32_t dt_ms = (ts - _kf.ts) / 1000;
+    if(!_kf.init || dt_ms > KalmanMaxGapMs){
+        _kf.init = true;
+        _kf.ts = ts;
+        _kf.x = (int32_t)z;
+        _kf.v = 0;
+        _kf.p00 = r;
+        _kf.p01 = 0;
+        _kf.p11 = ((int64_t)KalmanMaxSpeed * KalmanMaxSpeed) << 8;
+        return;
+    }
+    _kf.ts = ts;
+    
+    // prediccin: velocidad constante, con ruido de proceso por aceleracin (q = a^2)
+    int64_t dt = dt_ms;
+    int64_t q11 = ((((int64_t)_kf_accel * _kf_accel) << 8) * dt * dt) / 1000000;
+    int64_t q01 = (q11 * dt) / 2000;
+    int64_t q00 = (q11 * dt * dt) / 4000000;
+    _kf.x += (int32_t)(((int64_t)_kf.v * dt) / 1000);
+    _kf.p00 += ((2 * _kf.p01 * dt) / 1000) + ((_kf.p11 * dt * dt) / 1000000) + q00;
+    _kf.p01 += ((_kf.p11 * dt) / 1000) + q01;
+    _kf.p11 += q11;
+    
+    // correccin con la medida, ganancias en Q16
+    int64_t s = _kf.p00 + r;
+    int64_t k0 = (_kf.p00 << 16) / s;
+    int64_t k1 = (_kf.p01 << 16) / s;
+    int64_t y = z - _kf.x;
+    int64_t p01 = _kf.p01;
+    _kf.x += (int32_t)((k0 * y) >> 16);
+    _kf.v += (int32_t)((k1 * y) >> 16);
+    _kf.p00 -= (k0 * _kf.p00) >> 16;
+    _kf.p01 -= (k0 * p01) >> 16;
+    _kf.p11 -= (k1 * p01) >> 16;
+}
+
+
 //------------------------------------------------------------------------------------
 void ProximityManager::publicationCb(const char* topic, int32_t result){
 }
@@ -33,11 +33,28 @@
  *      $(sub_topic)/stop 0
  *      Permite detener la captura
  *
+ *      $(sub_topic)/filter M,N,A
+ *      Configura la etapa de filtrado propia (ver setFilter): M muestras de la mediana (0 o 1 la desactiva), N ruido de
+ *      medida en cm y A aceleracin mxima esperada del objeto en cm/s2 del filtro de Kalman (N = 0 lo desactiva).
+ *
  *  Publicacin:
  *      $(pub_topic)/dist E,D
  *      Permite notificar eventos de estado indicando E(tipo de evento: 0 si se acerca, 1 si se aleja, 2 error en medida) y 
  *      D(distancia en cm), as para notificar que un objeto se aproxima y que est a 20cm se publicar: $(pub_topic)/dist 0,20 
  *
+ *      $(pub_topic)/track D,V
+ *      Con la etapa de filtrado activa, por cada medida notifica la distancia filtrada D(cm) y la velocidad de 
+ *      aproximacin V(cm/s, positiva al acercarse y negativa al alejarse; 0 si el filtro de Kalman est desactivado).
+ *
+ *  Etapa de filtrado:
+ *      El filtro anti-glitch del driver (F muestras similares dentro de R cm) descarta medidas vlidas mientras el objeto
+ *      se mueve y deja pasar ecos errneos aislados. Como alternativa, ProximityManager puede filtrar cada medida
+ *      instantnea del driver (requiere Ei = 1, y se recomienda F = 1 para no retrasarlas): primero una mediana mvil de
+ *      M muestras, que elimina los ecos aislados, y despus un filtro de Kalman de velocidad constante en punto fijo 
+ *      (distancia y velocidad en Q8), que suaviza la distancia y estima la velocidad de aproximacin. Las medidas se 
+ *      registran en la ISR del driver, con su instante, en una cola circular sin bloqueos que vaca la tarea. Si entre
+ *      dos medidas pasan ms de KalmanMaxGapMs, o tras un error de medida, el filtro se reinicia con la siguiente.
+ *
  *  NOTA: Esta es la configuracin para una medida constante con resolucin adecuada:
  *  $.../config 100,3,3,3,10,0,1 
  *  $.../start 200,150 
@@ -51,6 +68,7 @@
 #include "mbed.h"
 #include "MQLib.h"
 #include "Logger.h"
+#include "Heap.h"
 #include "HCSR04.h"
 
 
@@ -113,15 +131,67 @@ public:
      *  @param pub_topic Topic base para la publicacin
      */
     void setPublicationBase(const char* pub_topic);     
+    
+  
+	/** setFilter()
+     *  Configura la etapa de filtrado propia de las medidas instantneas del driver. La configuracin se aplica desde la
+     *  tarea, antes de procesar la siguiente medida, reiniciando el estado de los filtros
+     *  @param median_len Muestras de la mediana mvil (0 o 1: desactivada), limitado a MaxMedianLen
+     *  @param noise_cm Desviacin tpica del ruido de medida en cm (0: filtro de Kalman desactivado)
+     *  @param accel_cms2 Aceleracin mxima esperada del objeto en cm/s2 (ruido de proceso del filtro de Kalman)
+     */
+    void setFilter(uint8_t median_len, uint16_t noise_cm, uint16_t accel_cms2);
+    
+  
+	/** getTrack()
+     *  Obtiene la ltima salida de la etapa de filtrado
+     *  @param dist_cm Recibe la distancia filtrada en cm
+     *  @param speed_cms Recibe la velocidad de aproximacin en cm/s (positiva al acercarse)
+     *  @return True si la etapa de filtrado est activa y ha procesado alguna medida
+     */
+    bool getTrack(int16_t* dist_cm, int16_t* speed_cms);
+    
+    /** Muestras mximas de la mediana mvil */
+    static const uint8_t MaxMedianLen = 9;
 
 
 protected:
     
+    static const uint8_t  SampleRingSize = 8;       /// Medidas de la cola de la ISR (potencia de 2)
+    static const uint32_t KalmanMaxGapMs = 1000;    /// Tiempo mximo entre medidas para mantener el filtro de Kalman
+    static const int32_t  KalmanMaxSpeed = 200;     /// Incertidumbre inicial de la velocidad en cm/s
+    
+    /** Medida instantnea registrada en la ISR */
+    struct Sample_t{
+        int16_t dist;                   /// Distancia en cm (< 0: error de medida)
+        uint32_t ts;                    /// Instante de la medida (us)
+    };
+    
+    /** Estado del filtro de Kalman (distancia y velocidad en Q8) */
+    struct Kalman_t{
+        bool init;                      /// Flag de filtro inicializado
+        uint32_t ts;                    /// Instante de la ltima medida
+        int32_t x;                      /// Distancia (cm, Q8)
+        int32_t v;                      /// Velocidad (cm/s, Q8)
+        int64_t p00;                    /// Covarianza (Q8)
+        int64_t p01;
+        int64_t p11;
+    };
+    
     /** Flags de tarea (asociados a la mquina de estados) */
     enum SigEventFlags{
         DistEventFlag        =  (1<<0),
         InvalidDistEventFlag =  (1<<1),
         MeasureErrorEventFlag = (1<<2),
+        SampleEventFlag       = (1<<3),
+        FilterConfigFlag      = (1<<4),     /// Configuracin de filtrado pendiente de aplicar
+    };
+    
+    /** Configuracin de la etapa de filtrado */
+    struct FilterConfig_t{
+        uint8_t median_len;             /// Muestras de la mediana (0: desactivada)
+        uint16_t noise_cm;              /// Ruido de medida (cm, 0: Kalman desactivado)
+        uint16_t accel_cms2;            /// Aceleracin mxima esperada (cm/s2)
     };
       
 	Thread _th;                         /// Hilo de ejecucin asociado
@@ -134,6 +204,22 @@ protected:
     MQ::PublishCallback   _publCb;      /// Callback de publicacin en topics
     MQ::SubscribeCallback _subscrCb;    /// Callback de suscripcin en topics
     HCSR04::DistEventCallback _distCb;  /// Callback de recepcin de eventos de medida
+    Sample_t    _ring[SampleRingSize];  /// Cola de medidas instantneas
+    volatile uint32_t _ring_head;       /// Medidas insertadas (slo escrito en ISR)
+    volatile uint32_t _ring_tail;       /// Medidas extradas (slo escrito en la tarea)
+    volatile uint32_t _ring_overflows;  /// Medidas descartadas por cola llena (slo escrito en ISR)
+    FilterConfig_t _filter_cfg;         /// Configuracin de filtrado pendiente de aplicar en la tarea
+    volatile bool _filter_on;           /// Flag de etapa de filtrado activa (consultado en ISR)
+    uint8_t     _med_len;               /// Muestras de la mediana (0: desactivada)
+    uint8_t     _med_count;             /// Muestras acumuladas en la ventana
+    uint8_t     _med_pos;               /// Posicin de la siguiente muestra en la ventana
+    int16_t     _med_win[MaxMedianLen]; /// Ventana de la mediana
+    uint16_t    _kf_noise;              /// Ruido de medida (cm, 0: Kalman desactivado)
+    uint16_t    _kf_accel;              /// Aceleracin mxima esperada (cm/s2)
+    Kalman_t    _kf;                    /// Estado del filtro de Kalman
+    bool        _track_valid;           /// Flag de salida filtrada disponible
+    int16_t     _track_dist;            /// ltima distancia filtrada (cm)
+    int16_t     _track_speed;           /// ltima velocidad de aproximacin (cm/s)
     
     
     /** @fn task
@@ -165,6 +251,34 @@ protected:
      *  @param dist Distancia en cm (0,-1 para errores de medida)
      */    
      void distEventCb(HCSR04::DistanceEvent ev, int16_t dist);
+    
+
+	/** filterApply()
+     *  Aplica la configuracin de filtrado pendiente (desde la tarea)
+     */
+    void filterApply();
+    
+    
+	/** filterStep()
+     *  Extrae las medidas de la cola, las filtra y publica el resultado
+     */    
+     void filterStep();
+    
+
+	/** medianPush()
+     *  Aade una medida a la ventana de la mediana
+     *  @param dist Distancia en cm
+     *  @return Mediana de las muestras de la ventana
+     */    
+     int16_t medianPush(int16_t dist);
+    
+
+	/** kalmanStep()
+     *  Predice el estado hasta el instante de la medida y lo corrige con ella
+     *  @param dist Distancia medida en cm
+     *  @param ts Instante de la medida (us)
+     */    
+     void kalmanStep(int16_t dist, uint32_t ts);
 };
 
 
@@ -0,0 +1,79 @@
+/*
+ * HCSR04.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Modelo del driver HCSR04 para el banco de pruebas bench_ProximityManager. No genera disparos ni mide echos: el
+ *  banco de pruebas entrega cada medida instantnea con simMeasure(), que actualiza el estado del driver que consulta
+ *  ProximityManager (_filter, _last_error) e invoca la callback instalada con start() en el contexto de interrupcin
+ *  simulado. Cada medida vlida se notifica como NoEvents (medida instantnea sin evento de acercamiento o alejamiento)
+ *  y cada distancia negativa como MeasureError, que son los casos que recorre la etapa de filtrado.
+ */
+
+#ifndef __HCSR04__H
+#define __HCSR04__H
+
+#include "mbed.h"
+#include <string.h>
+
+
+class HCSR04{
+public:
+    enum DistanceEvent{ NoEvents, MeasureError, Approaching, GoingAway };
+    typedef Callback<void(DistanceEvent, int16_t)> DistEventCallback;
+
+    /** Muestras del filtro del driver */
+    static const uint8_t FilterLen = 8;
+
+    HCSR04(PinName trig, PinName echo){
+        _last_event = NoEvents;
+        _last_dist_cm = 0;
+        _last_error = 0;
+        memset(&_filter, 0, sizeof(_filter));
+        _running = false;
+    }
+
+    virtual ~HCSR04(){}
+
+    void config(uint16_t max_dist_cm, uint16_t approach_cm, uint16_t goaway_cm, uint8_t filt_count = 3,
+                uint16_t filt_range = 10, uint8_t endis_invalid = 0, uint8_t endis_err = 0){}
+
+    void start(DistEventCallback cb, uint32_t lapse_ms, uint32_t timeout_ms){
+        _cb = cb;
+        _running = true;
+    }
+
+    void stop(){ _running = false; }
+
+    /** Entrega una medida instantnea (cm, < 0: error de medida) desde el contexto de interrupcin simulado */
+    void simMeasure(int16_t dist){
+        if(!_running || !_cb){
+            return;
+        }
+        if(dist < 0){
+            _last_event = MeasureError;
+            _last_error = -1;
+            _cb(MeasureError, -1);
+            return;
+        }
+        _filter.curr = (_filter.curr + 1) % FilterLen;
+        _filter.dist_cm[_filter.curr] = dist;
+        _cb(NoEvents, dist);
+    }
+
+protected:
+    DistanceEvent _last_event;
+    int16_t _last_dist_cm;
+    int32_t _last_error;
+    struct{
+        int16_t dist_cm[FilterLen];
+        uint8_t curr;
+    }_filter;
+
+private:
+    DistEventCallback _cb;
+    bool _running;
+};
+
+#endif
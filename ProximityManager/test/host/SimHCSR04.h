@@ -0,0 +1,124 @@
+/*
+ * SimHCSR04.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Modelo de sensor HC-SR04 para el banco de pruebas bench_ProximityManager, conectado a los pines de ProximityArray.
+ *
+ *  Cada sensor observa su salida de trigger (DigitalOut::onWrite): en el flanco de bajada del pulso inicia una medida
+ *  y, si tiene un objeto delante (setDistance), activa su entrada de echo (InterruptIn::simEdge) EchoDelayUs despus,
+ *  durante EchoUsPerCm por cm de distancia, con Timeout disparados en el contexto de interrupcin simulado. Sin objeto
+ *  (distancia negativa) no hay echo: como el HC-SR04, el sensor mantiene su entrada de echo activa durante NoEchoUs, y
+ *  la medida la finaliza el timeout de ProximityArray. Un sensor ignora los disparos recibidos desde el final del 
+ *  trigger hasta el final de su echo (ignored).
+ *
+ *  Todas las medidas de todos los sensores se registran en orden (shots), con el instante del disparo y el del final
+ *  del echo, y se contabilizan los disparos producidos mientras otro sensor tena su medida en curso (overlaps).
+ */
+
+#ifndef __SimHCSR04__H
+#define __SimHCSR04__H
+
+#include "mbed.h"
+#include <stdint.h>
+#include <vector>
+
+
+//------------------------------------------------------------------------------------
+class SimHCSR04{
+public:
+    static const uint32_t EchoDelayUs = 450;            /// Retardo entre el final del trigger y el inicio del echo
+    static const uint32_t EchoUsPerCm = 58;             /// Duracin del echo por cm de distancia (ida y vuelta)
+    static const uint32_t NoEchoUs = 38000;             /// Duracin del echo sin objeto
+
+    /** Medida de un sensor */
+    struct Shot{
+        uint8_t id;                                     /// Sensor disparado (orden de creacin)
+        uint64_t trig;                                  /// Instante del flanco de subida del trigger
+        uint64_t end;                                   /// Instante del final del echo (0: sin echo)
+    };
+
+    SimHCSR04(PinName trig, PinName echo) : _trig(trig), _echo(echo), _dist(-1), _trig_ts(0), _shot(-1), _width(0), _busy(false){
+        _id = (uint8_t)sensors().size();
+        sensors().push_back(this);
+        DigitalOut::onWrite() = callback(&SimHCSR04::pinWrite);
+    }
+
+    /** Fija la distancia al objeto en cm (< 0: sin objeto, no hay echo) */
+    void setDistance(int16_t dist_cm){ _dist = dist_cm; }
+
+    /** Medidas registradas de todos los sensores */
+    static std::vector<Shot>& shots(){ static std::vector<Shot> s; return s; }
+
+    /** Disparos producidos con la medida de otro sensor en curso */
+    static uint32_t& overlaps(){ static uint32_t n = 0; return n; }
+
+    /** Disparos ignorados por un sensor con su medida anterior en curso */
+    static uint32_t& ignored(){ static uint32_t n = 0; return n; }
+
+private:
+    static std::vector<SimHCSR04*>& sensors(){ static std::vector<SimHCSR04*> s; return s; }
+
+    static void pinWrite(PinName pin, int value){
+        for(SimHCSR04* s : sensors()){
+            if(s->_trig == pin){
+                s->trigger(value);
+            }
+        }
+    }
+
+    void trigger(int value){
+        if(value){
+            _trig_ts = SimClock::now();
+            return;
+        }
+        if(_busy){
+            ignored()++;
+            return;
+        }
+        _busy = true;
+        for(SimHCSR04* s : sensors()){
+            if(s != this && s->_shot >= 0){
+                overlaps()++;
+            }
+        }
+        shots().push_back({_id, _trig_ts, 0});
+        _shot = (_dist < 0)? -1 : ((int)shots().size() - 1);
+        _width = (_dist < 0)? NoEchoUs : ((uint32_t)_dist * EchoUsPerCm);
+        _tmr.attach_us(callback(this, &SimHCSR04::echoRise), EchoDelayUs);
+    }
+
+    void echoRise(){
+        edge(1);
+        _tmr.attach_us(callback(this, &SimHCSR04::echoFall), _width);
+    }
+
+    void echoFall(){
+        if(_shot >= 0){
+            shots()[_shot].end = SimClock::now();
+        }
+        _shot = -1;
+        _busy = false;
+        edge(0);
+    }
+
+    void edge(int level){
+        InterruptIn* in = InterruptIn::get(_echo);
+        if(in){
+            in->simEdge(level);
+        }
+    }
+
+    PinName _trig;
+    PinName _echo;
+    uint8_t _id;
+    int16_t _dist;
+    uint64_t _trig_ts;
+    int _shot;                                          /// Medida con echo en curso (-1: ninguna)
+    uint32_t _width;                                    /// Duracin del echo en curso
+    bool _busy;                                         /// Flag de medida en curso (trigger ignorado)
+    Timeout _tmr;
+};
+
+#endif
@@ -0,0 +1,589 @@
+/*
+ * bench_ProximityManager.cpp (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Banco de pruebas de ProximityArray y de la etapa de filtrado de ProximityManager en PC (Linux), sin hardware.
+ *  Utiliza los sustitutos comunes de test/host (tiempo simulado, ticker disparados desde el hilo principal, gpios) y
+ *  los de este directorio: sensores HC-SR04 simulados conectados a los pines de ProximityArray (SimHCSR04.h) y un
+ *  driver HCSR04 al que el banco de pruebas entrega directamente las medidas instantneas de ProximityManager.
+ *
+ *  Compilacin (desde la raz del repositorio):
+ *      g++ -std=gnu++11 -O2 -pthread -IProximityManager/test/host -Itest/host -IProximityManager \
+ *          ProximityManager/test/host/bench_ProximityManager.cpp ProximityManager/ProximityArray.cpp \
+ *          ProximityManager/ProximityManager.cpp -o bench_ProximityManager
+ *
+ *  Uso:
+ *      bench_ProximityManager [escenario]
+ *
+ *  Sin escenario se ejecutan todos, cada uno en un proceso independiente. Escenarios:
+ *      order       ProximityArray: turno rotatorio de 4 sensores con periodo de ciclo, tiempo de guarda entre el
+ *                  final de cada echo y el siguiente disparo, sin solapes, y eventos de cada sensor en su topic
+ *      timeout     ProximityArray: sensor sin echo, finalizado por timeout y notificado una nica vez, sin periodo
+ *                  de ciclo (la vuelta dura lo que permiten las distancias medidas)
+ *      busy        ProximityArray: con un timeout menor que el echo sin obstculo del HC-SR04, el disparo del sensor
+ *                  sin echo se aplaza hasta que lo libera, en lugar de perderse
+ *      median      ProximityManager: respuesta al escaln y rechazo de valores atpicos de la mediana mvil
+ *      kalman      ProximityManager: seguimiento de un objeto que se acerca a velocidad constante y se detiene,
+ *                  respuesta al escaln, reinicio tras un error de medida y mediana + Kalman con valores atpicos
+ *
+ *  Para cada escenario se informa del tiempo de cpu de la tarea por activacin (en el PC, til para comparar
+ *  versiones), de la planificacin o de la respuesta del filtro (en tiempo simulado) y de las comprobaciones. El
+ *  proceso devuelve 1 si alguna comprobacin falla.
+ */
+
+#include "mbed.h"
+#include "MQLib.h"
+#include "ProximityArray.h"
+#include "ProximityManager.h"
+#include "SimHCSR04.h"
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+
+
+// **************************************************************************
+// *********** DEFINICIONES *************************************************
+// **************************************************************************
+
+/** Publicacin recibida */
+struct BenchPub{
+    uint64_t t;
+    std::string topic;
+    int a;
+    int b;
+};
+
+/** Sensores del array */
+static const uint8_t Sensors = 4;
+
+/** Timeout de medida de los escenarios del array (ms) */
+static const uint32_t TimeoutMs = ProximityArray::DefaultTimeoutMs;
+
+/** Duracin del pulso de trigger que genera ProximityArray (us) */
+static const uint32_t TriggerPulseUs = 10;
+
+/** Periodo de las medidas instantneas del driver en los escenarios de filtrado (us) */
+static const uint32_t SamplePeriod = 60000;
+
+
+// **************************************************************************
+// *********** OBJETOS  *****************************************************
+// **************************************************************************
+
+static ProximityArray* array;
+static SimHCSR04* sensor[Sensors];
+static ProximityManager* proxman;
+static std::vector<BenchPub> pubs;
+static MQ::SubscribeCallback subscrCb;
+static int failures = 0;
+
+
+// **************************************************************************
+// *********** UTILIDADES ***************************************************
+// **************************************************************************
+
+//------------------------------------------------------------------------------------
+static uint64_t now(){
+    return SimClock::now();
+}
+
+
+//------------------------------------------------------------------------------------
+static void check(bool cond, const char* format, ...){
+    if(cond){
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    printf("    FALLO: ");
+    vprintf(format, args);
+    printf("\r\n");
+    va_end(args);
+    failures++;
+}
+
+
+//------------------------------------------------------------------------------------
+static uint64_t percentile(std::vector<uint64_t> v, double p){
+    if(v.empty()){
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))];
+}
+
+
+//------------------------------------------------------------------------------------
+/** Duracin de una medida con echo, desde el disparo hasta el final del echo (us) */
+static uint32_t shotUs(int16_t dist){
+    return TriggerPulseUs + SimHCSR04::EchoDelayUs + (dist * SimHCSR04::EchoUsPerCm);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Registra las publicaciones con formato A,B */
+static void onPublication(const char* topic, void* msg, uint16_t msg_len){
+    BenchPub p = {now(), std::string(topic), 0, 0};
+    sscanf((const char*)msg, "%d,%d", &p.a, &p.b);
+    pubs.push_back(p);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Publicaciones recibidas en un topic a partir del instante t */
+static std::vector<BenchPub> published(const char* topic, uint64_t t = 0){
+    std::vector<BenchPub> v;
+    for(size_t i = 0; i < pubs.size(); i++){
+        if(pubs[i].topic == topic && pubs[i].t >= t){
+            v.push_back(pubs[i]);
+        }
+    }
+    return v;
+}
+
+
+//------------------------------------------------------------------------------------
+/** Avanza el tiempo simulado hasta t, disparando los ticker vencidos y esperando a que la tarea los atienda */
+static void runUntil(uint64_t t){
+    for(;;){
+        Thread::settleAll();
+        uint64_t due = Ticker::nextDue();
+        if(due > t){
+            break;
+        }
+        if(now() < due){
+            SimClock::now() = due;
+        }
+        Ticker::fire(now());
+    }
+    Thread::settleAll();
+    if(now() < t){
+        SimClock::now() = t;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+/** Crea el array con un sensor simulado por cada distancia, publicando en prox/<i> */
+static void createArray(const int16_t* dist){
+    static const PinName pins[Sensors][2] = {{PC_0, PC_1}, {PC_2, PC_3}, {PC_4, PC_5}, {PC_6, PC_7}};
+    static const char* topics[Sensors] = {"prox/0", "prox/1", "prox/2", "prox/3"};
+    subscrCb = callback(onPublication);
+    MQ::MQClient::subscribe("prox/#", &subscrCb);
+    array = new ProximityArray();
+    for(uint8_t i = 0; i < Sensors; i++){
+        sensor[i] = new SimHCSR04(pins[i][0], pins[i][1]);
+        sensor[i]->setDistance(dist[i]);
+        check(array->add(pins[i][0], pins[i][1], topics[i]) == i, "add del sensor %d", i);
+        array->config(i, 300, 10, 10);
+    }
+    array->setSubscriptionBase("prox/cmd");
+    runUntil(now() + 1000);
+}
+
+
+//------------------------------------------------------------------------------------
+static void createManager(){
+    subscrCb = callback(onPublication);
+    MQ::MQClient::subscribe("prox/#", &subscrCb);
+    proxman = new ProximityManager(PA_0, PA_1);
+    proxman->setPublicationBase("prox");
+    proxman->setSubscriptionBase("prox/cmd");
+    runUntil(now() + 1000);
+    MQ::MQClient::publish("prox/cmd/start", (void*)"60,25", strlen("60,25") + 1, 0);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Orden en el topic de suscripcin */
+static void command(const char* topic, const char* msg){
+    MQ::MQClient::publish(topic, (void*)msg, strlen(msg) + 1, 0);
+    runUntil(now() + 1000);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Entrega una medida instantnea al cumplir el periodo y devuelve la salida filtrada publicada */
+static BenchPub sample(int16_t dist){
+    runUntil(now() + SamplePeriod);
+    size_t n = pubs.size();
+    proxman->simMeasure(dist);
+    runUntil(now() + 1);
+    for(size_t i = n; i < pubs.size(); i++){
+        if(pubs[i].topic == "prox/track"){
+            return pubs[i];
+        }
+    }
+    BenchPub none = {now(), std::string(), -1, 0};
+    return none;
+}
+
+
+//------------------------------------------------------------------------------------
+/** Informe comn: cpu por activacin de la tarea */
+static void report(uint64_t t0){
+    std::vector<Thread::Wake> wakes = Thread::takeAllWakes();
+    std::vector<uint64_t> cpu;
+    for(size_t i = 0; i < wakes.size(); i++){
+        if(wakes[i].at_us >= t0){
+            cpu.push_back(wakes[i].cpu_ns);
+        }
+    }
+    printf("    tarea: %u activaciones, cpu/activacin p50=%.1fus p99=%.1fus max=%.1fus (host), publicaciones %u\r\n",
+            (unsigned)cpu.size(), percentile(cpu, 0.5) / 1000.0, percentile(cpu, 0.99) / 1000.0,
+            percentile(cpu, 1.0) / 1000.0, (unsigned)pubs.size());
+    if(array){
+        ProximityArray::ArrayStats st;
+        array->getStats(&st);
+        printf("    ProximityArray: vueltas=%u medidas=%u timeouts=%u overflows=%u aplazados=%u vuelta=%uus\r\n", st.cycles,
+                st.samples, st.timeouts, st.overflows, st.deferred, st.cycle_us);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+/** Comprueba el turno rotatorio de las medidas registradas desde 'first': orden, solapes y tiempo de guarda */
+static void expectRoundRobin(size_t first){
+    std::vector<SimHCSR04::Shot>& shots = SimHCSR04::shots();
+    for(size_t k = first; k < shots.size(); k++){
+        check(shots[k].id == (k % Sensors), "medida %u del sensor %u, esperado %u", (unsigned)k, shots[k].id,
+                (unsigned)(k % Sensors));
+        if(k == 0 || (k % Sensors) == 0){
+            continue;
+        }
+        // el final de la medida anterior es el del echo o el del timeout
+        uint64_t end = (shots[k - 1].end)? shots[k - 1].end : (shots[k - 1].trig + (TimeoutMs * 1000));
+        check(shots[k].trig == end + ProximityArray::DefaultGuardUs, "medida %u disparada %lldus tras la anterior",
+                (unsigned)k, (long long)(shots[k].trig - end));
+    }
+    check(SimHCSR04::overlaps() == 0, "%u disparos con otra medida en curso", SimHCSR04::overlaps());
+    check(SimHCSR04::ignored() == 0, "%u disparos ignorados por un sensor ocupado", SimHCSR04::ignored());
+}
+
+
+
+// **************************************************************************
+// *********** ESCENARIOS ***************************************************
+// **************************************************************************
+
+//------------------------------------------------------------------------------------
+static void scenarioOrder(){
+    static const int16_t dist[Sensors] = {50, 120, 30, 200};
+    createArray(dist);
+    Thread::takeAllWakes();
+    uint64_t t0 = now();
+    command("prox/cmd/start", "100,0");
+    runUntil(t0 + 999000);
+    report(t0);
+
+    // 10 vueltas de 4 medidas, cada vuelta al cumplir el periodo de ciclo
+    std::vector<SimHCSR04::Shot>& shots = SimHCSR04::shots();
+    check(shots.size() == 10 * Sensors, "%u medidas, esperadas %u", (unsigned)shots.size(), 10 * Sensors);
+    expectRoundRobin(0);
+    for(size_t k = Sensors; k < shots.size(); k += Sensors){
+        check((shots[k].trig - shots[k - Sensors].trig) == 100000, "vuelta %u iniciada %lluus tras la anterior",
+                (unsigned)(k / Sensors), (unsigned long long)(shots[k].trig - shots[k - Sensors].trig));
+    }
+    uint32_t cycle = 3 * ProximityArray::DefaultGuardUs;
+    for(uint8_t i = 0; i < Sensors; i++){
+        cycle += shotUs(dist[i]);
+    }
+    ProximityArray::ArrayStats st;
+    array->getStats(&st);
+    check(st.cycles == 10 && st.samples == 10 * Sensors && st.timeouts == 0 && st.overflows == 0,
+            "estadsticas vueltas=%u medidas=%u timeouts=%u overflows=%u", st.cycles, st.samples, st.timeouts, st.overflows);
+    check(st.cycle_us == cycle, "vuelta de %uus, esperada %uus", st.cycle_us, cycle);
+
+    // la primera medida de cada sensor se notifica en su topic, el resto sin cambios no
+    static const char* topics[Sensors] = {"prox/0/dist", "prox/1/dist", "prox/2/dist", "prox/3/dist"};
+    for(uint8_t i = 0; i < Sensors; i++){
+        std::vector<BenchPub> p = published(topics[i]);
+        check(p.size() == 1 && p[0].a == 0 && p[0].b == dist[i], "sensor %d: %u eventos, primero %d,%d", i,
+                (unsigned)p.size(), (p.empty())? -1 : p[0].a, (p.empty())? -1 : p[0].b);
+        int16_t d = 0;
+        check(array->getDistance(i, &d) && d == dist[i], "distancia del sensor %d: %d", i, d);
+    }
+
+    // acercamiento y alejamiento por encima del umbral de 10cm
+    uint64_t t1 = now();
+    sensor[2]->setDistance(15);
+    sensor[3]->setDistance(215);
+    runUntil(t1 + 200000);
+    std::vector<BenchPub> p2 = published(topics[2], t1);
+    std::vector<BenchPub> p3 = published(topics[3], t1);
+    check(p2.size() == 1 && p2[0].a == 0 && p2[0].b == 15, "sensor 2: %u eventos tras acercarse", (unsigned)p2.size());
+    check(p3.size() == 1 && p3[0].a == 1 && p3[0].b == 215, "sensor 3: %u eventos tras alejarse", (unsigned)p3.size());
+    expectRoundRobin(0);
+
+    // tras detener la captura no hay ms disparos
+    command("prox/cmd/stop", "0");
+    size_t n = shots.size();
+    runUntil(now() + 300000);
+    check(shots.size() == n, "%u disparos tras detener la captura", (unsigned)(shots.size() - n));
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioTimeout(){
+    static const int16_t dist[Sensors] = {40, -1, 60, 80};
+    createArray(dist);
+    Thread::takeAllWakes();
+    uint64_t t0 = now();
+    command("prox/cmd/start", "0,0");
+    runUntil(t0 + 250000);
+    report(t0);
+
+    // sin periodo de ciclo las vueltas se suceden tras el tiempo de guarda, el sensor sin echo agota su timeout
+    std::vector<SimHCSR04::Shot>& shots = SimHCSR04::shots();
+    expectRoundRobin(0);
+    uint32_t cycle = (TimeoutMs * 1000) + (3 * ProximityArray::DefaultGuardUs);
+    uint32_t missing = 0, echoes = 0;
+    for(uint8_t i = 0; i < Sensors; i++){
+        cycle += (dist[i] < 0)? 0 : shotUs(dist[i]);
+    }
+    for(size_t k = 0; k < shots.size(); k++){
+        // sin contar la medida en curso
+        missing += (shots[k].id == 1 && (shots[k].trig + (TimeoutMs * 1000)) <= now())? 1 : 0;
+        echoes += (shots[k].end)? 1 : 0;
+    }
+    ProximityArray::ArrayStats st;
+    array->getStats(&st);
+    printf("    vuelta=%uus (%.1f medidas/s), frente a %uus con disparos a ritmo de timeout\r\n", st.cycle_us,
+            (Sensors * 1000000.0) / (st.cycle_us + ProximityArray::DefaultGuardUs),
+            Sensors * ((TimeoutMs * 1000) + ProximityArray::DefaultGuardUs));
+    check(st.cycle_us == cycle, "vuelta de %uus, esperada %uus", st.cycle_us, cycle);
+    check(st.timeouts == missing && missing >= 4, "timeouts=%u, medidas sin echo %u", st.timeouts, missing);
+    check(st.samples == echoes, "medidas=%u, echos completos %u", st.samples, echoes);
+
+    // el error se notifica una nica vez hasta la siguiente medida vlida
+    std::vector<BenchPub> p = published("prox/1/dist");
+    check(p.size() == 1 && p[0].a == 2 && p[0].b == 0, "sensor 1: %u eventos de error", (unsigned)p.size());
+    uint64_t t1 = now();
+    sensor[1]->setDistance(90);
+    runUntil(t1 + 100000);
+    sensor[1]->setDistance(-1);
+    runUntil(t1 + 300000);
+    p = published("prox/1/dist", t1);
+    check(p.size() == 2 && p[0].a == 0 && p[0].b == 90 && p[1].a == 2, "sensor 1: %u eventos tras recuperar el echo",
+            (unsigned)p.size());
+    expectRoundRobin(0);
+    for(uint8_t i = 0; i < Sensors; i += 2){
+        check(published((i == 0)? "prox/0/dist" : "prox/2/dist").size() == 1, "sensor %d: eventos sin cambios", i);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioBusy(){
+    static const int16_t dist[Sensors] = {10, -1, 10, 10};
+    static const uint32_t ShortTimeoutMs = 25;
+    createArray(dist);
+    array->setGuard(0);
+    Thread::takeAllWakes();
+    uint64_t t0 = now();
+    // con un timeout menor que el echo sin obstculo, el turno del sensor 1 llega antes de que lo libere
+    command("prox/cmd/start", "0,25");
+    runUntil(t0 + 300000);
+    report(t0);
+
+    // cada disparo del sensor 1 espera al final del echo de su medida anterior, y ninguno se pierde
+    std::vector<SimHCSR04::Shot>& shots = SimHCSR04::shots();
+    uint64_t prev = 0;
+    uint32_t busy = 0, fired = 0;
+    uint64_t min_gap = 0;
+    for(size_t k = 0; k < shots.size(); k++){
+        check(shots[k].id == (k % Sensors), "medida %u del sensor %u, esperado %u", (unsigned)k, shots[k].id,
+                (unsigned)(k % Sensors));
+        if(shots[k].id != 1){
+            continue;
+        }
+        fired += ((shots[k].trig + (ShortTimeoutMs * 1000)) <= now())? 1 : 0;
+        if(prev){
+            uint64_t gap = shots[k].trig - prev;
+            min_gap = (!min_gap || gap < min_gap)? gap : min_gap;
+            busy += (gap < (TriggerPulseUs + SimHCSR04::EchoDelayUs + SimHCSR04::NoEchoUs))? 1 : 0;
+        }
+        prev = shots[k].trig;
+    }
+    ProximityArray::ArrayStats st;
+    array->getStats(&st);
+    printf("    sensor 1: %u disparos, separacin mnima %lluus (echo sin obstculo de %uus)\r\n", fired,
+            (unsigned long long)min_gap, SimHCSR04::NoEchoUs);
+    check(SimHCSR04::ignored() == 0, "%u disparos ignorados por un sensor ocupado", SimHCSR04::ignored());
+    check(busy == 0, "%u disparos del sensor 1 con su echo anterior activo", busy);
+    check(st.deferred >= 4 && fired >= 5, "aplazados=%u, disparos del sensor 1 %u", st.deferred, fired);
+    check(st.timeouts == fired, "timeouts=%u, medidas sin echo %u", st.timeouts, fired);
+    std::vector<BenchPub> p = published("prox/1/dist");
+    check(p.size() == 1 && p[0].a == 2, "sensor 1: %u eventos de error", (unsigned)p.size());
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioMedian(){
+    createManager();
+    command("prox/cmd/filter", "5");
+    Thread::takeAllWakes();
+    uint64_t t0 = now();
+    BenchPub out;
+    for(int i = 0; i < 10; i++){
+        out = sample(200);
+    }
+    check(out.a == 200 && out.b == 0, "salida %d,%d en reposo", out.a, out.b);
+
+    // hasta (N-1)/2 valores atpicos consecutivos no alteran la salida
+    int max_dev = 0;
+    static const int16_t outliers[] = {400, 200, 200, 20, 390, 200, 200, 200};
+    for(size_t i = 0; i < sizeof(outliers) / sizeof(outliers[0]); i++){
+        out = sample(outliers[i]);
+        max_dev = std::max(max_dev, abs(out.a - 200));
+    }
+    check(max_dev == 0, "desviacin de %dcm con valores atpicos", max_dev);
+
+    // un escaln se refleja tras (N+1)/2 muestras
+    int delay = -1;
+    for(int i = 0; i < 10; i++){
+        out = sample(100);
+        if(delay < 0 && out.a == 100){
+            delay = i + 1;
+        }
+        check(out.a == 200 || out.a == 100, "salida %d durante el escaln", out.a);
+    }
+    report(t0);
+    printf("    escaln 200->100cm: %d muestras (%dms)\r\n", delay, delay * (SamplePeriod / 1000));
+    check(delay == 3, "escaln reflejado tras %d muestras, esperadas 3", delay);
+
+    // sin filtros no se publica la salida filtrada
+    command("prox/cmd/filter", "0");
+    out = sample(100);
+    check(out.topic.empty(), "salida filtrada publicada con los filtros desactivados");
+    int16_t d = 0, v = 0;
+    check(!proxman->getTrack(&d, &v), "salida filtrada vlida con los filtros desactivados");
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioKalman(){
+    createManager();
+    command("prox/cmd/filter", "0,2,100");
+    Thread::takeAllWakes();
+    uint64_t t0 = now();
+
+    // objeto acercndose a 50cm/s desde 300cm, con ruido de +-2cm
+    BenchPub out;
+    int max_err = 0, max_verr = 0;
+    double truth = 300;
+    uint32_t seed = 1;
+    for(int i = 0; i < 40; i++){
+        seed = (seed * 1103515245) + 12345;
+        int noise = (int)((seed >> 16) % 5) - 2;
+        out = sample((int16_t)(truth + noise));
+        if(i >= 20){
+            max_err = std::max(max_err, (int)fabs(out.a - truth));
+            max_verr = std::max(max_verr, abs(out.b - 50));
+        }
+        truth -= 50.0 * SamplePeriod / 1000000;
+    }
+    printf("    aproximacin 50cm/s: error max=%dcm, velocidad %dcm/s (error max %dcm/s)\r\n", max_err, out.b, max_verr);
+    check(max_err <= 4, "error de distancia de %dcm en aproximacin", max_err);
+    check(max_verr <= 10, "error de velocidad de %dcm/s en aproximacin", max_verr);
+
+    // el objeto se detiene: la velocidad estimada vuelve a cero
+    int16_t stop = (int16_t)truth;
+    int settle = -1;
+    for(int i = 0; i < 40; i++){
+        out = sample(stop);
+        if(settle < 0 && abs(out.b) <= 5 && abs(out.a - stop) <= 2){
+            settle = i + 1;
+        }
+    }
+    printf("    parada: velocidad <= 5cm/s tras %d muestras, salida final %d,%d\r\n", settle, out.a, out.b);
+    check(settle > 0 && settle <= 30, "velocidad estimada sin converger tras la parada (%d)", settle);
+    check(out.a == stop && abs(out.b) <= 2, "salida %d,%d con el objeto detenido en %d", out.a, out.b, stop);
+
+    // escaln de 60cm (otro objeto): tiempo hasta recuperar un error de 2cm
+    int16_t step = stop - 60;
+    settle = -1;
+    for(int i = 0; i < 40; i++){
+        out = sample(step);
+        if(settle < 0 && abs(out.a - step) <= 2){
+            settle = i + 1;
+        }
+    }
+    printf("    escaln de 60cm: error <= 2cm tras %d muestras (%dms)\r\n", settle, settle * (SamplePeriod / 1000));
+    check(settle > 0 && settle <= 10, "escaln sin converger (%d muestras)", settle);
+
+    // un error de medida reinicia el filtro en la siguiente medida vlida
+    sample(-1);
+    out = sample(150);
+    check(out.a == 150 && out.b == 0, "salida %d,%d tras un error de medida", out.a, out.b);
+
+    // mediana + Kalman: aproximacin con un valor atpico cada 7 muestras
+    command("prox/cmd/filter", "5,2,100");
+    truth = 300;
+    max_err = 0;
+    for(int i = 0; i < 40; i++){
+        int16_t d = (int16_t)truth;
+        out = sample(((i % 7) == 3)? (d * 2) : d);
+        if(i >= 20){
+            max_err = std::max(max_err, (int)fabs(out.a - truth));
+        }
+        truth -= 50.0 * SamplePeriod / 1000000;
+    }
+    report(t0);
+    printf("    mediana + Kalman con valores atpicos: error max=%dcm, velocidad %dcm/s\r\n", max_err, out.b);
+    check(max_err <= 10, "error de %dcm con valores atpicos", max_err);
+    check(abs(out.b - 50) <= 10, "velocidad de %dcm/s con valores atpicos", out.b);
+}
+
+
+
+// **************************************************************************
+// *********** MAIN *********************************************************
+// **************************************************************************
+
+//------------------------------------------------------------------------------------
+static const char* scenarios[] = {"order", "timeout", "busy", "median", "kalman"};
+
+
+//------------------------------------------------------------------------------------
+static int runScenario(std::string name){
+    printf("\r\n[%s]\r\n", name.c_str());
+    if(name == "order")         { scenarioOrder(); }
+    else if(name == "timeout")  { scenarioTimeout(); }
+    else if(name == "busy")     { scenarioBusy(); }
+    else if(name == "median")   { scenarioMedian(); }
+    else if(name == "kalman")   { scenarioKalman(); }
+    else{
+        printf("    escenario desconocido\r\n");
+        return 1;
+    }
+    printf("    %s\r\n", (failures)? "ERROR" : "OK");
+    fflush(stdout);
+    return (failures)? 1 : 0;
+}
+
+
+//------------------------------------------------------------------------------------
+int main(int argc, char** argv){
+    if(argc > 1){
+        // las tareas siguen bloqueadas en sus hilos, se finaliza sin destruir objetos
+        _exit(runScenario(argv[1]));
+    }
+
+    // cada escenario en un proceso independiente, con el tiempo y los sensores simulados en su estado inicial
+    int result = 0;
+    for(size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++){
+        pid_t pid = fork();
+        if(pid == 0){
+            _exit(runScenario(scenarios[i]));
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        result |= (WIFEXITED(status))? WEXITSTATUS(status) : 1;
+    }
+    return result;
+}
@@ -3,6 +3,7 @@
 #include "MQSerialBridge.h"
 #include "Logger.h"
 #include "ProximityManager.h"
+#include "ProximityArray.h"
 
 
 // **************************************************************************
@@ -25,6 +26,9 @@ static Logger* logger;
 /** Driver control detector */
 static ProximityManager* distdrv;
 
+/** Array de detectores disparados por turno */
+static ProximityArray* distarr;
+
 
 // **************************************************************************
 // *********** TEST  ********************************************************
@@ -72,11 +76,31 @@ void test_ProximityManager(){
     MQ::MQClient::subscribe("prox/sta/#", new MQ::SubscribeCallback(&distEvtSubscription));
     DEBUG_TRACE("OK!\r\n");
     
+    // --------------------------------------
+    // Creo un array de dos detectores, disparados por turno sin interferencias entre ellos
+    DEBUG_TRACE("\r\nCreando array de proximidad...");    
+    distarr = new ProximityArray();
+    distarr->setDebugChannel(logger);
+    while(!distarr->ready()){
+        Thread::yield();
+    }
+    distarr->add(PB_8, PB_9, "parr/0/sta");
+    distarr->add(PB_10, PB_11, "parr/1/sta");
+    distarr->config(0, 200, 10, 10);
+    distarr->config(1, 200, 10, 10);
+    distarr->setSubscriptionBase("parr/cmd");
+    MQ::MQClient::subscribe("parr/#", new MQ::SubscribeCallback(&distEvtSubscription));
+    DEBUG_TRACE("OK!\r\n");
+    
     // --------------------------------------
     // Arranca el test
     DEBUG_TRACE("\r\n...................INICIO DEL TEST.........................\r\n");    
     DEBUG_TRACE("\r\n- Ajustar eventos: prox/cmd/config D,I,O,F,R,Ei,Er");    
     DEBUG_TRACE("\r\n- Iniciar captura: prox/cmd/start T");    
-    DEBUG_TRACE("\r\n- Detener captura: prox/cmd/stop 0\r\n");    
+    DEBUG_TRACE("\r\n- Filtrar medidas: prox/cmd/filter M,N,A (con Ei=1, publica prox/sta/track D,V)");    
+    DEBUG_TRACE("\r\n- Detener captura: prox/cmd/stop 0");    
+    DEBUG_TRACE("\r\n- Ajustar sensor del array: parr/cmd/config S,D,I,O");    
+    DEBUG_TRACE("\r\n- Iniciar captura del array: parr/cmd/start T,t,G (eventos en parr/S/sta/dist)");    
+    DEBUG_TRACE("\r\n- Detener captura del array: parr/cmd/stop 0\r\n");    
 }
 
@@ -26,115 +26,1924 @@ ServoManager::ServoManager(PinName sda, PinName scl, uint8_t num_servos) : PCA96
             
     _debug = 0;
     _sub_topic = 0;    
-    _rmove.duty = NULL;
+    _pub_topic = 0;
+    _pub_topic_unique = 0;
+    _rmove[0] = 0;
+    _rmove[1] = 0;
+    _rmove_front = 0;
+    _rmove_active = false;
+    _rmove_staged = false;
+    _fade_left = 0;
+    _tick_period_us = 0;
+    _fs = 0;
+    _stream_active = false;
+    _stream = 0;
+    _stream_name[0] = 0;
+    _stream_speed = 100;
+    _rec_active = false;
+    _rec_busy = false;
+    _rec = 0;
+    _duty_req = 0;
+    _duty_out = 0;
+    _slew = 0;
+    _num_servos = 0;
+    allocServos(num_servos);
     _num_servos = num_servos;
-    for(uint8_t i=0; i<PCA9685_ServoDrv::ServoCount; i++){
-        _move_step[i] = NULL;
+    _num_ctrl = 1;
+    _cal_page = 0;
+    _ctrl[0].drv = this;
+    _ctrl[0].i2c = new I2C(sda, scl);
+    _ctrl[0].i2c->frequency(BusFrequency);
+    _ctrl[0].sda = sda;
+    _ctrl[0].scl = scl;
+    _ctrl[0].addr = BusBaseAddress;
+    _ctrl[0].first = 0;
+    _ctrl[0].num = num_servos;
+    _ctrl[0].init = false;
+    _dirty = 0;
+    _slew_active = 0;
+    _coalesce_us = 0;
+    _coalesce_armed = false;
+    memset(&_bus_stats, 0, sizeof(BusStats));
+    _tick_count = 0;
+    _tick_ts = 0;
+    _tick_served = 0;
+    _tick_prev_ts = 0;
+    _idle = false;
+    _idle_fired = false;
+    _idle_ts = 0;
+    memset(&_tick_stats, 0, sizeof(TickStats));
+    _catch_up = CatchUpSkipSteps;
+    _stats_period_ms = 0;
+    _stats_pub_ts = 0;
+    _snap_seq = 0;
+    _info_req = 0;
+    _read_req = 0;
+    _read_err = 0;
+    _read_mismatch = 0;
+    _read_errors = 0;
+                    
+    // Carga callbacks estticas de publicacin/suscripcin    
+    _subscrCb = callback(this, &ServoManager::subscriptionCb);   
+    _publCb = callback(this, &ServoManager::publicationCb);   
+    
+    // Inicializa parmetros del hilo de ejecucin propio
+    _th.start(callback(this, &ServoManager::task));    
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::ready(){
+    for(uint8_t c = 0; c < _num_ctrl; c++){
+        if(_ctrl[c].drv->getState() != PCA9685_ServoDrv::Ready){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+int16_t ServoManager::addController(PinName sda, PinName scl, uint8_t addr, uint8_t num_servos){
+    if(_num_ctrl >= MaxControllers || num_servos == 0 || num_servos > PCA9685_ServoDrv::ServoCount){
+        DEBUG_TRACE("\r\nServoManager: ERR_CTRL, no se puede aadir el controlador\r\n");
+        return -1;
+    }
+    _mut.lock();
+    // ampla la cach y el estado del limitador a los nuevos servos
+    if(!allocServos(_num_servos + num_servos)){
+        _mut.unlock();
+        DEBUG_TRACE("\r\nServoManager: ERR_MEM, no se puede aadir el controlador\r\n");
+        return -1;
+    }
+    Controller_t* ctrl = &_ctrl[_num_ctrl];
+    ctrl->drv = new PCA9685_ServoDrv(sda, scl, num_servos, addr);
+    // reutiliza el bus si ya existe otro controlador en los mismos pines
+    ctrl->i2c = 0;
+    for(uint8_t c = 0; c < _num_ctrl; c++){
+        if(_ctrl[c].sda == sda && _ctrl[c].scl == scl){
+            ctrl->i2c = _ctrl[c].i2c;
+            break;
+        }
+    }
+    if(!ctrl->i2c){
+        ctrl->i2c = new I2C(sda, scl);
+        ctrl->i2c->frequency(BusFrequency);
+    }
+    ctrl->sda = sda;
+    ctrl->scl = scl;
+    ctrl->addr = BusBaseAddress | ((addr & 0x3f) << 1);
+    ctrl->first = _num_servos;
+    ctrl->num = num_servos;
+    ctrl->init = false;
+    _num_servos += num_servos;
+    _num_ctrl++;
+    _mut.unlock();
+    return ctrl->first;
+}
+
+
+//------------------------------------------------------------------------------------
+PCA9685_ServoDrv* ServoManager::getServoDriver(uint8_t servo, uint8_t* local){
+    for(uint8_t c = 0; c < _num_ctrl; c++){
+        if(servo >= _ctrl[c].first && servo < (_ctrl[c].first + _ctrl[c].num)){
+            *local = servo - _ctrl[c].first;
+            return _ctrl[c].drv;
+        }
+    }
+    *local = 0;
+    return 0;
+}
+
+
+//------------------------------------------------------------------------------------
+PCA9685_ServoDrv::ErrorResult ServoManager::setServoAngle(uint8_t servo, uint8_t angle, bool update){
+    uint8_t local;
+    PCA9685_ServoDrv* drv = getServoDriver(servo, &local);
+    if(!drv){
+        return InvalidServoError;
+    }
+    _mut.lock();
+    // el driver convierte el ngulo segn la calibracin del servo, sin acceso al chip
+    ErrorResult result = drv->setServoAngle(local, angle);
+    if(result == Success){
+        result = applyDuty(servo, drv->getServoDuty(local), update);
+    }
+    _mut.unlock();
+    return result;
+}
+
+
+//------------------------------------------------------------------------------------
+PCA9685_ServoDrv::ErrorResult ServoManager::setServoDuty(uint8_t servo, uint16_t duty, bool update){
+    if(servo >= _num_servos){
+        return InvalidServoError;
+    }
+    _mut.lock();
+    ErrorResult result = applyDuty(servo, duty, update);
+    _mut.unlock();
+    return result;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::setSlewLimits(uint8_t servo, uint16_t max_vel, uint16_t max_acc){
+    if(servo >= _num_servos){
+        return false;
+    }
+    // convierte los lmites a pasos de duty por tick del limitador, en punto fijo
+    int32_t vmax = (int32_t)((((uint64_t)max_vel << SlewFracBits) * SlewTickUs) / 1000000);
+    int32_t amax = (int32_t)((((uint64_t)max_acc << SlewFracBits) * SlewTickUs * SlewTickUs) / 1000000000000ULL);
+    _mut.lock();
+    _slew[servo].vmax = (max_vel && !vmax)? 1 : vmax;
+    _slew[servo].amax = (max_acc && !amax)? 1 : amax;
+    _mut.unlock();
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::moveServo(uint8_t servo, uint16_t duty){
+    moveGroup(&servo, &duty, 1);
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::moveGroup(const uint8_t* servo, const uint16_t* duty, uint8_t count){
+    _mut.lock();
+    for(uint8_t i = 0; i < count; i++){
+        setTarget(servo[i], duty[i]);
+    }
+    // una nica actualizacin para todos los servos del grupo
+    commitTargets();
+    _mut.unlock();
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::savePose(uint8_t id){
+    if(!_fs){
+        return false;
+    }
+    uint32_t size = sizeof(PoseHeader) + (_num_servos * sizeof(uint16_t));
+    uint8_t* data = (uint8_t*)Heap::memAlloc(size);
+    if(!data){
+        return false;
+    }
+    char name[StreamNameLen];
+    sprintf(name, "pose%d", id);
+    PoseHeader hdr = {PoseMagic, _num_servos, {0, 0, 0}};
+    memcpy(data, &hdr, sizeof(PoseHeader));
+    _mut.lock();
+    memcpy(&data[sizeof(PoseHeader)], _duty_req, hdr.num_servos * sizeof(uint16_t));
+    _mut.unlock();
+    bool result = (_fs->save(name, data, size) == (int)size)? true : false;
+    Heap::memFree(data);
+    return result;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::recallPose(uint8_t id){
+    if(!_fs){
+        return false;
+    }
+    uint32_t size = sizeof(PoseHeader) + (MaxServos * sizeof(uint16_t));
+    uint8_t* data = (uint8_t*)Heap::memAlloc(size);
+    if(!data){
+        return false;
+    }
+    char name[StreamNameLen];
+    sprintf(name, "pose%d", id);
+    int rd = _fs->restore(name, data, size);
+    PoseHeader* hdr = (PoseHeader*)data;
+    if(rd < (int)sizeof(PoseHeader) || hdr->magic != PoseMagic || hdr->num_servos > MaxServos ||
+       rd < (int)(sizeof(PoseHeader) + (hdr->num_servos * sizeof(uint16_t)))){
+        Heap::memFree(data);
+        return false;
+    }
+    uint16_t* duty = (uint16_t*)&data[sizeof(PoseHeader)];
+    _mut.lock();
+    for(uint8_t i = 0; i < hdr->num_servos; i++){
+        // los servos sin duty conocido al guardar la pose no se modifican
+        if(duty[i] != InvalidDuty){
+            setTarget(i, duty[i]);
+        }
+    }
+    commitTargets();
+    _mut.unlock();
+    Heap::memFree(data);
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::setCoalescing(uint16_t period_ms){
+    _mut.lock();
+    _coalesce_us = period_ms * 1000;
+    _mut.unlock();
+    // al desactivarlo, escribe los destinos pendientes
+    if(!period_ms){
+        flushPending();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+uint32_t ServoManager::flushPending(){
+    _mut.lock();
+    _tick_coalesce.detach();
+    _coalesce_armed = false;
+    uint32_t bytes = flushDuty();
+    _mut.unlock();
+    return bytes;
+}
+
+
+//------------------------------------------------------------------------------------
+PCA9685_ServoDrv::ErrorResult ServoManager::updateAll(){
+    _mut.lock();
+    // el driver refleja la salida de la cach (las rdenes por ngulo no lo modifican hasta que la aproximacin cambia la
+    // salida), as que cualquier diferencia procede de una escritura directa
+    for(uint8_t i=0; i<_num_servos; i++){
+        uint8_t local = 0;
+        PCA9685_ServoDrv* drv = getServoDriver(i, &local);
+        if(drv && drv->getServoDuty(local) != _duty_req[i]){
+            setDuty(i, drv->getServoDuty(local));
+        }
+    }
+    _tick_coalesce.detach();
+    _coalesce_armed = false;
+    flushDuty();
+    ErrorResult result = (_dirty)? I2CError : Success;
+    _mut.unlock();
+    return result;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::startMovement(uint16_t* duty, uint8_t steps, uint32_t step_tick_us, uint8_t servo_zero, uint8_t step_dif, SwapMode swap, uint8_t fade_steps){
+    if(servo_zero >= _num_servos || steps == 0){
+        return;
+    }
+    
+    _mut.lock();
+    // si hay un fundido en curso, lo finaliza para liberar el buffer de reserva
+    _fade_left = 0;
+    
+    // prepara el nuevo movimiento en el buffer de reserva
+    if(!moveAlloc(_rmove_front ^ 1)){
+        _mut.unlock();
+        DEBUG_TRACE("\r\nServoManager: ERR_MEM, no se puede iniciar el movimiento\r\n");
+        return;
+    }
+    RepetitiveMovement_t* back = _rmove[_rmove_front ^ 1];
+    back->steps = steps;
+    back->step_tick_us = step_tick_us;
+    back->servo_zero = servo_zero;
+    for(uint8_t i=0;i<steps;i++){
+        back->duty[i] = duty[i];
+    }
+    for(uint8_t i=servo_zero;i<back->servos;i++){
+        back->offset[i] = (step_dif * (i - servo_zero)) % steps;
+    }
+    for(int8_t i=servo_zero-1;i>=0;i--){
+        back->offset[i] = (step_dif * (servo_zero-i)) % steps;
+    }
+    _rmove_swap = swap;
+    _fade_steps = fade_steps;
+    _rmove_staged = true;
+    
+    // si no hay movimiento en curso, lo inicia directamente, deteniendo la reproduccin de ficheros
+    if(!_rmove_active){
+        _rmove_swap = SwapAtCycleEnd;
+        _fade_steps = 0;
+        swapMovement();
+        _rmove_active = true;
+        _stream_active = false;
+        tickStart(step_tick_us);
+    }
+    // con el ticker suspendido, el cambio se atiende en el siguiente lmite de paso
+    else{
+        tickWake();
+    }
+    _mut.unlock();
+    _th.signal_set(StreamStopFlag);
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::stopMovement(){
+    _mut.lock();
+    if(!_stream_active){
+        tickStop();
+    }
+    _rmove_active = false;
+    _rmove_staged = false;
+    _fade_left = 0;
+    _mut.unlock();
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::playMotion(const char* data_id, uint16_t speed){
+    if(!_fs || !data_id || strlen(data_id) >= StreamNameLen){
+        return false;
+    }
+    _mut.lock();
+    strcpy(_stream_name, data_id);
+    _stream_speed = (speed)? speed : 100;
+    _mut.unlock();
+    _th.signal_set(StreamStartFlag);
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::stopMotion(){
+    _th.signal_set(StreamStopFlag);
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::startRecord(const char* data_id, uint32_t step_tick_us){
+    if(!_fs || !data_id || strlen(data_id) >= StreamNameLen || step_tick_us == 0){
+        return false;
+    }
+    _mut.lock();
+    // no admite una nueva grabacin hasta que la tarea cierre la anterior
+    if(_rec_busy || !recordAlloc()){
+        _mut.unlock();
+        return false;
+    }
+    strcpy(_rec->name, data_id);
+    _rec->step_tick_us = step_tick_us;
+    _rec->t0 = us_ticker_read();
+    _rec->tick = 0;
+    _rec->head = 0;
+    _rec->tail = 0;
+    _rec->dropped = 0;
+    _rec->dec_tick = 0;
+    _rec->frame_tick = 0;
+    _rec->frames = 0;
+    _rec->out_len = 0;
+    // la primera trama contiene el duty absoluto de todos los servos
+    _rec->frame_mask = 0;
+    for(uint8_t i = 0; i < _rec->servos; i++){
+        uint16_t duty = _duty_req[i];
+        if(duty == InvalidDuty){
+            uint8_t local = 0;
+            PCA9685_ServoDrv* drv = getServoDriver(i, &local);
+            if(drv){
+                duty = drv->getServoDuty(local);
+            }
+        }
+        _rec->last[i] = duty;
+        _rec->frame_duty[i] = duty;
+        _rec->emit_duty[i] = InvalidDuty;
+        _rec->frame_mask |= ((uint64_t)1 << i);
+    }
+    _rec_busy = true;
+    _rec_active = true;
+    _mut.unlock();
+    _th.signal_set(RecordStartFlag);
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::stopRecord(){
+    _mut.lock();
+    if(!_rec_active){
+        _mut.unlock();
+        return;
+    }
+    _rec->stop_tick = (us_ticker_read() - _rec->t0) / _rec->step_tick_us;
+    _rec_active = false;
+    _mut.unlock();
+    _th.signal_set(RecordStopFlag);
+}
+
+
+//------------------------------------------------------------------------------------
+ServoManager::CalResult ServoManager::saveCalibration(){
+    CalResult result = CalError;
+    uint32_t* page = (uint32_t*)Heap::memAlloc(NVFlash::getPageSize());
+    uint32_t* caldata = (uint32_t*)Heap::memAlloc(NVFlash::getPageSize());
+    if(page && caldata){
+        // el resultado global es el de mayor coste (error > borrado > escritura > sin cambios)
+        result = CalUnchanged;
+        for(uint8_t c = 0; c < _num_ctrl; c++){
+            CalResult res = calSave(c, page, caldata);
+            if(res == CalError || (res == CalSavedErased && result != CalError) || (res == CalSaved && result == CalUnchanged)){
+                result = res;
+            }
+        }
+    }
+    if(page){
+        Heap::memFree(page);
+    }
+    if(caldata){
+        Heap::memFree(caldata);
+    }
+    return result;
+}
+
+
+//------------------------------------------------------------------------------------
+ServoManager::CalResult ServoManager::restoreCalibration(){
+    uint32_t* page = (uint32_t*)Heap::memAlloc(NVFlash::getPageSize());
+    if(!page){
+        return CalError;
+    }
+    // el resultado global es el del controlador 0, salvo que alguno falle
+    CalResult result = CalError;
+    for(uint8_t c = 0; c < _num_ctrl; c++){
+        CalResult res = calRestore(c, page);
+        if(c == 0 || res == CalError){
+            result = res;
+        }
+    }
+    Heap::memFree(page);
+    return result;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::getBusStats(BusStats* stats){
+    _mut.lock();
+    *stats = _bus_stats;
+    _mut.unlock();
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::getTickStats(TickStats* stats){
+    _mut.lock();
+    *stats = _tick_stats;
+    _mut.unlock();
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::resetTickStats(){
+    _mut.lock();
+    memset(&_tick_stats, 0, sizeof(TickStats));
+    _mut.unlock();
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::getServoInfo(uint8_t servo, ServoInfo* info){
+    uint8_t local;
+    PCA9685_ServoDrv* drv = getServoDriver(servo, &local);
+    if(!drv){
+        return false;
+    }
+    _mut.lock();
+    info->servo = servo;
+    // la salida vigente es la de la cach (durante una aproximacin, su paso actual y no el destino)
+    if(_duty_req[servo] != InvalidDuty){
+        info->duty = _duty_req[servo];
+        info->angle = drv->getAngleFromDuty(local, info->duty);
+    }
+    else{
+        info->duty = drv->getServoDuty(local);
+        info->angle = drv->getServoAngle(local);
+    }
+    drv->getServoRanges(local, &info->min_ang, &info->max_ang, &info->min_duty, &info->max_duty);
+    info->flags = servoFlags(servo);
+    info->reserved = 0;
+    info->read_duty = InvalidDuty;
+    _mut.unlock();
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::setSnapshotPeriod(uint32_t period_ms){
+    _tick_snap.detach();
+    // la publicacin se realiza desde la tarea
+    if(!period_ms){
+        _th.signal_set(SnapshotFlag);
+        return;
+    }
+    _tick_snap.attach_us(callback(this, &ServoManager::onSnapshotCb), period_ms * 1000);
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::setSubscriptionBase(const char* sub_topic) {
+    if(_sub_topic){
+        DEBUG_TRACE("\r\nServoManager: ERROR_SUB ya hecha!\r\n");
+        return;
+    }
+    
+    _sub_topic = (char*)sub_topic; 
+ 
+    // Se suscribe a $sub_topic/#
+    char* suscr = (char*)Heap::memAlloc(strlen(sub_topic) + strlen("/#")+1);
+    if(suscr){
+        sprintf(suscr, "%s/#", _sub_topic);
+        MQ::MQClient::subscribe(suscr, &_subscrCb);
+        DEBUG_TRACE("\r\nServoManager: Suscrito a %s/#\r\n", sub_topic);
+    }     
+}   
+
+//------------------------------------------------------------------------------------
+void ServoManager::setPublicationBase(const char* pub_topic) {
+    _pub_topic = (char*)pub_topic; 
+    if(!_pub_topic_unique){
+        _pub_topic_unique = (char*)Heap::memAlloc(MQ::MQClient::getMaxTopicLen());
+    }
+}   
+
+
+//------------------------------------------------------------------------------------
+//- PROTECTED CLASS IMPL. ------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::task(){
+    
+    do{
+        Thread::yield();
+    }while(PCA9685_ServoDrv::getState() != PCA9685_ServoDrv::Ready);
+    
+    // habilita las escrituras en rfaga (el resto de controladores se configuran al estar disponibles)
+    if(!initController(&_ctrl[0])){
+        DEBUG_TRACE("\r\nServoManager: ERR_AI, no se puede activar el auto-incremento\r\n");
+    }
+       
+    // Arranca espera
+    _timeout = osWaitForever;
+    for(;;){
+        osEvent evt = _th.signal_wait(0, _timeout);
+        if(evt.status == osEventSignal){   
+            uint32_t sig = evt.value.signals;
+            
+            if((sig & RecordStartFlag)!=0){
+                recordOpen();
+            }
+            
+            if((sig & (RecordFlushFlag | RecordStopFlag))!=0){
+                recordFlush(((sig & RecordStopFlag)!=0)? true : false);
+            }
+            
+            if((sig & StreamStopFlag)!=0){
+                streamStop();
+            }
+            
+            if((sig & StreamStartFlag)!=0){
+                if(!streamStart()){
+                    DEBUG_TRACE("\r\nServoManager: ERR_PLAY %s\r\n", _stream_name);
+                }
+            }
+            
+            if((sig & CoalesceFlag)!=0){
+                flushPending();
+            }
+            
+            if((sig & SlewTickFlag)!=0){
+                _mut.lock();
+                if(_slew_active){
+                    slewStep();
+                }
+                _mut.unlock();
+            }
+            
+            if((sig & SnapshotFlag)!=0){
+                publishSnapshot();
+            }
+            
+            if((sig & InfoFlag)!=0){
+                publishRequests();
+            }
+            
+            if((sig & StatsFlag)!=0){
+                publishTickStats();
+            }
+            
+            if((sig & TickMoveFlag)!=0){
+                // obtiene los ticks generados desde el ltimo atendido, varios pueden agruparse en una misma seal
+                core_util_critical_section_enter();
+                uint32_t count = _tick_count;
+                uint32_t ts = _tick_ts;
+                core_util_critical_section_exit();
+                uint32_t pending = count - _tick_served;
+                _tick_served = count;
+                
+                // prepara el siguiente movimiento de cada servo
+                _mut.lock();
+                // tras una suspensin, avanza los pasos omitidos (sin cambios) hasta el tick de reanudacin
+                if(_idle && pending){
+                    uint32_t skip = (ts - _idle_ts + (_tick_period_us / 2)) / _tick_period_us;
+                    skip = (skip > 0)? (skip - 1) : 0;
+                    skipSteps(skip);
+                    _tick_prev_ts += (skip * _tick_period_us);
+                    _tick_stats.suspended += skip;
+                    _idle = false;
+                    _idle_fired = false;
+                }
+                if((_rmove_active || _stream_active) && pending){
+                    // si se han perdido ticks, avanza la fase en la cach sin acceder al bus
+                    uint32_t steps = (_catch_up == CatchUpAdvancePhase)? pending : 1;
+                    if(steps > MaxMoveSteps){
+                        steps = MaxMoveSteps;
+                    }
+                    while(steps--){
+                        playStep();
+                    }
+                    // actualiza nicamente los servos que han cambiado
+                    // la latencia se mide hasta completar la escritura en el chip
+                    uint32_t t0 = us_ticker_read();
+                    flushDuty();
+                    uint32_t t1 = us_ticker_read();
+                    updateTickStats(t1, ts, pending, t1 - t0);
+                    // los comandos agrupados pendientes se han escrito junto con el movimiento
+                    if(_coalesce_armed && !_dirty){
+                        _tick_coalesce.detach();
+                        _coalesce_armed = false;
+                    }
+                    // si los siguientes pasos no modifican ningn servo, suspende el ticker hasta el primero que lo haga
+                    uint32_t still = stillSteps();
+                    if(still >= IdleMinSteps){
+                        tickSuspend(ts, still);
+                    }
+                }
+                _mut.unlock();
+                
+                // rellena el bloque agotado mientras se reproduce el otro
+                if(_stream && _stream->refill){
+                    streamRefill();
+                }
+                
+                // publica las estadsticas peridicamente
+                uint32_t now = us_ticker_read();
+                if(_stats_period_ms && (now - _stats_pub_ts) >= (_stats_period_ms * 1000)){
+                    _stats_pub_ts = now;
+                    publishTickStats();
+                }
+            } 
+        }
+    }
+}
+    
+
+//------------------------------------------------------------------------------------
+void ServoManager::onTickCb(){
+    _tick_ts = us_ticker_read();
+    _tick_count++;
+    _th.signal_set(TickMoveFlag);   
+}        
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::onIdleCb(){
+    _idle_fired = true;
+    _tick_move.attach_us(callback(this, &ServoManager::onTickCb), _tick_period_us);
+    onTickCb();
+}        
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::tickStart(uint32_t period_us){
+    _tick_idle.detach();
+    _idle = false;
+    _idle_fired = false;
+    _tick_period_us = period_us;
+    _tick_move.attach_us(callback(this, &ServoManager::onTickCb), period_us);
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::tickStop(){
+    _tick_move.detach();
+    _tick_idle.detach();
+    _idle = false;
+    _idle_fired = false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::tickSuspend(uint32_t ts, uint32_t steps){
+    _tick_move.detach();
+    _idle = true;
+    _idle_fired = false;
+    _idle_ts = ts;
+    // reanuda en el instante en que se habra generado el primer paso con cambios
+    int32_t delay = (int32_t)((ts + ((steps + 1) * _tick_period_us)) - us_ticker_read());
+    _tick_idle.attach_us(callback(this, &ServoManager::onIdleCb), (delay > 0)? delay : 1);
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::tickWake(){
+    core_util_critical_section_enter();
+    if(_idle && !_idle_fired){
+        uint32_t elapsed = us_ticker_read() - _idle_ts;
+        _tick_idle.attach_us(callback(this, &ServoManager::onIdleCb), _tick_period_us - (elapsed % _tick_period_us));
+    }
+    core_util_critical_section_exit();
+}
+
+
+//------------------------------------------------------------------------------------
+uint32_t ServoManager::stillSteps(){
+    if(_stream_active){
+        return _stream->hold;
+    }
+    // durante un fundido o con un cambio de movimiento pendiente, cada paso puede modificar los servos
+    if(!_rmove_active || _rmove_staged || _fade_left){
+        return 0;
+    }
+    RepetitiveMovement_t* front = _rmove[_rmove_front];
+    uint32_t still = 0;
+    while(still < front->steps){
+        for(uint8_t i = 0; i < front->servos; i++){
+            if(front->duty[(front->step[i] + still) % front->steps] != _duty_req[i]){
+                return still;
+            }
+        }
+        still++;
+    }
+    return still;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::skipSteps(uint32_t steps){
+    if(_stream_active){
+        _stream->hold = (steps < _stream->hold)? (_stream->hold - steps) : 0;
+        return;
+    }
+    if(_rmove_active){
+        RepetitiveMovement_t* front = _rmove[_rmove_front];
+        for(uint8_t i = 0; i < front->servos; i++){
+            front->step[i] = (uint8_t)((front->step[i] + steps) % front->steps);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::onSlewTickCb(){
+    _th.signal_set(SlewTickFlag);   
+}        
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::setTarget(uint8_t servo, uint16_t duty){
+    if(servo >= _num_servos){
+        return;
+    }
+    uint64_t mask = ((uint64_t)1 << servo);
+    Slew_t* sl = &_slew[servo];
+    // sin lmites o sin posicin conocida, se aplica de forma inmediata
+    if((sl->vmax == 0 && sl->amax == 0) || _duty_req[servo] == InvalidDuty){
+        _slew_active &= ~mask;
+        if(_coalesce_us && (_dirty & mask) != 0){
+            _bus_stats.coalesced++;
+        }
+        setDuty(servo, duty);
+        recordCapture(servo, duty);
+        return;
+    }
+    // si no hay aproximacin en curso, parte en reposo desde el duty actual
+    if((_slew_active & mask) == 0 || _duty_req[servo] != sl->out){
+        sl->pos = (int32_t)_duty_req[servo] << SlewFracBits;
+        sl->vel = 0;
+        sl->out = _duty_req[servo];
+    }
+    sl->target = (int32_t)duty << SlewFracBits;
+    if(!_slew_active){
+        _tick_slew.attach_us(callback(this, &ServoManager::onSlewTickCb), SlewTickUs);
+    }
+    _slew_active |= mask;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::groupAngle(uint8_t servo, uint8_t deg){
+    uint8_t local;
+    PCA9685_ServoDrv* drv = getServoDriver(servo, &local);
+    if(drv){
+        // el destino se calcula sin modificar el driver, que refleja la salida actual mientras dura la aproximacin
+        setTarget(servo, drv->getDutyFromAngle(local, deg));
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::commitTargets(){
+    // un movimiento repetitivo suspendido reescribe sus servos en el siguiente paso, como si no lo estuviera
+    tickWake();
+    if(!_dirty){
+        return;
+    }
+    if(!_coalesce_us){
+        flushDuty();
+    }
+    // en modo agrupacin, la escritura se realiza en el siguiente tick de movimiento o al vencer el plazo
+    else if(!_coalesce_armed){
+        _coalesce_armed = true;
+        _tick_coalesce.attach_us(callback(this, &ServoManager::onCoalesceCb), _coalesce_us);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::onCoalesceCb(){
+    _th.signal_set(CoalesceFlag);   
+}        
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::slewStep(){
+    for(uint8_t i = 0; i < _num_servos; i++){
+        uint64_t mask = ((uint64_t)1 << i);
+        if((_slew_active & mask) == 0){
+            continue;
+        }
+        Slew_t* sl = &_slew[i];
+        // otra fuente (movimiento, fichero) ha tomado el control del servo
+        if(_duty_req[i] != sl->out){
+            _slew_active &= ~mask;
+            continue;
+        }
+        int32_t err = sl->target - sl->pos;
+        int32_t dist = (err < 0)? -err : err;
+        
+        // velocidad deseada: la mxima que permite frenar en la distancia restante, limitada por vmax
+        int32_t vdes = dist;
+        if(sl->amax){
+            int32_t vstop = (int32_t)isqrt(2ULL * sl->amax * dist);
+            vdes = (vstop < vdes)? vstop : vdes;
+        }
+        if(sl->vmax && sl->vmax < vdes){
+            vdes = sl->vmax;
+        }
+        if(err < 0){
+            vdes = -vdes;
+        }
+        
+        // aplica la variacin de velocidad limitada por amax
+        int32_t dv = vdes - sl->vel;
+        if(sl->amax){
+            dv = (dv > sl->amax)? sl->amax : ((dv < -sl->amax)? -sl->amax : dv);
+        }
+        sl->vel += dv;
+        sl->pos += sl->vel;
+        
+        // destino alcanzado o sobrepasado por redondeo
+        if((err >= 0 && sl->pos >= sl->target) || (err <= 0 && sl->pos <= sl->target)){
+            sl->pos = sl->target;
+            sl->vel = 0;
+            _slew_active &= ~mask;
+        }
+        sl->out = (uint16_t)((sl->pos + (1 << (SlewFracBits - 1))) >> SlewFracBits);
+        setDuty(i, sl->out);
+        recordCapture(i, sl->out);
+    }
+    // una nica escritura para todos los servos en aproximacin
+    flushDuty();
+    if(!_slew_active){
+        _tick_slew.detach();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+uint32_t ServoManager::isqrt(uint64_t x){
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while(bit > x){
+        bit >>= 2;
+    }
+    while(bit){
+        if(x >= res + bit){
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else{
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)res;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::updateTickStats(uint32_t now, uint32_t ts, uint32_t pending, uint32_t bus_us){
+    _tick_stats.ticks = _tick_count;
+    _tick_stats.updates++;
+    if(pending > 1){
+        _tick_stats.missed += (pending - 1);
+        _tick_stats.coalesced++;
+    }
+    // el jitter slo es medible entre ticks consecutivos
+    else if(_tick_stats.updates > 1){
+        int32_t dev = (int32_t)(ts - _tick_prev_ts) - (int32_t)_tick_period_us;
+        uint32_t jitter = (dev < 0)? -dev : dev;
+        if(jitter > _tick_stats.jitter_max_us){
+            _tick_stats.jitter_max_us = jitter;
+        }
+    }
+    _tick_prev_ts = ts;
+    
+    _tick_stats.latency_us = now - ts;
+    _tick_stats.latency_avg_us = (_tick_stats.updates > 1)? 
+            (_tick_stats.latency_avg_us + (((int32_t)_tick_stats.latency_us - (int32_t)_tick_stats.latency_avg_us) / 8)) : 
+            _tick_stats.latency_us;
+    if(_tick_stats.latency_us > _tick_stats.latency_max_us){
+        _tick_stats.latency_max_us = _tick_stats.latency_us;
+    }
+    _tick_stats.bus_us = bus_us;
+    if(bus_us > _tick_stats.bus_max_us){
+        _tick_stats.bus_max_us = bus_us;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::publishTickStats(){
+    if(!_pub_topic_unique){
+        return;
+    }
+    getTickStats(&_tick_stats_msg);
+    sprintf(_pub_topic_unique, "%s/stats", _pub_topic);
+    MQ::MQClient::publish(_pub_topic_unique, &_tick_stats_msg, sizeof(TickStats), &_publCb);
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::onSnapshotCb(){
+    _th.signal_set(SnapshotFlag);   
+}        
+
+
+//------------------------------------------------------------------------------------
+uint8_t ServoManager::servoFlags(uint8_t servo){
+    uint64_t mask = ((uint64_t)1 << servo);
+    uint8_t flags = 0;
+    flags |= (_duty_req[servo] == InvalidDuty)? ServoUnknown : 0;
+    flags |= ((_dirty & mask) != 0)? ServoPending : 0;
+    flags |= ((_slew_active & mask) != 0)? ServoSlewing : 0;
+    flags |= ((_read_err & mask) != 0)? ServoReadError : 0;
+    flags |= ((_read_mismatch & mask) != 0)? ServoReadMismatch : 0;
+    return flags;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::readServo(uint8_t servo, ServoInfo* info){
+    if(!getServoInfo(servo, info)){
+        return false;
+    }
+    uint64_t mask = ((uint64_t)1 << servo);
+    uint8_t local;
+    PCA9685_ServoDrv* drv = getServoDriver(servo, &local);
+    uint16_t duty;
+    _mut.lock();
+    bool ok = (drv->readServoDuty(local, &duty) == PCA9685_ServoDrv::Success)? true : false;
+    _read_err = (ok)? (_read_err & ~mask) : (_read_err | mask);
+    // slo hay discrepancia si el duty escrito en el chip es conocido
+    bool mismatch = (ok && _duty_out[servo] != InvalidDuty && duty != _duty_out[servo])? true : false;
+    _read_mismatch = (mismatch)? (_read_mismatch | mask) : (_read_mismatch & ~mask);
+    _read_errors += (!ok || mismatch)? 1 : 0;
+    info->read_duty = (ok)? duty : InvalidDuty;
+    info->flags = servoFlags(servo);
+    _mut.unlock();
+    return (ok && !mismatch)? true : false;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::requestInfo(uint8_t servo, bool read){
+    if(servo >= _num_servos){
+        return;
+    }
+    core_util_critical_section_enter();
+    if(read){
+        _read_req |= ((uint64_t)1 << servo);
+    }
+    else{
+        _info_req |= ((uint64_t)1 << servo);
+    }
+    core_util_critical_section_exit();
+    _th.signal_set(InfoFlag);
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::publishRequests(){
+    core_util_critical_section_enter();
+    uint64_t info = _info_req;
+    uint64_t read = _read_req;
+    _info_req = 0;
+    _read_req = 0;
+    core_util_critical_section_exit();
+    for(uint8_t i = 0; i < _num_servos; i++){
+        uint64_t mask = ((uint64_t)1 << i);
+        if((info & mask) != 0 && getServoInfo(i, &_info_msg)){
+            publishInfo("info");
+        }
+        if((read & mask) != 0){
+            if(!readServo(i, &_info_msg)){
+                DEBUG_TRACE("\r\nServoManager: ERR_READ Servo %d\r\n", i); 
+            }
+            publishInfo("read");
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::publishInfo(const char* name){
+    if(!_pub_topic_unique){
+        return;
+    }
+    sprintf(_pub_topic_unique, "%s/%s", _pub_topic, name);
+    MQ::MQClient::publish(_pub_topic_unique, &_info_msg, sizeof(ServoInfo), &_publCb);
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::publishSnapshot(){
+    if(!_pub_topic_unique){
+        return;
+    }
+    _mut.lock();
+    uint32_t msg_len = sizeof(SnapshotHeader) + (_num_servos * sizeof(ServoState));
+    uint8_t* data = (uint8_t*)Heap::memAlloc(msg_len);
+    if(!data){
+        _mut.unlock();
+        return;
+    }
+    SnapshotHeader* hdr = (SnapshotHeader*)data;
+    ServoState* state = (ServoState*)&data[sizeof(SnapshotHeader)];
+    hdr->ts_us = us_ticker_read();
+    hdr->seq = _snap_seq++;
+    hdr->num_servos = _num_servos;
+    hdr->reserved = 0;
+    hdr->read_errors = _read_errors;
+    for(uint8_t i = 0; i < _num_servos; i++){
+        uint8_t local;
+        PCA9685_ServoDrv* drv = getServoDriver(i, &local);
+        state[i].duty = _duty_req[i];
+        state[i].angle = (drv)? drv->getServoAngle(local) : 0;
+        state[i].flags = servoFlags(i);
+    }
+    _mut.unlock();
+    sprintf(_pub_topic_unique, "%s/snapshot", _pub_topic);
+    MQ::MQClient::publish(_pub_topic_unique, data, msg_len, &_publCb);
+    Heap::memFree(data);
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::playStep(){
+    if(_stream_active){
+        streamStep();
+        return;
+    }
+    moveStep();
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::streamAlloc(){
+    if(_stream && _stream->servos >= _num_servos){
+        return true;
+    }
+    // los servos aadidos requieren un buffer mayor, el anterior no est en uso con la reproduccin detenida
+    if(_stream){
+        Heap::memFree(_stream);
+    }
+    uint8_t servos = _num_servos;
+    _stream = (MotionStream_t*)Heap::memAlloc(sizeof(MotionStream_t) + (servos * sizeof(uint16_t)));
+    if(!_stream){
+        return false;
+    }
+    _stream->rs = 0;
+    _stream->servos = servos;
+    _stream->duty = (uint16_t*)&_stream[1];
+    return true;
+}
+
+//------------------------------------------------------------------------------------
+bool ServoManager::streamStart(){
+    streamStop();
+    if(!streamAlloc()){
+        DEBUG_TRACE("\r\nServoManager: ERR_MEM, no se puede reservar el buffer de reproduccin\r\n");
+        return false;
+    }
+    
+    MotionHeader hdr;
+    _stream->pos = 0;
+    _stream->rs = _fs->openRecordSet(_stream_name);
+    if(!_stream->rs){
+        return false;
+    }
+    if(_fs->readRecordSet(_stream->rs, &hdr, sizeof(MotionHeader), &_stream->pos) != sizeof(MotionHeader) || 
+       hdr.magic != MotionMagic || hdr.version == 0 || hdr.version > MotionVersion || hdr.num_servos == 0 || 
+       hdr.num_servos > MaxServos || hdr.step_tick_us == 0){
+        streamStop();
+        return false;
+    }
+    _stream->version = hdr.version;
+    _stream->num_servos = hdr.num_servos;
+    _stream->mask_len = (hdr.num_servos + 7) / 8;
+    _stream->frames = hdr.frames;
+    _stream->hold = 0;
+    _stream->underruns = 0;
+    _stream->eof = false;
+    _stream->cur = 0;
+    _stream->idx = 0;
+    _stream->len[0] = 0;
+    _stream->len[1] = 0;
+    _mut.lock();
+    for(uint8_t i = 0; i < _stream->servos; i++){
+        _stream->duty[i] = _duty_req[i];
+    }
+    _mut.unlock();
+    
+    // precarga ambos bloques antes de arrancar (streamRefill carga el bloque no activo): primero el 0 y despus el 1
+    _stream->cur = 1;
+    _stream->refill = true;
+    streamRefill();
+    _stream->cur = 0;
+    _stream->refill = true;
+    streamRefill();
+    
+    // detiene el movimiento repetitivo y arranca el ticker con la cadencia del fichero
+    _mut.lock();
+    _rmove_active = false;
+    _rmove_staged = false;
+    _fade_left = 0;
+    _stream_active = true;
+    tickStart((uint32_t)(((uint64_t)hdr.step_tick_us * 100) / _stream_speed));
+    _mut.unlock();
+    DEBUG_TRACE("\r\nServoManager: Reproduciendo %s, %d tramas\r\n", _stream_name, hdr.frames);
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::streamStop(){
+    _mut.lock();
+    if(_stream_active && !_rmove_active){
+        tickStop();
+    }
+    _stream_active = false;
+    _mut.unlock();
+    if(_stream && _stream->rs){
+        _fs->closeRecordSet(_stream->rs);
+        _stream->rs = 0;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::streamRefill(){
+    _stream->refill = false;
+    uint8_t b = _stream->cur ^ 1;
+    if(_stream->eof || !_stream->rs || _stream->len[b] != 0){
+        return;
+    }
+    int32_t rd = _fs->readRecordSet(_stream->rs, _stream->buf[b], StreamChunkSize, &_stream->pos);
+    if(rd < StreamChunkSize){
+        _stream->eof = true;
+    }
+    _stream->len[b] = (rd > 0)? rd : 0;
+}
+
+
+//------------------------------------------------------------------------------------
+uint8_t ServoManager::streamByte(){
+    if(_stream->idx >= _stream->len[_stream->cur]){
+        // bloque agotado, pasa al siguiente y solicita rellenar el agotado
+        _stream->len[_stream->cur] = 0;
+        _stream->cur ^= 1;
+        _stream->idx = 0;
+        _stream->refill = true;
+    }
+    return _stream->buf[_stream->cur][_stream->idx++];
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::streamStep(){
+    // mantiene la trama anterior
+    if(_stream->hold){
+        _stream->hold--;
+        return;
+    }
+    // las tramas de cambio de cadencia no consumen paso, por lo que se lee a continuacin la trama siguiente
+    for(;;){
+        // la trama debe estar completa en los bloques cargados, si no se mantiene hasta el siguiente paso
+        uint16_t avail = (_stream->len[_stream->cur] - _stream->idx) + _stream->len[_stream->cur ^ 1];
+        uint16_t need = (_stream->num_servos > 2)? (3 * _stream->num_servos) : 6;
+        if(_stream->frames == 0 || (_stream->eof && avail < (_stream->mask_len + 1))){
+            _th.signal_set(StreamStopFlag);
+            return;
+        }
+        if(!_stream->eof && avail < (_stream->mask_len + need)){
+            _stream->underruns++;
+            return;
+        }
+        
+        uint8_t mask[(MaxServos + 7) / 8];
+        bool changes = false;
+        for(uint8_t i = 0; i < _stream->mask_len; i++){
+            mask[i] = streamByte();
+            changes = (mask[i] != 0)? true : changes;
+        }
+        if(!changes){
+            uint16_t hold = streamByte();
+            hold |= ((uint16_t)streamByte() << 8);
+            if(hold == 0 && _stream->version >= 2){
+                uint32_t step_tick_us = streamByte();
+                step_tick_us |= ((uint32_t)streamByte() << 8);
+                step_tick_us |= ((uint32_t)streamByte() << 16);
+                step_tick_us |= ((uint32_t)streamByte() << 24);
+                if(step_tick_us){
+                    tickStart((uint32_t)(((uint64_t)step_tick_us * 100) / _stream_speed));
+                }
+                continue;
+            }
+            hold = (hold == 0)? 1 : hold;
+            hold = (hold > _stream->frames)? _stream->frames : hold;
+            _stream->frames -= hold;
+            _stream->hold = hold - 1;
+            return;
+        }
+        for(uint8_t i = 0; i < _stream->num_servos; i++){
+            if((mask[i >> 3] & (1 << (i & 7))) == 0){
+                continue;
+            }
+            uint16_t duty = (i < _stream->servos)? _stream->duty[i] : 0;
+            uint8_t delta = streamByte();
+            if(delta == MotionAbsDuty){
+                duty = streamByte();
+                duty |= ((uint16_t)streamByte() << 8);
+            }
+            else{
+                duty += (int8_t)delta;
+            }
+            // los servos del fichero que no existen en el equipo se decodifican sin aplicarse
+            if(i < _stream->servos){
+                _stream->duty[i] = duty;
+                setDuty(i, duty);
+            }
+        }
+        _stream->frames--;
+        return;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::recordAlloc(){
+    if(_rec && _rec->servos >= _num_servos){
+        return true;
+    }
+    if(_rec){
+        Heap::memFree(_rec);
+    }
+    // last, frame_duty y emit_duty a continuacin de la estructura
+    _rec = (MotionRecord_t*)Heap::memAlloc(sizeof(MotionRecord_t) + (3 * _num_servos * sizeof(uint16_t)));
+    if(!_rec){
+        return false;
+    }
+    _rec->rs = 0;
+    _rec->servos = _num_servos;
+    _rec->last = (uint16_t*)&_rec[1];
+    _rec->frame_duty = &_rec->last[_num_servos];
+    _rec->emit_duty = &_rec->frame_duty[_num_servos];
+    return true;
+}
+
+//------------------------------------------------------------------------------------
+void ServoManager::recordCapture(uint8_t servo, uint16_t duty){
+    // los servos aadidos durante la grabacin no forman parte de ella
+    if(!_rec_active || servo >= _rec->servos){
+        return;
+    }
+    uint16_t used = (_rec->head - _rec->tail) & (RecordRingSize - 1);
+    if((RecordRingSize - 1 - used) < RecordEventMaxSize){
+        _rec->dropped++;
+        return;
+    }
+    // cuantiza el instante al tick de grabacin (mximo 21 bits entre eventos)
+    uint32_t tick = (us_ticker_read() - _rec->t0) / _rec->step_tick_us;
+    uint32_t dt = tick - _rec->tick;
+    dt = (dt > 0x1FFFFF)? 0x1FFFFF : dt;
+    _rec->tick += dt;
+    uint16_t h = _rec->head;
+    do{
+        uint8_t b = dt & 0x7f;
+        dt >>= 7;
+        _rec->ring[h] = (dt)? (b | 0x80) : b;
+        h = (h + 1) & (RecordRingSize - 1);
+    }while(dt);
+    _rec->ring[h] = servo;
+    h = (h + 1) & (RecordRingSize - 1);
+    int32_t delta = (int32_t)duty - _rec->last[servo];
+    if(delta >= -127 && delta <= 127){
+        _rec->ring[h] = (uint8_t)delta;
+        h = (h + 1) & (RecordRingSize - 1);
+    }
+    else{
+        _rec->ring[h] = MotionAbsDuty;
+        h = (h + 1) & (RecordRingSize - 1);
+        _rec->ring[h] = (uint8_t)(duty & 0xff);
+        h = (h + 1) & (RecordRingSize - 1);
+        _rec->ring[h] = (uint8_t)(duty >> 8);
+        h = (h + 1) & (RecordRingSize - 1);
+    }
+    _rec->last[servo] = duty;
+    // publica el evento completo, una vez escritos todos sus bytes
+    __DMB();
+    _rec->head = h;
+    if(used >= (RecordRingSize / 2)){
+        _th.signal_set(RecordFlushFlag);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::recordOpen(){
+    MotionHeader hdr = {MotionMagic, MotionVersion, _rec->servos, 0, _rec->step_tick_us, 0};
+    _rec->rs = 0;
+    _rec->pos = sizeof(MotionHeader);
+    if(_fs->save(_rec->name, &hdr, sizeof(MotionHeader)) == sizeof(MotionHeader)){
+        _rec->rs = _fs->openRecordSet(_rec->name);
+    }
+    if(!_rec->rs){
+        DEBUG_TRACE("\r\nServoManager: ERR_RECORD %s\r\n", _rec->name);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::recordFlush(bool close){
+    // decodifica los eventos capturados hasta el momento
+    uint16_t head = _rec->head;
+    uint16_t t = _rec->tail;
+    // los eventos hasta head estn completos, se leen despus de head
+    __DMB();
+    while(t != head){
+        uint32_t dt = 0;
+        uint8_t shift = 0;
+        uint8_t b;
+        do{
+            b = _rec->ring[t];
+            t = (t + 1) & (RecordRingSize - 1);
+            dt |= ((uint32_t)(b & 0x7f) << shift);
+            shift += 7;
+        }while((b & 0x80) != 0);
+        uint8_t servo = _rec->ring[t];
+        t = (t + 1) & (RecordRingSize - 1);
+        uint16_t duty;
+        b = _rec->ring[t];
+        t = (t + 1) & (RecordRingSize - 1);
+        if(b == MotionAbsDuty){
+            duty = _rec->ring[t];
+            t = (t + 1) & (RecordRingSize - 1);
+            duty |= ((uint16_t)_rec->ring[t] << 8);
+            t = (t + 1) & (RecordRingSize - 1);
+        }
+        else{
+            duty = _rec->frame_duty[servo] + (int8_t)b;
+        }
+        // al cambiar de tick, escribe la trama en construccin
+        _rec->dec_tick += dt;
+        if(_rec->dec_tick > _rec->frame_tick){
+            recordEmit(_rec->dec_tick);
+        }
+        _rec->frame_duty[servo] = duty;
+        _rec->frame_mask |= ((uint64_t)1 << servo);
+    }
+    // libera los eventos una vez decodificados
+    __DMB();
+    _rec->tail = t;
+    
+    if(!close){
+        return;
+    }
+    
+    // escribe la ltima trama, mantenida hasta el final de la grabacin, y actualiza la cabecera
+    recordEmit(((_rec->stop_tick > _rec->frame_tick)? _rec->stop_tick : _rec->frame_tick) + 1);
+    if(_rec->rs){
+        if(_rec->out_len){
+            _fs->writeRecordSet(_rec->rs, _rec->out, _rec->out_len, &_rec->pos);
+        }
+        MotionHeader hdr = {MotionMagic, MotionVersion, _rec->servos, 0, _rec->step_tick_us, _rec->frames};
+        int32_t pos = 0;
+        _fs->writeRecordSet(_rec->rs, &hdr, sizeof(MotionHeader), &pos);
+        _fs->closeRecordSet(_rec->rs);
+        _rec->rs = 0;
+        DEBUG_TRACE("\r\nServoManager: Grabadas %d tramas en %s, %d eventos descartados\r\n", _rec->frames, _rec->name, _rec->dropped);
+    }
+    _rec->out_len = 0;
+    _mut.lock();
+    _rec_busy = false;
+    _mut.unlock();
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::recordEmit(uint32_t tick){
+    uint32_t hold = tick - _rec->frame_tick;
+    if(_rec->frame_mask){
+        uint8_t mask_len = (_rec->servos + 7) / 8;
+        for(uint8_t i = 0; i < mask_len; i++){
+            recordPut((uint8_t)(_rec->frame_mask >> (8 * i)));
+        }
+        for(uint8_t i = 0; i < _rec->servos; i++){
+            if((_rec->frame_mask & ((uint64_t)1 << i)) == 0){
+                continue;
+            }
+            int32_t delta = (int32_t)_rec->frame_duty[i] - _rec->emit_duty[i];
+            if(delta >= -127 && delta <= 127){
+                recordPut((uint8_t)delta);
+            }
+            else{
+                recordPut(MotionAbsDuty);
+                recordPut((uint8_t)(_rec->frame_duty[i] & 0xff));
+                recordPut((uint8_t)(_rec->frame_duty[i] >> 8));
+            }
+            _rec->emit_duty[i] = _rec->frame_duty[i];
+        }
+        _rec->frames++;
+        hold--;
+    }
+    // tramas sin cambios hasta el siguiente tick
+    while(hold){
+        uint16_t n = (hold > 0xFFFF)? 0xFFFF : hold;
+        uint8_t mask_len = (_rec->servos + 7) / 8;
+        for(uint8_t i = 0; i < mask_len; i++){
+            recordPut(0);
+        }
+        recordPut((uint8_t)(n & 0xff));
+        recordPut((uint8_t)(n >> 8));
+        _rec->frames += n;
+        hold -= n;
+    }
+    _rec->frame_tick = tick;
+    _rec->frame_mask = 0;
+}
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::recordPut(uint8_t b){
+    _rec->out[_rec->out_len++] = b;
+    if(_rec->out_len == RecordOutSize){
+        if(_rec->rs){
+            _fs->writeRecordSet(_rec->rs, _rec->out, RecordOutSize, &_rec->pos);
+        }
+        _rec->out_len = 0;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+ServoManager::CalResult ServoManager::calSave(uint8_t ctrl, uint32_t* page, uint32_t* caldata){
+    uint32_t page_words = NVFlash::getPageSize() / sizeof(uint32_t);
+    uint32_t nv_page = _cal_page + ctrl;
+    
+    // obtiene los datos actuales y su tamao real, hasta la ltima palabra escrita por el driver
+    for(uint32_t i = 0; i < page_words; i++){
+        caldata[i] = CalGuard;
+    }
+    _ctrl[ctrl].drv->getNVData(caldata);
+    uint32_t words = page_words;
+    while(words > 0 && caldata[words - 1] == CalGuard){
+        words--;
+    }
+    if(!words || NVFlash::readPage(nv_page, page) != NVFlash::Success){
+        return CalError;
     }
-                    
-    // Carga callbacks estticas de publicacin/suscripcin    
-    _subscrCb = callback(this, &ServoManager::subscriptionCb);   
     
-    // Inicializa parmetros del hilo de ejecucin propio
-    _th.start(callback(this, &ServoManager::task));    
+    // si no cabe en una ranura, guarda la pgina completa con el formato previo, slo si ha cambiado
+    if(calSlotWords(words) > page_words){
+        if(memcmp(page, caldata, NVFlash::getPageSize()) == 0){
+            return CalUnchanged;
+        }
+        NVFlash::erasePage(nv_page);
+        return ((NVFlash::writePage(nv_page, caldata) == NVFlash::Success)? CalSavedErased : CalError);
+    }
+    
+    int32_t last, free;
+    calFindSlots(page, &last, &free);
+    CalSlotHeader hdr = {CalMagic, 0, 0, words};
+    
+    // descarta la escritura si no hay cambios respecto de la ranura vigente
+    if(last >= 0){
+        CalSlotHeader* slot = (CalSlotHeader*)&page[last];
+        if(slot->words == words && memcmp(&page[last + CalHeaderWords], caldata, words * sizeof(uint32_t)) == 0){
+            return CalUnchanged;
+        }
+        hdr.seq = slot->seq + 1;
+    }
+    hdr.checksum = calChecksum(hdr.seq, caldata, words);
+    
+    // programa la ranura a continuacin de la ltima si la zona est borrada, escribiendo slo sus dobles palabras: la
+    // flash no admite programar de nuevo una posicin ya escrita, por lo que el resto de la pgina no se toca
+    uint32_t slot_words = calSlotWords(words);
+    if(free >= 0 && (free + slot_words) <= page_words){
+        bool erased = true;
+        for(uint32_t i = free; i < (free + slot_words) && erased; i++){
+            erased = (page[i] == CalErased)? true : false;
+        }
+        if(erased){
+            memcpy(&page[free], &hdr, sizeof(CalSlotHeader));
+            memcpy(&page[free + CalHeaderWords], caldata, words * sizeof(uint32_t));
+            return ((NVFlash::writeWords(nv_page, free, &page[free], slot_words) == NVFlash::Success)? CalSaved : CalError);
+        }
+    }
+    
+    // no queda espacio libre, borra la pgina y escribe la ranura al comienzo
+    for(uint32_t i = 0; i < slot_words; i++){
+        page[i] = CalErased;
+    }
+    memcpy(&page[0], &hdr, sizeof(CalSlotHeader));
+    memcpy(&page[CalHeaderWords], caldata, words * sizeof(uint32_t));
+    NVFlash::erasePage(nv_page);
+    return ((NVFlash::writeWords(nv_page, 0, page, slot_words) == NVFlash::Success)? CalSavedErased : CalError);
 }
 
 
 //------------------------------------------------------------------------------------
-void ServoManager::startMovement(uint16_t* duty, uint8_t steps, uint32_t step_tick_us, uint8_t servo_zero, uint8_t step_dif){
-    if(servo_zero >= _num_servos){
-        return;
+ServoManager::CalResult ServoManager::calRestore(uint8_t ctrl, uint32_t* page){
+    uint32_t nv_page = _cal_page + ctrl;
+    if(NVFlash::readPage(nv_page, page) != NVFlash::Success){
+        return CalError;
     }
-    
-    if(_rmove.duty){
-        _tick_move.detach();
-        Heap::memFree(_rmove.duty); 
-        _rmove.duty = NULL;
-    }
-    _rmove.duty = (uint16_t*)Heap::memAlloc(steps * sizeof(uint16_t));
-    if(_rmove.duty){
-        _rmove.steps = steps;
-        _rmove.step_tick_us = step_tick_us;
-        for(uint8_t i=0;i<steps;i++){
-            _rmove.duty[i] = duty[i];
-        }
-        for(uint8_t i=servo_zero;i<_num_servos;i++){
-            _move_step[i] = step_dif * (i - servo_zero);
-        }
-        for(int8_t i=servo_zero-1;i>=0;i--){
-            _move_step[i] = step_dif * (servo_zero-i);
-        }        
-        _tick_move.attach_us(callback(this, &ServoManager::onTickCb), _rmove.step_tick_us);
-    }    
+    int32_t last, free;
+    calFindSlots(page, &last, &free);
+    if(last >= 0){
+        return ((_ctrl[ctrl].drv->setNVData(&page[last + CalHeaderWords]) == 0)? CalRestored : CalError);
+    }
+    // sin ranuras vlidas, intenta recuperar una pgina con el formato previo
+    return ((_ctrl[ctrl].drv->setNVData(page) == 0)? CalRestoredLegacy : CalError);
 }
 
 
 //------------------------------------------------------------------------------------
-void ServoManager::stopMovement(){
-    _tick_move.detach();
+void ServoManager::calFindSlots(uint32_t* page, int32_t* last, int32_t* free){
+    *last = -1;
+    *free = -1;
+    uint32_t last_seq = 0;
+    uint32_t page_words = NVFlash::getPageSize() / sizeof(uint32_t);
+    uint32_t pos = 0;
+    // las ranuras se ocupan en orden, cada una a continuacin de la anterior segn su tamao
+    while((pos + CalHeaderWords) <= page_words){
+        CalSlotHeader* hdr = (CalSlotHeader*)&page[pos];
+        if(hdr->magic == CalErased && hdr->seq == CalErased && hdr->checksum == CalErased && hdr->words == CalErased){
+            *free = pos;
+            return;
+        }
+        // cualquier otro contenido que no sea una cabecera de ranura invalida el resto de la pgina
+        if(hdr->magic != CalMagic || !hdr->words || (pos + calSlotWords(hdr->words)) > page_words){
+            return;
+        }
+        if(hdr->checksum == calChecksum(hdr->seq, &page[pos + CalHeaderWords], hdr->words) && (*last < 0 || hdr->seq > last_seq)){
+            *last = pos;
+            last_seq = hdr->seq;
+        }
+        pos += calSlotWords(hdr->words);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+uint32_t ServoManager::calChecksum(uint32_t seq, uint32_t* data, uint32_t words){
+    uint32_t sum = seq + words;
+    for(uint32_t i = 0; i < words; i++){
+        sum += data[i];
+    }
+    return ~sum;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::allocServos(uint8_t num){
+    uint16_t* duty_req = (uint16_t*)Heap::memAlloc(num * sizeof(uint16_t));
+    uint16_t* duty_out = (uint16_t*)Heap::memAlloc(num * sizeof(uint16_t));
+    Slew_t* slew = (Slew_t*)Heap::memAlloc(num * sizeof(Slew_t));
+    if(!duty_req || !duty_out || !slew){
+        if(duty_req){
+            Heap::memFree(duty_req);
+        }
+        if(duty_out){
+            Heap::memFree(duty_out);
+        }
+        if(slew){
+            Heap::memFree(slew);
+        }
+        return false;
+    }
+    // conserva el estado de los servos existentes, los nuevos parten sin duty conocido y sin lmites
+    memset(slew, 0, num * sizeof(Slew_t));
+    for(uint8_t i = 0; i < num; i++){
+        duty_req[i] = (i < _num_servos)? _duty_req[i] : InvalidDuty;
+        duty_out[i] = (i < _num_servos)? _duty_out[i] : InvalidDuty;
+    }
+    if(_num_servos){
+        memcpy(slew, _slew, _num_servos * sizeof(Slew_t));
+        Heap::memFree(_duty_req);
+        Heap::memFree(_duty_out);
+        Heap::memFree(_slew);
+    }
+    _duty_req = duty_req;
+    _duty_out = duty_out;
+    _slew = slew;
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+bool ServoManager::moveAlloc(uint8_t idx){
+    if(_rmove[idx] && _rmove[idx]->servos >= _num_servos){
+        return true;
+    }
+    if(_rmove[idx]){
+        Heap::memFree(_rmove[idx]);
+    }
+    // offset y step a continuacin de la estructura
+    RepetitiveMovement_t* mv = (RepetitiveMovement_t*)Heap::memAlloc(sizeof(RepetitiveMovement_t) + (2 * _num_servos));
+    _rmove[idx] = mv;
+    if(!mv){
+        return false;
+    }
+    mv->servos = _num_servos;
+    mv->offset = (uint8_t*)&mv[1];
+    mv->step = &mv->offset[_num_servos];
+    return true;
+}
+
+//------------------------------------------------------------------------------------
+void ServoManager::moveStep(){
+    // conmuta al movimiento preparado al comienzo del ciclo del servo origen o en el siguiente paso
+    RepetitiveMovement_t* front = _rmove[_rmove_front];
+    if(_rmove_staged && (_rmove_swap == SwapPhaseMatched || front->step[front->servo_zero] == 0)){
+        swapMovement();
+        front = _rmove[_rmove_front];
+    }
+    RepetitiveMovement_t* back = _rmove[_rmove_front ^ 1];
     
-    if(_rmove.duty){
-        Heap::memFree(_rmove.duty); 
-        _rmove.duty = NULL;
+    for(uint8_t i = 0; i<front->servos; i++){
+        uint16_t duty = front->duty[front->step[i]];
+        front->step[i] = (front->step[i] < (front->steps - 1))? (front->step[i] + 1) : 0;
+        // durante el fundido, interpola entre el movimiento anterior (que sigue avanzando) y el nuevo
+        if(_fade_left && i < back->servos){
+            int32_t prev = back->duty[back->step[i]];
+            duty = (uint16_t)(prev + ((((int32_t)duty - prev) * (_fade_steps - _fade_left + 1)) / _fade_steps));
+            back->step[i] = (back->step[i] < (back->steps - 1))? (back->step[i] + 1) : 0;
+        }
+        setDuty(i, duty);
+    }
+    if(_fade_left){
+        _fade_left--;
     }
 }
 
 
 //------------------------------------------------------------------------------------
-void ServoManager::setSubscriptionBase(const char* sub_topic) {
-    if(_sub_topic){
-        DEBUG_TRACE("\r\nServoManager: ERROR_SUB ya hecha!\r\n");
-        return;
+void ServoManager::swapMovement(){
+    RepetitiveMovement_t* front = _rmove[_rmove_front];
+    RepetitiveMovement_t* back = _rmove[_rmove_front ^ 1];
+    
+    // en modo de fase equivalente, escala el paso del servo origen al nmero de pasos del nuevo movimiento
+    uint8_t phase = 0;
+    if(_rmove_active && _rmove_swap == SwapPhaseMatched){
+        phase = (uint8_t)(((uint32_t)front->step[front->servo_zero] * back->steps) / front->steps);
+    }
+    for(uint8_t i = 0; i<back->servos; i++){
+        back->step[i] = (uint8_t)((back->offset[i] + phase) % back->steps);
     }
     
-    _sub_topic = (char*)sub_topic; 
- 
-    // Se suscribe a $sub_topic/#
-    char* suscr = (char*)Heap::memAlloc(strlen(sub_topic) + strlen("/#")+1);
-    if(suscr){
-        sprintf(suscr, "%s/#", _sub_topic);
-        MQ::MQClient::subscribe(suscr, &_subscrCb);
-        DEBUG_TRACE("\r\nServoManager: Suscrito a %s/#\r\n", sub_topic);
-    }     
-}   
+    // reajusta la cadencia slo si cambia, sin detener el ticker
+    if(_rmove_active && back->step_tick_us != front->step_tick_us){
+        tickStart(back->step_tick_us);
+    }
+    _fade_left = (_rmove_active)? _fade_steps : 0;
+    _rmove_front ^= 1;
+    _rmove_staged = false;
+}
+
 
 //------------------------------------------------------------------------------------
-//- PROTECTED CLASS IMPL. ------------------------------------------------------------
+bool ServoManager::initController(Controller_t* ctrl){
+    char reg = RegMode1;
+    char mode[2] = {0, 0};
+    // lee MODE1 y MODE2 (el puntero de registro avanza aunque AI no est activo en la lectura)
+    if(ctrl->i2c->write(ctrl->addr, &reg, 1, true) != 0 || ctrl->i2c->read(ctrl->addr, &mode[0], 1) != 0){
+        return false;
+    }
+    reg = RegMode2;
+    if(ctrl->i2c->write(ctrl->addr, &reg, 1, true) != 0 || ctrl->i2c->read(ctrl->addr, &mode[1], 1) != 0){
+        return false;
+    }
+    if((mode[0] & Mode1AutoIncrement) == 0){
+        char cmd[2] = {RegMode1, (char)(mode[0] | Mode1AutoIncrement)};
+        if(ctrl->i2c->write(ctrl->addr, cmd, 2) != 0){
+            return false;
+        }
+    }
+    // las salidas cambian en el STOP, de forma que todos los controladores del bus actualizan a la vez
+    if((mode[1] & Mode2OutputOnAck) != 0){
+        char cmd[2] = {RegMode2, (char)(mode[1] & ~Mode2OutputOnAck)};
+        if(ctrl->i2c->write(ctrl->addr, cmd, 2) != 0){
+            return false;
+        }
+    }
+    ctrl->init = true;
+    return true;
+}
+
+
 //------------------------------------------------------------------------------------
+PCA9685_ServoDrv::ErrorResult ServoManager::applyDuty(uint8_t servo, uint16_t duty, bool update){
+    _slew_active &= ~((uint64_t)1 << servo);
+    setDuty(servo, duty);
+    recordCapture(servo, duty);
+    if(!update){
+        return Success;
+    }
+    _tick_coalesce.detach();
+    _coalesce_armed = false;
+    flushDuty();
+    return ((_dirty & ((uint64_t)1 << servo)) != 0)? I2CError : Success;
+}
 
 
 //------------------------------------------------------------------------------------
-void ServoManager::task(){
-    
-    do{
-        Thread::yield();
-    }while(PCA9685_ServoDrv::getState() != PCA9685_ServoDrv::Ready);
-       
-    // Arranca espera
-    _timeout = osWaitForever;
-    for(;;){
-        osEvent evt = _th.signal_wait(0, _timeout);
-        if(evt.status == osEventSignal){   
-            uint32_t sig = evt.value.signals;
-            
-            if((sig & TickMoveFlag)!=0){
-                // prepara el siguiente movimiento de cada servo
-                for(uint8_t i = 0; i<_num_servos; i++){
-                    setServoDuty(i, _rmove.duty[_move_step[i]]);
-                    _move_step[i] = (_move_step[i] < (_rmove.steps - 1))? (_move_step[i] + 1) : 0;
+void ServoManager::setDuty(uint8_t servo, uint16_t duty){
+    if(duty != _duty_req[servo]){
+        _duty_req[servo] = duty;
+        // mantiene actualizado el estado del driver, sin acceso al chip
+        uint8_t local;
+        PCA9685_ServoDrv* drv = getServoDriver(servo, &local);
+        if(drv){
+            drv->setServoDuty(local, duty);
+        }
+    }
+    if(duty != _duty_out[servo]){
+        _dirty |= ((uint64_t)1 << servo);
+    }
+    else{
+        _dirty &= ~((uint64_t)1 << servo);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+uint32_t ServoManager::flushDuty(){
+    if(!_dirty){
+        return 0;
+    }
+    // dos buffers alternos: se prepara la siguiente rfaga antes de escribir la actual, para saber si es la ltima
+    // de la transaccin (STOP) o debe continuar con un START repetido
+    Burst_t burst[2];
+    uint32_t bytes = 0;
+    uint32_t t0 = us_ticker_read();
+    bool done[MaxControllers] = {false};
+    for(uint8_t b = 0; b < _num_ctrl; b++){
+        if(done[b]){
+            continue;
+        }
+        // una transaccin por bus, con las rfagas de todos los controladores conectados a l. El bus se reserva durante
+        // toda la cadena: write() lo libera tras cada llamada, y otro hilo (o el objeto I2C del propio driver en los
+        // mismos pines) podra intercalar sus transferencias entre los START repetidos
+        I2C* i2c = _ctrl[b].i2c;
+        i2c->lock();
+        // los controladores pendientes de inicializar lo hacen antes de comenzar la cadena
+        for(uint8_t c = b; c < _num_ctrl; c++){
+            Controller_t* ctrl = &_ctrl[c];
+            if(ctrl->i2c == i2c && !ctrl->init && ctrl->drv->getState() == PCA9685_ServoDrv::Ready){
+                initController(ctrl);
+            }
+        }
+        Burst_t* pending = 0;
+        uint8_t cur = 0;
+        for(uint8_t c = b; c < _num_ctrl; c++){
+            if(_ctrl[c].i2c != i2c){
+                continue;
+            }
+            done[c] = true;
+            Controller_t* ctrl = &_ctrl[c];
+            if(!ctrl->init){
+                // controlador no disponible, sus canales quedan sucios
+                continue;
+            }
+            uint8_t end = ctrl->first + ctrl->num;
+            uint8_t i = ctrl->first;
+            while(i < end){
+                if((_dirty & ((uint64_t)1 << i)) == 0){
+                    i++;
+                    continue;
                 }
-                // actualiza los servos
-                PCA9685_ServoDrv::updateAll();
-            } 
+                // busca el final del rango contiguo de canales sucios
+                Burst_t* next = &burst[cur];
+                next->addr = ctrl->addr;
+                next->first = i;
+                while(i < end && (_dirty & ((uint64_t)1 << i)) != 0){
+                    i++;
+                }
+                next->last = i;
+                // la rfaga comienza en LEDn_OFF_L, por lo que los canales intermedios escriben ON=0
+                next->len = 0;
+                next->buf[next->len++] = RegLed0OffL + (RegsPerChannel * (next->first - ctrl->first));
+                for(uint8_t ch = next->first; ch < next->last; ch++){
+                    if(ch != next->first){
+                        next->buf[next->len++] = 0;
+                        next->buf[next->len++] = 0;
+                    }
+                    next->buf[next->len++] = (char)(_duty_req[ch] & 0xff);
+                    next->buf[next->len++] = (char)(_duty_req[ch] >> 8);
+                }
+                if(pending){
+                    bytes += burstWrite(i2c, pending, true);
+                }
+                pending = next;
+                cur ^= 1;
+            }
+        }
+        if(pending){
+            bytes += burstWrite(i2c, pending, false);
         }
+        i2c->unlock();
     }
+    _bus_stats.updates++;
+    _bus_stats.bytes = bytes;
+    _bus_stats.us = us_ticker_read() - t0;
+    _bus_stats.total_bytes += bytes;
+    return bytes;
 }
-    
+
 
 //------------------------------------------------------------------------------------
-void ServoManager::onTickCb(){
-    _th.signal_set(TickMoveFlag);   
-}        
+uint32_t ServoManager::burstWrite(I2C* i2c, Burst_t* burst, bool repeated){
+    if(i2c->write(burst->addr, burst->buf, burst->len, repeated) != 0){
+        // los canales quedan sucios y se reintentan en la siguiente actualizacin. La transaccin se cierra con STOP y
+        // las rfagas restantes comienzan una nueva
+        if(repeated){
+            i2c->stop();
+        }
+        _bus_stats.errors++;
+        return 0;
+    }
+    for(uint8_t ch = burst->first; ch < burst->last; ch++){
+        _duty_out[ch] = _duty_req[ch];
+        _dirty &= ~((uint64_t)1 << ch);
+    }
+    return (burst->len + 1);
+}
 
 
 //------------------------------------------------------------------------------------
@@ -146,6 +1955,56 @@ void ServoManager::subscriptionCb(const char* topic, void* msg, uint16_t msg_len
         return;
     }
     
+    // si es un comando para detener la reproduccin de un fichero de movimiento
+    if(MQ::MQClient::isTopicToken(topic, "/play/stop")){
+        DEBUG_TRACE("\r\nServoManager: Reproduccin terminada!\r\n");
+        stopMotion();
+        return;
+    }
+    
+    // si es un comando para reproducir un fichero de movimiento
+    if(MQ::MQClient::isTopicToken(topic, "/play")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        // obtengo los parmetros del mensaje Name,Speed
+        char* data = (char*)Heap::memAlloc(msg_len);
+        if(data){
+            strcpy(data, (char*)msg);
+            char* name = strtok(data, ",");
+            char* arg = strtok(NULL, ",");
+            uint16_t speed = (arg)? atoi(arg) : 100;
+            if(!playMotion(name, speed)){
+                DEBUG_TRACE("\r\nServoManager: ERR_PLAY %s\r\n", msg);
+            }
+            Heap::memFree(data);
+        }
+        return;
+    }
+    
+    // si es un comando para finalizar una grabacin
+    if(MQ::MQClient::isTopicToken(topic, "/record/stop")){
+        DEBUG_TRACE("\r\nServoManager: Grabacin terminada!\r\n");
+        stopRecord();
+        return;
+    }
+    
+    // si es un comando para iniciar una grabacin
+    if(MQ::MQClient::isTopicToken(topic, "/record/start")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        // obtengo los parmetros del mensaje Name,StepTimeUs
+        char* data = (char*)Heap::memAlloc(msg_len);
+        if(data){
+            strcpy(data, (char*)msg);
+            char* name = strtok(data, ",");
+            char* arg = strtok(NULL, ",");
+            uint32_t tstep = (arg)? atoi(arg) : 0;
+            if(!startRecord(name, tstep)){
+                DEBUG_TRACE("\r\nServoManager: ERR_RECORD %s\r\n", msg);
+            }
+            Heap::memFree(data);
+        }
+        return;
+    }
+    
     // si es un comando para iniciar un movimiento repetitivo tipo respiracin...
     if(MQ::MQClient::isTopicToken(topic, "/move/start")){
         DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
@@ -165,86 +2024,156 @@ void ServoManager::subscriptionCb(const char* topic, void* msg, uint16_t msg_len
             uint8_t ang_min = atoi(arg);
             arg = strtok(NULL, ",");
             uint8_t ang_max = atoi(arg);
+            arg = strtok(NULL, ",");
+            SwapMode swap = (arg && atoi(arg) != 0)? SwapPhaseMatched : SwapAtCycleEnd;
+            arg = (arg)? strtok(NULL, ",") : NULL;
+            uint8_t fade = (arg)? atoi(arg) : 0;
             Heap::memFree(data);
+            if(num_steps == 0 || num_steps > MaxMoveSteps){
+                DEBUG_TRACE("\r\nServoManager: ERR_STEPS, mximo %d pasos\r\n", MaxMoveSteps);
+                return;
+            }
             
             // obtiene el nmero de pasos
-            uint16_t* duties = (uint16_t*)Heap::memAlloc(num_steps * sizeof(uint16_t));            
+            uint8_t local;
+            PCA9685_ServoDrv* drv = getServoDriver(srvorig, &local);
+            uint16_t* duties = (drv)? (uint16_t*)Heap::memAlloc(num_steps * sizeof(uint16_t)) : NULL;            
             if(duties){
                 float rad_inc = (((360.0f/num_steps) * 3.14159265f) / 180);
                 for(int i=0; i<num_steps;i++){
                     float value = sinf((i * rad_inc));
                     uint8_t angle = (uint8_t)((((ang_max - ang_min)/2) * value) + (ang_max - ang_min)/2);
-                    duties[i] = PCA9685_ServoDrv::getDutyFromAngle(srvorig, angle);                    
+                    duties[i] = drv->getDutyFromAngle(local, angle);                    
                 }
-                startMovement(duties, num_steps, tstep, srvorig, stepdif);
+                startMovement(duties, num_steps, tstep, srvorig, stepdif, swap, fade);
                 Heap::memFree(duties);
             }            
         }
         return;
     }
 
-    // si es un comando para mover un nico servo
-    if(MQ::MQClient::isTopicToken(topic, "/servo")){
+    // si es un comando para mover un grupo de servos indicado por mscara
+    if(MQ::MQClient::isTopicToken(topic, "/group/mask")){
         DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
-        // obtengo los parmetros del mensaje ServoID,Deg
+        // obtengo los parmetros del mensaje Mask,A[,A...]
         char* data = (char*)Heap::memAlloc(msg_len);
         if(data){
             strcpy(data, (char*)msg);
             char* arg = strtok(data, ",");
-            uint8_t servo = atoi(arg);
-            arg = strtok(NULL, ",");
-            uint8_t deg = atoi(arg);
+            uint64_t mask = (arg)? strtoull(arg, NULL, 16) : 0;
+            _mut.lock();
+            for(uint8_t servo = 0; servo < _num_servos && mask; servo++){
+                if((mask & ((uint64_t)1 << servo)) == 0){
+                    continue;
+                }
+                mask &= ~((uint64_t)1 << servo);
+                if((arg = strtok(NULL, ",")) == NULL){
+                    break;
+                }
+                groupAngle(servo, atoi(arg));
+            }
+            commitTargets();
+            _mut.unlock();
             Heap::memFree(data);
-            
-            // mueve el servo
-            PCA9685_ServoDrv::setServoAngle(servo, deg, true);                       
         }
         return;
-    }    
+    }
 
-    // si es un comando para mover un nico servo
-    if(MQ::MQClient::isTopicToken(topic, "/duty")){
+    // si es un comando para mover un grupo de servos
+    if(MQ::MQClient::isTopicToken(topic, "/group")){
         DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
-        // obtengo los parmetros del mensaje ServoID,Duty
+        // obtengo los parmetros del mensaje S,A[,S,A...]
+        char* data = (char*)Heap::memAlloc(msg_len);
+        if(data){
+            strcpy(data, (char*)msg);
+            _mut.lock();
+            char* arg = strtok(data, ",");
+            while(arg){
+                uint8_t servo = atoi(arg);
+                if((arg = strtok(NULL, ",")) == NULL){
+                    break;
+                }
+                groupAngle(servo, atoi(arg));
+                arg = strtok(NULL, ",");
+            }
+            commitTargets();
+            _mut.unlock();
+            Heap::memFree(data);
+        }
+        return;
+    }
+
+    // si es un comando para guardar la posicin actual como una pose
+    if(MQ::MQClient::isTopicToken(topic, "/pose/save")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        if(!savePose(atoi((char*)msg))){
+            DEBUG_TRACE("\r\nServoManager: ERR_POSE_SAVE %s\r\n", msg);
+        }
+        return;
+    }
+
+    // si es un comando para recuperar una pose
+    if(MQ::MQClient::isTopicToken(topic, "/pose")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        if(!recallPose(atoi((char*)msg))){
+            DEBUG_TRACE("\r\nServoManager: ERR_POSE %s\r\n", msg);
+        }
+        return;
+    }
+
+    // si es un comando para activar/desactivar la agrupacin de comandos
+    if(MQ::MQClient::isTopicToken(topic, "/coalesce")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        setCoalescing(atoi((char*)msg));
+        return;
+    }
+
+    // si es un comando para establecer los lmites de velocidad/aceleracin de un servo
+    if(MQ::MQClient::isTopicToken(topic, "/slew")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        // obtengo los parmetros del mensaje ServoID,Vel,Acc
         char* data = (char*)Heap::memAlloc(msg_len);
         if(data){
             strcpy(data, (char*)msg);
             char* arg = strtok(data, ",");
             uint8_t servo = atoi(arg);
             arg = strtok(NULL, ",");
-            uint16_t duty = atoi(arg);
+            uint16_t vel = (arg)? atoi(arg) : 0;
+            arg = (arg)? strtok(NULL, ",") : NULL;
+            uint16_t acc = (arg)? atoi(arg) : 0;
             Heap::memFree(data);
-            
-            // mueve el servo
-            PCA9685_ServoDrv::setServoDuty(servo, duty, true);                       
+            if(!setSlewLimits(servo, vel, acc)){
+                DEBUG_TRACE("\r\nServoManager: ERR_SLEW Servo %d\r\n", servo);
+            }
         }
         return;
-    }  
+    }
 
     // si es un comando para mover un nico servo
-    if(MQ::MQClient::isTopicToken(topic, "/info")){
+    if(MQ::MQClient::isTopicToken(topic, "/servo")){
         DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
-        // obtengo los parmetros del mensaje ServoID,Duty
+        // obtengo los parmetros del mensaje ServoID,Deg
         char* data = (char*)Heap::memAlloc(msg_len);
         if(data){
             strcpy(data, (char*)msg);
             char* arg = strtok(data, ",");
             uint8_t servo = atoi(arg);
+            arg = strtok(NULL, ",");
+            uint8_t deg = atoi(arg);
             Heap::memFree(data);
             
-            // mueve el servo
-            uint8_t angle = PCA9685_ServoDrv::getServoAngle(servo);                       
-            uint16_t duty = PCA9685_ServoDrv::getServoDuty(servo);
-            int16_t min_ang, max_ang;
-            uint16_t min_duty, max_duty;
-            PCA9685_ServoDrv::getServoRanges(servo, &min_ang, &max_ang, &min_duty, &max_duty);             
-            DEBUG_TRACE("\r\nServoManager: Servo %d: ang=%d (%d,%d), duty=%d (%d,%d)\r\n", servo, angle, min_ang, max_ang, duty, min_duty, max_duty); 
+            // mueve el servo (el driver limita el ngulo a su rango, sin modificar su estado hasta que cambie la salida)
+            uint8_t local;
+            PCA9685_ServoDrv* drv = getServoDriver(servo, &local);
+            if(drv){
+                moveServo(servo, drv->getDutyFromAngle(local, deg));
+            }
         }
         return;
-    }            
+    }    
 
-    // si es un comando para leer el duty del servo del chip i2c
-    if(MQ::MQClient::isTopicToken(topic, "/read")){
+    // si es un comando para mover un nico servo
+    if(MQ::MQClient::isTopicToken(topic, "/duty")){
         DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
         // obtengo los parmetros del mensaje ServoID,Duty
         char* data = (char*)Heap::memAlloc(msg_len);
@@ -252,19 +2181,35 @@ void ServoManager::subscriptionCb(const char* topic, void* msg, uint16_t msg_len
             strcpy(data, (char*)msg);
             char* arg = strtok(data, ",");
             uint8_t servo = atoi(arg);
+            arg = strtok(NULL, ",");
+            uint16_t duty = atoi(arg);
             Heap::memFree(data);
             
             // mueve el servo
-            uint16_t duty;    
-            if(PCA9685_ServoDrv::readServoDuty(servo, &duty) == PCA9685_ServoDrv::Success){
-                uint8_t angle = PCA9685_ServoDrv::getAngleFromDuty(servo, duty);                                   
-                DEBUG_TRACE("\r\nServoManager: Servo %d: ang=%d, duty=%d\r\n", servo, angle, duty);                 
-            }
-            else{
-                DEBUG_TRACE("\r\nServoManager: ERR_READ Servo %d\r\n", servo); 
-            }
+            moveServo(servo, duty);
         }
         return;
+    }  
+
+    // si es un comando para obtener la informacin de un servo
+    if(MQ::MQClient::isTopicToken(topic, "/info")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        requestInfo(atoi((char*)msg), false);
+        return;
+    }            
+
+    // si es un comando para leer el duty del servo del chip i2c
+    if(MQ::MQClient::isTopicToken(topic, "/read")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        requestInfo(atoi((char*)msg), true);
+        return;
+    }              
+
+    // si es un comando para publicar el estado de todos los servos
+    if(MQ::MQClient::isTopicToken(topic, "/snapshot")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        setSnapshotPeriod(atoi((char*)msg));
+        return;
     }              
 
     // si es un comando para calibrar el servo
@@ -287,28 +2232,45 @@ void ServoManager::subscriptionCb(const char* topic, void* msg, uint16_t msg_len
             Heap::memFree(data);
             
             // calibra el servo
-            PCA9685_ServoDrv::setServoRanges(servo, ang_min, ang_max, d_min, d_max);
+            uint8_t local;
+            PCA9685_ServoDrv* drv = getServoDriver(servo, &local);
+            if(drv){
+                drv->setServoRanges(local, ang_min, ang_max, d_min, d_max);
+            }
         }
         return;
     }                  
 
+    // si es un comando para publicar las estadsticas de temporizacin
+    if(MQ::MQClient::isTopicToken(topic, "/stats")){
+        DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
+        _stats_period_ms = atoi((char*)msg);
+        _stats_pub_ts = us_ticker_read();
+        if(!_stats_period_ms){
+            _th.signal_set(StatsFlag);
+        }
+        return;
+    }                      
+
     // si es un comando para guardar la calibracin de los servos
     if(MQ::MQClient::isTopicToken(topic, "/save")){
         DEBUG_TRACE("\r\nServoManager: Topic:%s msg:%s\r\n", topic, msg);
-        // obtengo los datos de calibracin y los actualizo
-        uint32_t* caldata = (uint32_t*)Heap::memAlloc(NVFlash::getPageSize());
-        if(caldata){
-            NVFlash::readPage(0, caldata);
-            PCA9685_ServoDrv::getNVData(caldata);
-            NVFlash::erasePage(0);
-            if(NVFlash::writePage(0, caldata) == NVFlash::Success){
-                DEBUG_TRACE("\r\nGuardados datos de calibracin\r\n");               
-            }
-            else{
+        switch(saveCalibration()){
+            case CalUnchanged:
+                DEBUG_TRACE("\r\nDatos de calibracin sin cambios\r\n");
+                break;
+            case CalError:
                 DEBUG_TRACE("\r\nERROR guardando datos de calibracin\r\n");
-            }
-            Heap::memFree(caldata);
+                break;
+            default:
+                DEBUG_TRACE("\r\nGuardados datos de calibracin\r\n");               
+                break;
         }
         return;
     }                      
 }
+
+
+//------------------------------------------------------------------------------------
+void ServoManager::publicationCb(const char* topic, int32_t result){
+}
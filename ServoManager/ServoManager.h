@@ -13,27 +13,155 @@
  *  Los topics en los que escucha este mdulo son los siguientes: 
  *
  *  ${sub_topic}/servo S,A
- *      Mueve el servo S al ngulo A (limitado por rangos min,max)
+ *      Mueve el servo S al ngulo A (limitado por rangos min,max). Si el servo tiene lmites de velocidad/aceleracin
+ *      el ngulo se alcanza de forma gradual.
  *
  *  ${sub_topic}/duty S,D
- *      Mueve el servo S al duty D (sin limitacin por rango)
+ *      Mueve el servo S al duty D (sin limitacin por rango). Si el servo tiene lmites de velocidad/aceleracin el duty
+ *      se alcanza de forma gradual.
  *
- *  ${sub_topic}/move/start StepTimeUs,NumSteps,ServoOrigin,StepDif,AngIni,AngEnd
+ *  ${sub_topic}/group S,A[,S,A...]
+ *      Mueve varios servos, cada servo S a su ngulo A, en una nica actualizacin. Los servos con lmites de velocidad/
+ *      aceleracin se aproximan de forma gradual.
+ *
+ *  ${sub_topic}/group/mask M,A[,A...]
+ *      Igual que /group, indicando los servos mediante la mscara M (hexadecimal, bit n = servo n) y sus ngulos A en 
+ *      orden ascendente de servo.
+ *
+ *  ${sub_topic}/pose/save Id
+ *      Guarda el duty actual de todos los servos como la pose Id, en el fichero "pose<Id>" del sistema de ficheros 
+ *      instalado con setFileSystem(). Formato: PoseHeader + uint16_t duty[num_servos] (InvalidDuty si desconocido).
+ *
+ *  ${sub_topic}/pose Id
+ *      Recupera la pose Id y la aplica a todos sus servos en una nica actualizacin.
+ *
+ *  ${sub_topic}/coalesce P
+ *      Activa (P>0) o desactiva (P=0) el modo de agrupacin de comandos. En este modo, /servo y /duty slo registran el
+ *      ltimo destino de cada servo, y los destinos pendientes se escriben juntos mediante flushPending() en el siguiente
+ *      tick de movimiento o, como mximo, P milisegundos despus del primer comando pendiente. As la carga del bus
+ *      queda acotada a una actualizacin cada P ms y la latencia de un comando no supera P ms.
+ *
+ *  ${sub_topic}/slew S,V,A
+ *      Establece los lmites del servo S: velocidad mxima V (pasos de duty/s) y aceleracin mxima A (pasos de duty/s).
+ *      Con V=0 y A=0 se desactiva la limitacin y los comandos se aplican de forma inmediata. Mientras haya servos
+ *      aproximndose a su destino, un ticker de control (SlewTickUs) avanza todos ellos en aritmtica de punto fijo y
+ *      los actualiza en una nica escritura; al alcanzar todos su destino, el ticker se detiene. Los movimientos y 
+ *      ficheros de movimiento no se limitan, y cancelan la aproximacin de los servos que modifican.
+ *
+ *  ${sub_topic}/move/start StepTimeUs,NumSteps,ServoOrigin,StepDif,AngIni,AngEnd[,Swap,Fade]
  *      Genera un patrn de movimiento senoidal(-1,1,-1) con una cadencia de paso StepTimeUs a completar en NumSteps pasos y 
  *      centrado en el servo ServoOrigin. Los servos adyacentes replican el movimiento variando StepDif pasos del servo
- *      origen.
+ *      origen. Si ya hay un movimiento en curso, el nuevo se prepara en un segundo buffer y se conmuta sin detener el
+ *      ticker, al final del ciclo en curso (Swap=0, por defecto) o inmediatamente en el punto de fase equivalente (Swap=1).
+ *      Opcionalmente se puede realizar un fundido de Fade pasos entre ambos movimientos.
  *
  *  ${sub_topic}/move/stop 0
  *      Detiene el patrn de movimiento
  *
  *  ${sub_topic}/info S
- *      Obtiene informacin sobre el servo S
+ *      Publica la informacin del servo S (ngulo, duty, rangos y estado) en ${pub_topic}/info
+ *
+ *  ${sub_topic}/read S
+ *      Lee el duty del servo S del chip y publica el resultado en ${pub_topic}/read. Si la lectura falla o no coincide
+ *      con el ltimo duty escrito, se activa el flag correspondiente del servo en las siguientes publicaciones.
+ *
+ *  ${sub_topic}/snapshot P
+ *      Publica el estado de todos los servos en un nico mensaje en ${pub_topic}/snapshot. Con P=0 se publica una nica
+ *      vez y se desactiva la publicacin peridica, con P>0 se publica cada P milisegundos. El mensaje se construye en 
+ *      un buffer propio, sin reservas de memoria.
  *
  *  ${sub_topic}/cal S,Ai,Af,Di,Df
  *      Calibra los rangos del servo S, con ngulo minmax Ai,Af y duty minmax Di,Df.
  *
  *  ${sub_topic}/save 0
- *      Guarda los datos de calibracin de todos los servos en NVFlash
+ *      Guarda los datos de calibracin de todos los servos en NVFlash. Si no han cambiado respecto de la ltima copia
+ *      guardada no se escribe nada. El controlador c usa la pgina base+c de NVFlash (ver setCalibrationPage), 
+ *      organizada en ranuras (CalSlot) con nmero de secuencia y del tamao real de los datos: cada nueva versin se
+ *      programa a continuacin de la vigente, escribiendo slo las dobles palabras (CalProgramWords) de la nueva
+ *      ranura, que estn borradas, y la pgina slo se borra cuando no queda espacio. La flash no admite programar de
+ *      nuevo una posicin no borrada, por lo que las ranuras previas nunca se reescriben. Si los datos no caben en una
+ *      ranura, se guarda la pgina completa slo si ha cambiado.
+ *
+ *  ${sub_topic}/play Name[,Speed]
+ *      Reproduce el fichero de movimiento Name del sistema de ficheros instalado con setFileSystem(). Detiene el movimiento
+ *      repetitivo en curso. Speed es la velocidad de reproduccin en % (100 por defecto).
+ *
+ *  ${sub_topic}/play/stop 0
+ *      Detiene la reproduccin del fichero de movimiento
+ *
+ *  ${sub_topic}/record/start Name,StepTimeUs
+ *      Inicia la grabacin de los comandos /servo y /duty recibidos en el fichero de movimiento Name, cuantizados a una
+ *      cadencia de StepTimeUs. Los cambios se capturan en un buffer circular (incremento de ticks y de duty) que la tarea
+ *      vuelca al fichero en segundo plano.
+ *
+ *  ${sub_topic}/record/stop 0
+ *      Finaliza la grabacin, volcando los cambios pendientes y cerrando el fichero
+ *
+ *  ${sub_topic}/stats P
+ *      Publica las estadsticas de temporizacin (TickStats) en ${pub_topic}/stats. Con P=0 se publica una nica vez y
+ *      se desactiva la publicacin peridica, con P>0 se publican cada P milisegundos mientras haya movimiento.
+ *
+ *  Publicacin:
+ *      ${pub_topic}/stats
+ *      msg = (ServoManager::TickStats*)
+ *      msg_len = sizeof(ServoManager::TickStats)
+ *
+ *      ${pub_topic}/info, ${pub_topic}/read
+ *      msg = (ServoManager::ServoInfo*)
+ *      msg_len = sizeof(ServoManager::ServoInfo)
+ *
+ *      ${pub_topic}/snapshot
+ *      msg = ServoManager::SnapshotHeader + ServoManager::ServoState[num_servos]
+ *      msg_len = sizeof(ServoManager::SnapshotHeader) + (num_servos * sizeof(ServoManager::ServoState))
+ *
+ *  Ficheros de movimiento:
+ *      Secuencias de duracin ilimitada almacenadas como registros de FSManager (/fs/Name.dat), con el formato:
+ *          MotionHeader                Cabecera (magic, versin, nmero de servos, cadencia de paso y nmero de tramas)
+ *          Trama[frames]               Cada trama es un paso de la secuencia:
+ *              mask[(servos+7)/8]      Mscara de servos que cambian en la trama (bit0 del byte0 = servo 0)
+ *              si mask == 0:
+ *                  uint16_t hold       La trama se repite 'hold' pasos sin cambios (>=1), o bien
+ *                  0,uint32_t step     (versin 2) Nueva cadencia de paso en us para las tramas siguientes. No 
+ *                                      consume un paso. En versin 1 hold=0 equivale a hold=1.
+ *              si no, por cada servo marcado, en orden ascendente:
+ *                  int8_t delta        Incremento de duty respecto a la trama anterior en [-127,127], o bien
+ *                  0x80,uint16_t duty  Duty absoluto (little endian)
+ *      La primera trama debe incluir el duty absoluto de todos los servos. La reproduccin se realiza desde dos bloques
+ *      de StreamChunkSize bytes: mientras se reproduce uno, la tarea rellena el otro desde el fichero entre paso y paso.
+ *
+ *  Suspensin del ticker:
+ *      Cuando los siguientes pasos de un movimiento no modifican ningn servo (tramas 'hold' de un fichero o tramos 
+ *      constantes de un movimiento repetitivo), el ticker de movimiento se detiene y un Timeout lo rearranca en el 
+ *      instante del siguiente paso con cambios, sin activaciones de la tarea ni trfico i2c mientras tanto. Los pasos
+ *      omitidos se aplican al reanudar, por lo que la fase del movimiento no vara. Un nuevo movimiento o un cambio de 
+ *      movimiento durante la suspensin reanuda el ticker en el siguiente lmite de paso.
+ *
+ *  Varios controladores:
+ *      Adems del PCA9685 propio (direccin A5..A0 = 0), se pueden aadir hasta MaxControllers-1 controladores con 
+ *      addController(), en el mismo bus i2c o en otros. Sus servos ocupan los ndices globales a continuacin de los
+ *      existentes, y todos los topics trabajan con ndices globales. En cada actualizacin, las rfagas de todos los
+ *      controladores de un mismo bus se encadenan en una nica transaccin (START repetido entre rfagas) y con las
+ *      salidas configuradas para cambiar en el STOP (MODE2.OCH = 0), por lo que todos los controladores del bus 
+ *      actualizan sus salidas a la vez al finalizar la transaccin.
+ *
+ *      La cach de duty y el estado del limitador de cada servo se reservan en el heap para los servos de los
+ *      controladores aadidos, y los buffers del movimiento repetitivo, la reproduccin y la grabacin de ficheros al
+ *      iniciarse cada funcin por primera vez (y de nuevo si desde entonces se han aadido servos).
+ *
+ *      Cada controlador guarda su calibracin en una pgina propia de NVFlash: el controlador c (0 el propio) ocupa la
+ *      pgina base+c, con base 0 por defecto (setCalibrationPage). Con N controladores se reservan las pginas base a
+ *      base+N-1, que no deben utilizarse para otros datos.
+ *
+ *  Actualizacin de los servos:
+ *      Los duty solicitados se registran en una cach local que marca como 'sucios' nicamente los canales cuyo valor
+ *      difiere del ltimo escrito en el chip. En cada actualizacin se escriben en rfaga (auto-incremento de registros
+ *      del PCA9685) slo los rangos contiguos de canales sucios, comenzando en el registro LEDn_OFF_L del primero. As
+ *      una rfaga de k canales ocupa 4k bytes en el bus (incluyendo direccin y registro), cada byte a 400kHz son 22.5us:
+ *          - 1 servo cambia:                  4 bytes ->   ~95us
+ *          - 3 servos contiguos (senoidal):  12 bytes ->  ~275us
+ *          - 16 servos contiguos (senoidal): 64 bytes -> ~1.45ms
+ *          - servos en reposo:                0 bytes ->     0us
+ *      Los valores reales medidos se pueden consultar mediante getBusStats().
  */
  
 #ifndef __ServoManager__H
@@ -46,6 +174,7 @@
 #include "Logger.h"
 #include "PCA9685_ServoDrv.h"
 #include "NVFlash.h"
+#include "FSManager.h"
 
 
    
@@ -80,6 +209,16 @@ class ServoManager : public PCA9685_ServoDrv{
     void setSubscriptionBase(const char* sub_topic);  
     
   
+    /** Modos de conmutacin entre movimientos repetitivos */
+    enum SwapMode{
+        SwapAtCycleEnd,     /// Al finalizar el ciclo en curso del servo origen
+        SwapPhaseMatched,   /// En el siguiente paso, manteniendo la fase relativa del ciclo
+    };
+    
+    /** Nmero mximo de pasos de un movimiento repetitivo */
+    static const uint8_t MaxMoveSteps = 255;
+    
+  
 	/** startMovement()
      *  Establece un movimiento repetitivo
      *  @param duty Array de movimientos en cuentas pwm
@@ -87,8 +226,11 @@ class ServoManager : public PCA9685_ServoDrv{
      *  @param step_tick_us Tiempo entre paso y paso en us
      *  @param servo_zero Servo que inicia el movimiento. 
      *  @param step_dif Diferencia de paso entre servos adyacentes
+     *  @param swap Modo de conmutacin si hay un movimiento en curso
+     *  @param fade_steps Pasos de fundido con el movimiento en curso (0: sin fundido)
      */
-    void startMovement(uint16_t* duty, uint8_t steps, uint32_t step_tick_us, uint8_t servo_zero, uint8_t step_dif);
+    void startMovement(uint16_t* duty, uint8_t steps, uint32_t step_tick_us, uint8_t servo_zero, uint8_t step_dif, 
+                       SwapMode swap = SwapAtCycleEnd, uint8_t fade_steps = 0);
     
   
 	/** stopMovement()
@@ -100,33 +242,551 @@ class ServoManager : public PCA9685_ServoDrv{
     /** Devuelve el estado del driver
      *  @return Estado del chip
      */
-    bool ready() { return ((PCA9685_ServoDrv::getState() == PCA9685_ServoDrv::Ready)? true : false); }    
+    bool ready();
+    
+    
+    /** Nmero mximo de controladores PCA9685 y de servos gestionables */
+    static const uint8_t MaxControllers = 4;
+    static const uint8_t MaxServos = PCA9685_ServoDrv::ServoCount * MaxControllers;
+    
+  
+	/** addController()
+     *  Aade un controlador PCA9685 adicional, cuyos servos ocupan los ndices globales a continuacin de los existentes
+     *  @param sda Lnea sda del bus i2c
+     *  @param scl Lnea scl del bus i2c
+     *  @param addr Direccin del chip (pines A5..A0)
+     *  @param num_servos Nmero de servos del controlador
+     *  @return ndice global del primer servo del controlador, o -1 en caso de error (incluida la falta de memoria)
+     */
+    int16_t addController(PinName sda, PinName scl, uint8_t addr, uint8_t num_servos);
+    
+  
+	/** getServoDriver()
+     *  Obtiene el driver del controlador que gestiona un servo. Slo para consultas y calibracin: las escrituras de
+     *  duty o ngulo a travs del driver no pasan por la cach de ServoManager
+     *  @param servo ndice global del servo
+     *  @param local Recibe el ndice del servo en su controlador
+     *  @return Driver del controlador, o NULL si el servo no existe
+     */
+    PCA9685_ServoDrv* getServoDriver(uint8_t servo, uint8_t* local);
+    
+  
+	/** setServoAngle()
+     *  Sustituye a la del driver: registra el ngulo de un servo en la cach de duty, de forma inmediata (sin lmites
+     *  de velocidad/aceleracin)
+     *  @param servo ndice global del servo
+     *  @param angle ngulo
+     *  @param update Flag para escribir de inmediato los canales pendientes
+     *  @return Success, InvalidServoError o I2CError si falla la escritura
+     */
+    ErrorResult setServoAngle(uint8_t servo, uint8_t angle, bool update = false);
+    
+  
+	/** setServoDuty()
+     *  Sustituye a la del driver: registra el duty de un servo en la cach de duty, de forma inmediata (sin lmites
+     *  de velocidad/aceleracin)
+     *  @param servo ndice global del servo
+     *  @param duty Duty en cuentas pwm
+     *  @param update Flag para escribir de inmediato los canales pendientes
+     *  @return Success, InvalidServoError o I2CError si falla la escritura
+     */
+    ErrorResult setServoDuty(uint8_t servo, uint16_t duty, bool update = false);
+    
+  
+	/** setSlewLimits()
+     *  Establece los lmites de velocidad y aceleracin de un servo
+     *  @param servo ndice global del servo
+     *  @param max_vel Velocidad mxima en pasos de duty/s (0: sin lmite)
+     *  @param max_acc Aceleracin mxima en pasos de duty/s (0: sin lmite)
+     *  @return True si el servo existe
+     */
+    bool setSlewLimits(uint8_t servo, uint16_t max_vel, uint16_t max_acc);
+    
+  
+	/** moveServo()
+     *  Mueve un servo a un duty, de forma gradual si tiene lmites de velocidad/aceleracin
+     *  @param servo ndice global del servo
+     *  @param duty Duty de destino
+     */
+    void moveServo(uint8_t servo, uint16_t duty);
+    
+  
+	/** moveGroup()
+     *  Mueve un grupo de servos a sus duty de destino en una nica actualizacin
+     *  @param servo ndices globales de los servos
+     *  @param duty Duty de destino de cada servo
+     *  @param count Nmero de servos
+     */
+    void moveGroup(const uint8_t* servo, const uint16_t* duty, uint8_t count);
+    
+  
+	/** savePose()
+     *  Guarda el duty actual de todos los servos como una pose en el sistema de ficheros
+     *  @param id Identificador de la pose
+     *  @return True si se ha guardado
+     */
+    bool savePose(uint8_t id);
+    
+  
+	/** recallPose()
+     *  Recupera una pose del sistema de ficheros y la aplica en una nica actualizacin
+     *  @param id Identificador de la pose
+     *  @return True si se ha aplicado
+     */
+    bool recallPose(uint8_t id);
+    
+  
+	/** setCoalescing()
+     *  Activa o desactiva el modo de agrupacin de comandos
+     *  @param period_ms Latencia mxima de un comando en ms (0: desactivado, cada comando se escribe de inmediato)
+     */
+    void setCoalescing(uint16_t period_ms);
+    
+  
+	/** flushPending()
+     *  Escribe en una nica actualizacin todos los destinos pendientes
+     *  @return Nmero de bytes transferidos en el bus
+     */
+    uint32_t flushPending();
+    
+  
+	/** updateAll()
+     *  Sustituye a la del driver: incorpora a la cach el duty de los servos modificados directamente en su driver y
+     *  escribe en una nica actualizacin todos los canales pendientes
+     *  @return Success o I2CError si algn canal queda pendiente de escribir
+     */
+    ErrorResult updateAll();
+    
+    
+    /** Estadsticas de uso del bus i2c en las actualizaciones de los servos */
+    struct BusStats{
+        uint32_t updates;                   /// Nmero de actualizaciones con escritura en el bus
+        uint32_t bytes;                     /// Bytes transferidos en la ltima actualizacin
+        uint32_t us;                        /// Duracin (us) de la ltima actualizacin
+        uint32_t total_bytes;               /// Bytes transferidos desde el arranque
+        uint32_t errors;                    /// Nmero de errores de escritura en el bus
+        uint32_t coalesced;                 /// Comandos sustituidos por otro posterior antes de escribirse
+    };
+    
+    
+    /** Cabecera de los ficheros de movimiento */
+    struct MotionHeader{
+        uint32_t magic;                     /// MotionMagic
+        uint8_t  version;                   /// MotionVersion
+        uint8_t  num_servos;                /// Nmero de servos en cada trama
+        uint16_t reserved;
+        uint32_t step_tick_us;              /// Tiempo entre trama y trama en us
+        uint32_t frames;                    /// Nmero de tramas (pasos) de la secuencia
+    };
+    static const uint32_t MotionMagic = 0x564F4D53;    /// 'SMOV'
+    static const uint8_t  MotionVersion = 2;
+    static const uint8_t  MotionAbsDuty = 0x80;        /// Marca de duty absoluto en una trama
+    
+    
+    /** Cabecera de los ficheros de pose */
+    struct PoseHeader{
+        uint32_t magic;                     /// PoseMagic
+        uint8_t  num_servos;                /// Nmero de duty a continuacin
+        uint8_t  reserved[3];
+    };
+    static const uint32_t PoseMagic = 0x534F5053;      /// 'SPOS'
+    
+  
+	/** setFileSystem()
+     *  Instala el sistema de ficheros desde el que se reproducen los ficheros de movimiento
+     *  @param fs Sistema de ficheros
+     */
+    void setFileSystem(FSManager* fs){ _fs = fs; }
+    
+  
+	/** playMotion()
+     *  Inicia la reproduccin de un fichero de movimiento. La apertura y la lectura del fichero se realizan en el contexto
+     *  de la tarea.
+     *  @param data_id Identificador del fichero en FSManager
+     *  @param speed Velocidad de reproduccin en % respecto de la cadencia grabada
+     *  @return True si la solicitud se ha aceptado
+     */
+    bool playMotion(const char* data_id, uint16_t speed = 100);
+    
+  
+	/** stopMotion()
+     *  Detiene la reproduccin del fichero de movimiento
+     */
+    void stopMotion();
+    
+  
+	/** startRecord()
+     *  Inicia la grabacin de los cambios de duty recibidos mediante comandos. La creacin y escritura del fichero se
+     *  realizan en el contexto de la tarea.
+     *  @param data_id Identificador del fichero en FSManager
+     *  @param step_tick_us Cadencia de cuantizacin de los cambios
+     *  @return True si la solicitud se ha aceptado
+     */
+    bool startRecord(const char* data_id, uint32_t step_tick_us);
+    
+  
+	/** stopRecord()
+     *  Finaliza la grabacin en curso
+     */
+    void stopRecord();
+    
+    
+    /** Resultados de la gestin de los datos de calibracin en NVFlash */
+    enum CalResult{
+        CalSaved,           /// Guardados en una ranura libre
+        CalSavedErased,     /// Guardados tras borrar la pgina (no quedaban ranuras libres)
+        CalUnchanged,       /// Sin cambios respecto de la ltima copia guardada, no se escribe
+        CalRestored,        /// Recuperados de la ltima ranura vlida
+        CalRestoredLegacy,  /// Recuperados de una pgina con formato previo (sin ranuras)
+        CalError,           /// Error de acceso a NVFlash o datos no vlidos
+    };
+    
+  
+	/** setCalibrationPage()
+     *  Ajusta la primera pgina de NVFlash reservada para la calibracin. El controlador c utiliza la pgina base+c
+     *  @param base Pgina del controlador propio (0 por defecto)
+     */
+    void setCalibrationPage(uint32_t base){ _cal_page = base; }
+    
+  
+	/** saveCalibration()
+     *  Guarda los datos de calibracin de todos los servos en la siguiente ranura libre de NVFlash, si han cambiado. El
+     *  controlador c utiliza la pgina base+c (ver setCalibrationPage).
+     *  @return Resultado de la operacin
+     */
+    CalResult saveCalibration();
+    
+  
+	/** restoreCalibration()
+     *  Recupera los datos de calibracin de la ranura de NVFlash con mayor nmero de secuencia
+     *  @return Resultado de la operacin
+     */
+    CalResult restoreCalibration();
+    
+    
+	/** getBusStats()
+     *  Obtiene las estadsticas de uso del bus i2c
+     *  @param stats Recibe las estadsticas
+     */
+    void getBusStats(BusStats* stats);
+    
+    
+    /** Estadsticas de temporizacin de los pasos del movimiento */
+    struct TickStats{
+        uint32_t ticks;                     /// Ticks generados por el ticker
+        uint32_t updates;                   /// Pasos atendidos por la tarea
+        uint32_t missed;                    /// Ticks perdidos por retraso de la tarea
+        uint32_t coalesced;                 /// Pasos atendidos que agruparon varios ticks
+        uint32_t latency_us;                /// Latencia ISR->actualizacin del ltimo paso
+        uint32_t latency_avg_us;            /// Latencia media (filtro exponencial 1/8)
+        uint32_t latency_max_us;            /// Latencia mxima
+        uint32_t jitter_max_us;             /// Desviacin mxima del periodo entre ticks consecutivos
+        uint32_t bus_us;                    /// Duracin de la ltima actualizacin i2c
+        uint32_t bus_max_us;                /// Duracin mxima de la actualizacin i2c
+        uint32_t suspended;                 /// Pasos omitidos con el ticker suspendido
+    };
+    
+    /** Poltica de recuperacin cuando se han perdido ticks */
+    enum CatchUpPolicy{
+        CatchUpSkipSteps,       /// Ejecuta un nico paso, descartando los perdidos (el movimiento se retrasa)
+        CatchUpAdvancePhase,    /// Avanza tantos pasos como ticks transcurridos (el movimiento mantiene su fase)
+    };
+    
+    
+	/** getTickStats()
+     *  Obtiene una copia de las estadsticas de temporizacin
+     *  @param stats Recibe las estadsticas
+     */
+    void getTickStats(TickStats* stats);
+    
+    
+	/** resetTickStats()
+     *  Reinicia las estadsticas de temporizacin
+     */
+    void resetTickStats();
+    
+    
+    /** Flags de estado de un servo en la telemetra */
+    enum ServoFlags{
+        ServoUnknown        = (1<<0),       /// Duty desconocido (no escrito an)
+        ServoPending        = (1<<1),       /// Duty pendiente de escribir en el chip
+        ServoSlewing        = (1<<2),       /// Aproximacin en curso con lmites de velocidad/aceleracin
+        ServoReadError      = (1<<3),       /// Fall la ltima lectura del chip
+        ServoReadMismatch   = (1<<4),       /// La ltima lectura del chip no coincide con el duty escrito
+    };
+    
+    /** Informacin de un servo (${pub_topic}/info y ${pub_topic}/read) */
+    struct ServoInfo{
+        uint8_t servo;                      /// ndice global del servo
+        uint8_t angle;                      /// ngulo actual
+        uint8_t flags;                      /// Flags de estado (ServoFlags)
+        uint8_t reserved;
+        int16_t min_ang;                    /// Rango de ngulo
+        int16_t max_ang;
+        uint16_t duty;                      /// Duty actual
+        uint16_t min_duty;                  /// Rango de duty
+        uint16_t max_duty;
+        uint16_t read_duty;                 /// Duty ledo del chip (slo en /read, 0xFFFF si no disponible)
+    };
+    
+    /** Cabecera del estado de todos los servos (${pub_topic}/snapshot) */
+    struct SnapshotHeader{
+        uint32_t ts_us;                     /// Instante de la captura
+        uint32_t seq;                       /// Nmero de secuencia de la publicacin
+        uint8_t num_servos;                 /// Nmero de ServoState a continuacin
+        uint8_t reserved;
+        uint16_t read_errors;               /// Lecturas del chip fallidas o con discrepancias desde el arranque
+    };
+    
+    /** Estado de un servo en ${pub_topic}/snapshot */
+    struct ServoState{
+        uint16_t duty;                      /// Duty actual
+        uint8_t angle;                      /// ngulo actual
+        uint8_t flags;                      /// Flags de estado (ServoFlags)
+    };
+    
+    
+	/** getServoInfo()
+     *  Obtiene la informacin de un servo
+     *  @param servo ndice global del servo
+     *  @param info Recibe la informacin
+     *  @return True si el servo existe
+     */
+    bool getServoInfo(uint8_t servo, ServoInfo* info);
+    
+    
+	/** setSnapshotPeriod()
+     *  Establece el periodo de publicacin del estado de todos los servos
+     *  @param period_ms Periodo en ms (0: publica una nica vez y desactiva la publicacin peridica)
+     */
+    void setSnapshotPeriod(uint32_t period_ms);
+    
+    
+	/** setCatchUpPolicy()
+     *  Establece la poltica de recuperacin ante ticks perdidos
+     *  @param policy Poltica a aplicar
+     */
+    void setCatchUpPolicy(CatchUpPolicy policy){ _catch_up = policy; }
+    
+  
+	/** setPublicationBase()
+     *  Registra el topic base a los que publicar el mdulo
+     *  @param pub_topic Topic base para la publicacin
+     */
+    void setPublicationBase(const char* pub_topic);     
     
     
   protected:
+    
+    /** Parmetros del bus i2c y registros del PCA9685 utilizados en las escrituras en rfaga */
+    static const uint8_t  BusBaseAddress = 0x80;        /// Direccin i2c con A5..A0 = 0
+    static const uint32_t BusFrequency = 400000;        /// Frecuencia del bus i2c
+    static const uint8_t  RegMode1 = 0x00;              /// Registro MODE1
+    static const uint8_t  RegMode2 = 0x01;              /// Registro MODE2
+    static const uint8_t  RegLed0OffL = 0x08;           /// Registro LED0_OFF_L
+    static const uint8_t  Mode1AutoIncrement = (1<<5);  /// Bit AI del registro MODE1
+    static const uint8_t  Mode2OutputOnAck = (1<<3);    /// Bit OCH del registro MODE2 (0: cambio en STOP)
+    static const uint8_t  RegsPerChannel = 4;           /// Registros por canal (ON_L, ON_H, OFF_L, OFF_H)
+    static const uint16_t InvalidDuty = 0xFFFF;         /// Duty no escrito an en el chip
+    static const uint32_t SlewTickUs = 5000;            /// Periodo del limitador de velocidad/aceleracin
+    static const uint8_t  IdleMinSteps = 2;             /// Pasos sin cambios mnimos para suspender el ticker
+    static const uint8_t  SlewFracBits = 16;            /// Bits fraccionarios del punto fijo del limitador
+    
+    /** Estado del limitador de cada servo (posicin, velocidad y lmites en Q16.16 pasos de duty por tick) */
+    struct Slew_t{
+        int32_t pos;                        /// Posicin actual
+        int32_t vel;                        /// Velocidad actual (con signo)
+        int32_t target;                     /// Posicin de destino
+        int32_t vmax;                       /// Velocidad mxima (0: sin lmite)
+        int32_t amax;                       /// Aceleracin mxima (0: sin lmite)
+        uint16_t out;                       /// ltimo duty aplicado por el limitador
+    };
+    
+    /** Estructura de gestin de cada controlador PCA9685 */
+    struct Controller_t{
+        PCA9685_ServoDrv* drv;              /// Driver del controlador
+        I2C* i2c;                           /// Bus i2c (compartido entre controladores con los mismos pines)
+        PinName sda;                        /// Lnea sda del bus
+        PinName scl;                        /// Lnea scl del bus
+        uint8_t addr;                       /// Direccin i2c (8 bits)
+        uint8_t first;                      /// ndice global del primer servo
+        uint8_t num;                        /// Nmero de servos
+        bool init;                          /// Flag de registros MODE1/MODE2 configurados
+    };
+    
+    /** Rfaga de escritura de un rango contiguo de canales de un controlador */
+    struct Burst_t{
+        char buf[1 + (RegsPerChannel * PCA9685_ServoDrv::ServoCount)];  /// Registro inicial y datos
+        int len;                            /// Bytes a escribir
+        uint8_t addr;                       /// Direccin i2c del controlador
+        uint8_t first;                      /// ndice global del primer servo de la rfaga
+        uint8_t last;                       /// ndice global siguiente al ltimo servo de la rfaga
+    };
       
     /** Flags de tarea (asociados a la mquina de estados) */
     enum SigEventFlags{
-        TickMoveFlag  = (1<<0),
+        TickMoveFlag    = (1<<0),
+        StreamStartFlag = (1<<1),       /// Solicitud de inicio de reproduccin de un fichero
+        StreamStopFlag  = (1<<2),       /// Solicitud de fin de reproduccin de un fichero
+        RecordStartFlag = (1<<3),       /// Solicitud de inicio de grabacin
+        RecordFlushFlag = (1<<4),       /// Solicitud de volcado del buffer de grabacin
+        RecordStopFlag  = (1<<5),       /// Solicitud de fin de grabacin
+        SlewTickFlag    = (1<<6),       /// Tick del limitador de velocidad/aceleracin
+        CoalesceFlag    = (1<<7),       /// Vencimiento del plazo de agrupacin de comandos
+        SnapshotFlag    = (1<<8),       /// Publicacin peridica del estado de los servos
+        InfoFlag        = (1<<9),       /// Solicitud de publicacin de la informacin o lectura de servos
+        StatsFlag       = (1<<10),      /// Solicitud de publicacin de las estadsticas de temporizacin
+    };
+      
+    /** Parmetros de reproduccin de ficheros de movimiento */
+    static const uint16_t StreamChunkSize = 256;        /// Tamao de cada bloque de lectura
+    static const uint8_t  StreamNameLen = 24;           /// Longitud mxima del identificador del fichero
+      
+    /** Estructura de reproduccin de ficheros de movimiento */
+    struct MotionStream_t{
+        int32_t rs;                         /// Manejador del recordset
+        int32_t pos;                        /// Posicin de lectura en el fichero
+        uint8_t buf[2][StreamChunkSize];    /// Bloques de lectura
+        uint16_t len[2];                    /// Bytes vlidos en cada bloque (0: pendiente de rellenar)
+        uint8_t cur;                        /// Bloque en reproduccin
+        uint16_t idx;                       /// Posicin de lectura en el bloque en reproduccin
+        bool eof;                           /// Flag de fin de fichero alcanzado
+        bool refill;                        /// Flag de bloque pendiente de rellenar
+        uint8_t version;                    /// Versin del formato del fichero
+        uint8_t num_servos;                 /// Servos en cada trama
+        uint8_t mask_len;                   /// Bytes de la mscara de cada trama
+        uint32_t frames;                    /// Tramas pendientes de decodificar
+        uint16_t hold;                      /// Tramas sin cambios pendientes
+        uint32_t underruns;                 /// Pasos sin datos disponibles a tiempo
+        uint8_t servos;                     /// Servos con duty reservado (los del fichero a partir de ste se descartan)
+        uint16_t* duty;                     /// Duty decodificado de cada servo (reservado a continuacin)
+    };
+      
+    /** Parmetros de grabacin de ficheros de movimiento */
+    static const uint16_t RecordRingSize = 512;         /// Tamao del buffer circular de captura
+    static const uint8_t  RecordEventMaxSize = 7;       /// Tamao mximo de un evento (ticks, servo, duty)
+    static const uint8_t  RecordOutSize = 64;           /// Tamao del buffer de escritura en fichero
+    
+    /** Parmetros de las ranuras de calibracin en la pgina de NVFlash de cada controlador */
+    static const uint32_t CalMagic = 0x4C414353;        /// 'SCAL'
+    static const uint32_t CalErased = 0xFFFFFFFF;       /// Valor de una palabra borrada
+    static const uint32_t CalGuard = 0xA5C35A3C;        /// Relleno para obtener el tamao real de los datos
+    static const uint32_t CalProgramWords = 2;          /// Unidad de programacin de la flash (doble palabra)
+    
+    /** Cabecera de cada ranura de calibracin, seguida de sus palabras de datos */
+    struct CalSlotHeader{
+        uint32_t magic;                     /// CalMagic
+        uint32_t seq;                       /// Nmero de secuencia, la ranura vlida ms alta es la vigente
+        uint32_t checksum;                  /// Complemento de la suma de seq, words y los datos
+        uint32_t words;                     /// Palabras de datos de la ranura (la ranura se completa a dobles palabras)
+    };
+    static const uint16_t CalHeaderWords = sizeof(CalSlotHeader) / sizeof(uint32_t);
+    
+    /** Estructura de grabacin de ficheros de movimiento. Los eventos del buffer circular se codifican como:
+     *      ticks desde el evento anterior (1 a 3 bytes, 7 bits por byte, bit7 = contina), servo (1 byte) y
+     *      duty (int8 incremental respecto del ltimo capturado del servo, o MotionAbsDuty + uint16 absoluto)
+     */
+    struct MotionRecord_t{
+        char name[StreamNameLen];           /// Identificador del fichero
+        int32_t rs;                         /// Manejador del recordset
+        int32_t pos;                        /// Posicin de escritura en el fichero
+        uint32_t step_tick_us;              /// Cadencia de cuantizacin
+        uint32_t t0;                        /// Instante de inicio de la grabacin
+        uint32_t stop_tick;                 /// Tick de fin de la grabacin
+        // captura (contexto de los comandos)
+        uint8_t ring[RecordRingSize];       /// Buffer circular de eventos
+        volatile uint16_t head;             /// Posicin de escritura en el buffer circular
+        volatile uint16_t tail;             /// Posicin de lectura en el buffer circular
+        uint32_t tick;                      /// Tick del ltimo evento capturado
+        uint16_t* last;                     /// ltimo duty capturado de cada servo
+        uint32_t dropped;                   /// Eventos descartados por buffer lleno
+        // volcado (contexto de la tarea)
+        uint32_t dec_tick;                  /// Tick del ltimo evento decodificado
+        uint32_t frame_tick;                /// Tick de la trama en construccin
+        uint64_t frame_mask;                /// Servos modificados en la trama en construccin
+        uint16_t* frame_duty;               /// Duty actual de cada servo
+        uint16_t* emit_duty;                /// Duty de cada servo en la ltima trama escrita
+        uint32_t frames;                    /// Tramas escritas
+        uint8_t out[RecordOutSize];         /// Buffer de escritura en fichero
+        uint8_t out_len;                    /// Bytes pendientes en el buffer de escritura
+        uint8_t servos;                     /// Servos de la grabacin (arrays por servo reservados a continuacin)
     };
       
     /** Estructura de ejecucin de movimientos repetitivos */
     struct RepetitiveMovement_t{
-        uint16_t *duty;
+        uint16_t duty[MaxMoveSteps];
         uint8_t steps;
         uint32_t step_tick_us;
+        uint8_t servo_zero;
+        uint8_t servos;                 /// Servos del movimiento (arrays por servo reservados a continuacin)
+        uint8_t* offset;                /// Paso inicial de cada servo
+        uint8_t* step;                  /// Paso en curso de cada servo
     };
         
     Thread      _th;                    /// Manejador del thread
     uint32_t    _timeout;               /// Manejador de timming en la tarea
     char*       _sub_topic;             /// Topic base para la suscripcin
+    char*       _pub_topic;             /// Topic base para la publicacin
+    char*       _pub_topic_unique;      /// Topic para publicar
     Logger*     _debug;                 /// Canal de depuracin
     uint8_t     _num_servos;            /// Nmero de servos
-    RepetitiveMovement_t _rmove;        /// Movimiento repetitivo
-    uint8_t _move_step[PCA9685_ServoDrv::ServoCount];
+    RepetitiveMovement_t* _rmove[2];    /// Movimientos repetitivos (en curso y preparado), reservados al utilizarse
+    uint8_t     _rmove_front;           /// ndice del movimiento en curso
+    bool        _rmove_active;          /// Flag de movimiento en curso
+    bool        _rmove_staged;          /// Flag de movimiento preparado pendiente de conmutar
+    SwapMode    _rmove_swap;            /// Modo de conmutacin del movimiento preparado
+    uint8_t     _fade_steps;            /// Pasos de fundido del movimiento preparado
+    uint8_t     _fade_left;             /// Pasos de fundido pendientes
     Ticker _tick_move;
+    Ticker      _tick_slew;             /// Ticker del limitador de velocidad/aceleracin
+    Slew_t*     _slew;                  /// Estado del limitador de cada servo
+    uint64_t    _slew_active;           /// Mscara de servos aproximndose a su destino
+    Timeout     _tick_coalesce;         /// Plazo de escritura de los comandos agrupados
+    uint32_t    _coalesce_us;           /// Latencia mxima de los comandos agrupados (0: desactivado)
+    bool        _coalesce_armed;        /// Flag de plazo de agrupacin en curso
+    uint32_t    _tick_period_us;        /// Cadencia actual del ticker
+    FSManager*  _fs;                    /// Sistema de ficheros para los ficheros de movimiento
+    MotionStream_t* _stream;            /// Reproduccin de ficheros de movimiento, reservada al utilizarse
+    char        _stream_name[StreamNameLen];    /// Identificador del fichero a reproducir
+    bool        _stream_active;         /// Flag de reproduccin en curso
+    uint16_t    _stream_speed;          /// Velocidad de reproduccin solicitada en %
+    MotionRecord_t* _rec;               /// Grabacin de ficheros de movimiento, reservada al utilizarse
+    bool        _rec_active;            /// Flag de captura en curso
+    bool        _rec_busy;              /// Flag de grabacin pendiente de cerrar por la tarea
+    
+    Controller_t _ctrl[MaxControllers]; /// Controladores PCA9685 (el 0 es el propio)
+    uint8_t     _num_ctrl;              /// Nmero de controladores
+    uint32_t    _cal_page;              /// Pgina de NVFlash de la calibracin del controlador 0
+    Mutex       _mut;                   /// Mutex de acceso a la cach de duty
+    uint16_t*   _duty_req;              /// Duty solicitado en cada canal
+    uint16_t*   _duty_out;              /// ltimo duty escrito en el chip
+    uint64_t    _dirty;                 /// Mscara de canales pendientes de escribir
+    BusStats    _bus_stats;             /// Estadsticas de uso del bus
+    
+    volatile uint32_t _tick_count;      /// Ticks generados (actualizado en ISR)
+    volatile uint32_t _tick_ts;         /// Instante (us) del ltimo tick (actualizado en ISR)
+    uint32_t    _tick_served;           /// Ticks atendidos por la tarea
+    uint32_t    _tick_prev_ts;          /// Instante del tick atendido anterior
+    Timeout     _tick_idle;             /// Reanudacin del ticker de movimiento tras una suspensin
+    bool        _idle;                  /// Flag de ticker de movimiento suspendido
+    volatile bool _idle_fired;          /// Flag de reanudacin en curso (actualizado en ISR)
+    uint32_t    _idle_ts;               /// Instante del ltimo paso atendido antes de la suspensin
+    TickStats   _tick_stats;            /// Estadsticas de temporizacin
+    TickStats   _tick_stats_msg;        /// Copia de las estadsticas para su publicacin
+    CatchUpPolicy _catch_up;            /// Poltica de recuperacin ante ticks perdidos
+    uint32_t    _stats_period_ms;       /// Periodo de publicacin de estadsticas (0: desactivada)
+    uint32_t    _stats_pub_ts;          /// Instante de la ltima publicacin de estadsticas
+    ServoInfo   _info_msg;              /// Mensaje de informacin de un servo
+    uint64_t    _info_req;              /// Mscara de servos con publicacin de /info pendiente
+    uint64_t    _read_req;              /// Mscara de servos con lectura y publicacin de /read pendiente
+    uint32_t    _snap_seq;              /// Nmero de secuencia del estado de los servos
+    Ticker      _tick_snap;             /// Ticker de publicacin del estado de los servos
+    uint64_t    _read_err;              /// Mscara de servos con fallo en la ltima lectura del chip
+    uint64_t    _read_mismatch;         /// Mscara de servos con discrepancia en la ltima lectura del chip
+    uint16_t    _read_errors;           /// Lecturas del chip fallidas o con discrepancias
 
     MQ::SubscribeCallback     _subscrCb;    /// Callback de suscripcin en topics
+    MQ::PublishCallback       _publCb;      /// Callback de publicacin en topics
     
 	/** task()
      *  Hilo de ejecucin del protocolo 
@@ -138,6 +798,381 @@ class ServoManager : public PCA9685_ServoDrv{
      *  Callback invocada tras recibir un evento de temporizacin
      */
     void onTickCb();        
+  
+    
+	/** onIdleCb()
+     *  Callback invocada al finalizar la suspensin del ticker de movimiento: lo rearranca y genera el tick en curso
+     */
+    void onIdleCb();
+    
+    
+	/** tickStart()
+     *  Arranca (o reajusta) el ticker de movimiento, cancelando una posible suspensin
+     *  @param period_us Cadencia de paso
+     */
+    void tickStart(uint32_t period_us);
+    
+    
+	/** tickStop()
+     *  Detiene el ticker de movimiento, cancelando una posible suspensin
+     */
+    void tickStop();
+    
+    
+	/** tickSuspend()
+     *  Suspende el ticker de movimiento hasta el siguiente paso con cambios
+     *  @param ts Instante del paso atendido
+     *  @param steps Pasos siguientes sin cambios
+     */
+    void tickSuspend(uint32_t ts, uint32_t steps);
+    
+    
+	/** tickWake()
+     *  Adelanta la reanudacin de un ticker suspendido al siguiente lmite de paso
+     */
+    void tickWake();
+    
+    
+	/** stillSteps()
+     *  Calcula los pasos siguientes del movimiento en curso que no modifican ningn servo
+     *  @return Nmero de pasos sin cambios
+     */
+    uint32_t stillSteps();
+    
+    
+	/** skipSteps()
+     *  Avanza el movimiento en curso los pasos omitidos durante la suspensin, sin modificar los servos
+     *  @param steps Pasos omitidos
+     */
+    void skipSteps(uint32_t steps);
+    
+    
+	/** onSlewTickCb()
+     *  Callback invocada en cada tick del limitador de velocidad/aceleracin
+     */
+    void onSlewTickCb();
+    
+    
+	/** setTarget()
+     *  Establece el destino de un servo: inmediato o mediante el limitador, segn sus lmites. Requiere _mut tomado
+     *  @param servo ndice global del servo
+     *  @param duty Duty de destino
+     */
+    void setTarget(uint8_t servo, uint16_t duty);
+    
+    
+	/** groupAngle()
+     *  Establece el destino de un servo a partir de un ngulo. Requiere _mut tomado
+     *  @param servo ndice global del servo
+     *  @param deg ngulo de destino
+     */
+    void groupAngle(uint8_t servo, uint8_t deg);
+    
+    
+	/** commitTargets()
+     *  Escribe los destinos inmediatos pendientes, o arma el plazo de escritura en modo agrupacin. Requiere _mut tomado
+     */
+    void commitTargets();
+    
+    
+	/** onCoalesceCb()
+     *  Callback invocada al vencer el plazo de agrupacin de comandos
+     */
+    void onCoalesceCb();
+    
+    
+	/** slewStep()
+     *  Avanza un tick los servos con aproximacin en curso y los actualiza en una nica escritura
+     */
+    void slewStep();
+    
+    
+	/** isqrt()
+     *  Raz cuadrada entera
+     *  @param x Valor
+     *  @return Parte entera de la raz cuadrada de x
+     */
+    static uint32_t isqrt(uint64_t x);
+    
+    
+	/** updateTickStats()
+     *  Registra la temporizacin del tick atendido
+     *  @param now Instante en us en que finaliza la actualizacin i2c del paso
+     *  @param ts Instante del ltimo tick en us
+     *  @param pending Ticks generados desde el ltimo atendido
+     *  @param bus_us Duracin de la actualizacin i2c
+     */
+    void updateTickStats(uint32_t now, uint32_t ts, uint32_t pending, uint32_t bus_us);
+    
+    
+	/** publishTickStats()
+     *  Publica una copia de las estadsticas de temporizacin en ${pub_topic}/stats
+     */
+    void publishTickStats();
+    
+    
+	/** onSnapshotCb()
+     *  Callback invocada peridicamente para publicar el estado de los servos
+     */
+    void onSnapshotCb();
+    
+    
+	/** servoFlags()
+     *  Obtiene los flags de estado de un servo (requiere _mut)
+     *  @param servo ndice global del servo
+     *  @return Flags de estado (ServoFlags)
+     */
+    uint8_t servoFlags(uint8_t servo);
+    
+    
+	/** readServo()
+     *  Lee el duty de un servo del chip y actualiza sus flags de lectura
+     *  @param servo ndice global del servo
+     *  @param info Recibe la informacin del servo, con el duty ledo
+     *  @return True si la lectura es correcta
+     */
+    bool readServo(uint8_t servo, ServoInfo* info);
+    
+    
+	/** requestInfo()
+     *  Solicita a la tarea la publicacin de la informacin de un servo. Todas las publicaciones se realizan desde la
+     *  tarea, que es la nica que utiliza los buffers de publicacin
+     *  @param servo ndice global del servo
+     *  @param read Flag para leer previamente el duty del chip (/read) o no (/info)
+     */
+    void requestInfo(uint8_t servo, bool read);
+    
+    
+	/** publishRequests()
+     *  Atiende las solicitudes de publicacin de /info y /read pendientes (desde la tarea)
+     */
+    void publishRequests();
+    
+    
+	/** publishInfo()
+     *  Publica la informacin de un servo en ${pub_topic}/<name>
+     *  @param name Nombre del topic
+     */
+    void publishInfo(const char* name);
+    
+    
+	/** publishSnapshot()
+     *  Publica el estado de todos los servos en ${pub_topic}/snapshot
+     */
+    void publishSnapshot();
+    
+    
+	/** allocServos()
+     *  Ampla la cach de duty y el estado del limitador a un nuevo nmero de servos, conservando los de los servos 
+     *  existentes. Requiere _mut tomado
+     *  @param num Nmero total de servos
+     *  @return True si se ha reservado la memoria
+     */
+    bool allocServos(uint8_t num);
+    
+    
+	/** moveAlloc()
+     *  Reserva el buffer de un movimiento repetitivo, o lo ampla si se han aadido servos. Requiere _mut tomado
+     *  @param idx ndice del buffer (nunca el del movimiento en curso)
+     *  @return True si el buffer est disponible
+     */
+    bool moveAlloc(uint8_t idx);
+    
+    
+	/** moveStep()
+     *  Ejecuta un paso del movimiento repetitivo, conmutando al movimiento preparado si corresponde. Debe
+     *  invocarse con el mutex tomado.
+     */
+    void moveStep();
+    
+    
+	/** playStep()
+     *  Ejecuta un paso del origen de movimiento activo (fichero o movimiento repetitivo). Debe invocarse con el 
+     *  mutex tomado.
+     */
+    void playStep();
+    
+    
+	/** streamAlloc()
+     *  Reserva el buffer de reproduccin, o lo ampla si se han aadido servos. Slo desde la tarea, con la
+     *  reproduccin detenida
+     *  @return True si el buffer est disponible
+     */
+    bool streamAlloc();
+    
+    
+	/** streamStart()
+     *  Abre el fichero solicitado, lee su cabecera, precarga los dos bloques e inicia la reproduccin
+     *  @return True si se ha iniciado la reproduccin
+     */
+    bool streamStart();
+    
+    
+	/** streamStop()
+     *  Finaliza la reproduccin y cierra el fichero
+     */
+    void streamStop();
+    
+    
+	/** streamRefill()
+     *  Rellena desde el fichero el bloque que no est en reproduccin, si est vaco
+     */
+    void streamRefill();
+    
+    
+	/** streamStep()
+     *  Decodifica la siguiente trama del fichero de movimiento. Debe invocarse con el mutex tomado.
+     */
+    void streamStep();
+    
+    
+	/** streamByte()
+     *  Obtiene el siguiente byte del bloque en reproduccin, pasando al siguiente bloque al agotarlo
+     *  @return Byte ledo
+     */
+    uint8_t streamByte();
+    
+    
+	/** recordAlloc()
+     *  Reserva el buffer de grabacin, o lo ampla si se han aadido servos. Requiere _mut tomado y ninguna grabacin
+     *  pendiente de cerrar
+     *  @return True si el buffer est disponible
+     */
+    bool recordAlloc();
+    
+    
+	/** recordCapture()
+     *  Captura un cambio de duty en el buffer circular de grabacin. Debe invocarse con el mutex tomado.
+     *  @param servo Canal
+     *  @param duty Duty en cuentas pwm
+     */
+    void recordCapture(uint8_t servo, uint16_t duty);
+    
+    
+	/** recordOpen()
+     *  Crea el fichero de grabacin escribiendo una cabecera provisional
+     */
+    void recordOpen();
+    
+    
+	/** recordFlush()
+     *  Decodifica los eventos del buffer circular y los escribe en el fichero como tramas
+     *  @param close Flag para finalizar la grabacin, escribiendo la ltima trama y la cabecera definitiva
+     */
+    void recordFlush(bool close);
+    
+    
+	/** recordEmit()
+     *  Escribe la trama en construccin y las tramas sin cambios hasta un tick dado
+     *  @param tick Tick de la siguiente trama a construir
+     */
+    void recordEmit(uint32_t tick);
+    
+    
+	/** recordPut()
+     *  Aade un byte al buffer de escritura en fichero, escribindolo cuando se llena
+     *  @param b Byte a escribir
+     */
+    void recordPut(uint8_t b);
+    
+    
+	/** calSave()
+     *  Guarda los datos de calibracin de un controlador en una ranura a continuacin de la vigente, si han cambiado
+     *  @param ctrl ndice del controlador, que utiliza la pgina _cal_page+ctrl de NVFlash
+     *  @param page Buffer auxiliar del tamao de una pgina
+     *  @param caldata Buffer auxiliar del tamao de una pgina
+     *  @return Resultado de la operacin
+     */
+    CalResult calSave(uint8_t ctrl, uint32_t* page, uint32_t* caldata);
+    
+    
+	/** calRestore()
+     *  Recupera los datos de calibracin de un controlador
+     *  @param ctrl ndice del controlador, que utiliza la pgina _cal_page+ctrl de NVFlash
+     *  @param page Buffer auxiliar del tamao de una pgina
+     *  @return Resultado de la operacin
+     */
+    CalResult calRestore(uint8_t ctrl, uint32_t* page);
+    
+    
+	/** calFindSlots()
+     *  Analiza la pgina de calibracin
+     *  @param page Contenido de la pgina
+     *  @param last Recibe la posicin (en palabras) de la ranura vlida con mayor nmero de secuencia (-1 si no hay)
+     *  @param free Recibe la posicin (en palabras) del espacio borrado tras la ltima ranura (-1 si no hay)
+     */
+    void calFindSlots(uint32_t* page, int32_t* last, int32_t* free);
+    
+    
+	/** calChecksum()
+     *  Calcula el checksum de una ranura
+     *  @param seq Nmero de secuencia
+     *  @param data Datos de calibracin
+     *  @param words Palabras de datos
+     *  @return Checksum
+     */
+    uint32_t calChecksum(uint32_t seq, uint32_t* data, uint32_t words);
+    
+    
+	/** calSlotWords()
+     *  Calcula el tamao que ocupa una ranura en la pgina, completado a la unidad de programacin de la flash
+     *  @param words Palabras de datos
+     *  @return Palabras de la ranura, cabecera incluida
+     */
+    static uint32_t calSlotWords(uint32_t words){
+        return (((CalHeaderWords + words) + (CalProgramWords - 1)) / CalProgramWords) * CalProgramWords;
+    }
+    
+    
+	/** swapMovement()
+     *  Conmuta al movimiento preparado, calculando el paso inicial de cada servo segn el modo de conmutacin
+     */
+    void swapMovement();
+    
+    
+	/** initController()
+     *  Activa el auto-incremento de registros del chip, necesario para las escrituras en rfaga, y configura las salidas
+     *  para que cambien al recibir el STOP de la transaccin
+     *  @param ctrl Controlador
+     *  @return True si se ha podido configurar
+     */
+    bool initController(Controller_t* ctrl);
+    
+    
+	/** applyDuty()
+     *  Registra el duty de un servo en la cach de forma inmediata y, si se solicita, lo escribe en el chip
+     *  @param servo ndice global del servo
+     *  @param duty Duty en cuentas pwm
+     *  @param update Flag para escribir de inmediato los canales pendientes
+     *  @return Success o I2CError si el canal queda pendiente de escribir
+     */
+    ErrorResult applyDuty(uint8_t servo, uint16_t duty, bool update);
+    
+    
+	/** setDuty()
+     *  Registra el duty de un canal en la cach, marcndolo como sucio si difiere del escrito en el chip
+     *  @param servo Canal
+     *  @param duty Duty en cuentas pwm
+     */
+    void setDuty(uint8_t servo, uint16_t duty);
+    
+    
+	/** flushDuty()
+     *  Escribe en rfaga los rangos contiguos de canales sucios, en una transaccin por bus con el bus reservado
+     *  (I2C::lock) durante toda la cadena de rfagas
+     *  @return Nmero de bytes transferidos en el bus
+     */
+    uint32_t flushDuty();
+    
+    
+	/** burstWrite()
+     *  Escribe una rfaga y marca sus canales como escritos. Si falla, cierra la transaccin con STOP
+     *  @param i2c Bus i2c
+     *  @param burst Rfaga a escribir
+     *  @param repeated Flag para no generar STOP al finalizar (la transaccin contina con otra rfaga)
+     *  @return Nmero de bytes transferidos en el bus
+     */
+    uint32_t burstWrite(I2C* i2c, Burst_t* burst, bool repeated);
     
 
 	/** subscriptionCb()
@@ -148,6 +1183,14 @@ class ServoManager : public PCA9685_ServoDrv{
      */    
      void subscriptionCb(const char* name, void* msg, uint16_t msg_len);    
     
+
+	/** publicationCb()
+     *  Callback invocada al finalizar una publicacin
+     *  @param topic Identificador del topic
+     *  @param result Resultado de la publicacin
+     */    
+     void publicationCb(const char* topic, int32_t result);
+    
 };
      
 #endif /*__ServoManager__H */
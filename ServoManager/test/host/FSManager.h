@@ -0,0 +1,103 @@
+/*
+ * FSManager.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Modelo en RAM de FSManager para el banco de pruebas bench_ServoManager, con la misma interfaz y semntica de
+ *  posiciones que el original. Los identificadores de recordset son ndices de fichero abierto (>0).
+ */
+
+#ifndef __FSManager__H
+#define __FSManager__H
+
+#include "mbed.h"
+#include "Heap.h"
+#include <string>
+#include <map>
+#include <vector>
+
+
+class FSManager{
+public:
+    FSManager(const char *name, PinName mosi, PinName miso, PinName sclk, PinName csel, int freq){}
+
+    bool ready(){ return true; }
+
+    int save(const char* data_id, void* data, uint32_t size){
+        std::vector<uint8_t>& f = _files[data_id];
+        f.assign((uint8_t*)data, (uint8_t*)data + size);
+        return size;
+    }
+
+    int restore(const char* data_id, void* data, uint32_t size){
+        if(_files.find(data_id) == _files.end()){
+            return 0;
+        }
+        std::vector<uint8_t>& f = _files[data_id];
+        uint32_t rd = (size < f.size())? size : f.size();
+        memcpy(data, &f[0], rd);
+        return rd;
+    }
+
+    int32_t openRecordSet(const char* data_id){
+        if(_files.find(data_id) == _files.end()){
+            return 0;
+        }
+        _open.push_back(data_id);
+        return _open.size();
+    }
+
+    int32_t closeRecordSet(int32_t recordset){
+        return 0;
+    }
+
+    int32_t writeRecordSet(int32_t recordset, void* data, uint32_t record_size, int32_t* pos){
+        if(!recordset || !data || !record_size){
+            return 0;
+        }
+        std::vector<uint8_t>& f = _files[_open[recordset - 1]];
+        int32_t vpos = (pos)? *pos : f.size();
+        if(f.size() < vpos + record_size){
+            f.resize(vpos + record_size);
+        }
+        memcpy(&f[vpos], data, record_size);
+        if(pos){
+            *pos = vpos + record_size;
+        }
+        return record_size;
+    }
+
+    int32_t readRecordSet(int32_t recordset, void* data, uint32_t record_size, int32_t* pos){
+        if(!recordset || !data || !record_size){
+            return 0;
+        }
+        std::vector<uint8_t>& f = _files[_open[recordset - 1]];
+        int32_t vpos = (pos)? *pos : 0;
+        int32_t rd = ((int32_t)f.size() > vpos)? (f.size() - vpos) : 0;
+        rd = (rd > (int32_t)record_size)? record_size : rd;
+        if(rd){
+            memcpy(data, &f[vpos], rd);
+        }
+        if(pos){
+            *pos = vpos + rd;
+        }
+        return rd;
+    }
+
+    int32_t getRecord(const char* data_id, void* data, uint32_t record_size, int32_t* pos){
+        int32_t rs = openRecordSet(data_id);
+        return (rs)? readRecordSet(rs, data, record_size, pos) : 0;
+    }
+
+    int32_t setRecord(const char* data_id, void* data, uint32_t record_size, int32_t* pos){
+        int32_t rs = openRecordSet(data_id);
+        return (rs)? writeRecordSet(rs, data, record_size, pos) : 0;
+    }
+
+private:
+    std::map<std::string, std::vector<uint8_t> > _files;
+    std::vector<std::string> _open;
+};
+
+#endif
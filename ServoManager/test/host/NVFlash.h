@@ -0,0 +1,81 @@
+/*
+ * NVFlash.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Modelo en RAM de NVFlash para el banco de pruebas bench_ServoManager. Respeta la semntica de la flash del
+ *  STM32L4: el borrado deja las palabras a 0xFFFFFFFF y se programa por dobles palabras alineadas, que deben estar
+ *  borradas (salvo para escribir ceros). Una escritura que no cumple estas condiciones se rechaza sin modificar la
+ *  pgina, como el error de programacin del chip, y se contabiliza.
+ */
+
+#ifndef __NVFlash__H
+#define __NVFlash__H
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <vector>
+
+
+class NVFlash{
+public:
+    enum ErrorResult{ Success = 0, Error = -1 };
+
+    static void init(){}
+    static uint32_t getPageSize(){ return 2048; }
+
+    static ErrorResult erasePage(uint32_t page){
+        std::vector<uint32_t>& p = pages()[page];
+        p.assign(getPageSize() / sizeof(uint32_t), 0xFFFFFFFF);
+        erase_count()[page]++;
+        return Success;
+    }
+    static ErrorResult readPage(uint32_t page, uint32_t* data){
+        memcpy(data, &get(page)[0], getPageSize());
+        return Success;
+    }
+    static ErrorResult writePage(uint32_t page, uint32_t* data){
+        return writeWords(page, 0, data, getPageSize() / sizeof(uint32_t));
+    }
+
+    /** Programa 'words' palabras a partir de la palabra 'offset' de la pgina (ambos mltiplos de la doble palabra) */
+    static ErrorResult writeWords(uint32_t page, uint32_t offset, uint32_t* data, uint32_t words){
+        std::vector<uint32_t>& p = get(page);
+        if((offset % 2) != 0 || (words % 2) != 0 || (offset + words) > p.size()){
+            prog_errors()++;
+            return Error;
+        }
+        for(uint32_t i = 0; i < words; i += 2){
+            bool erased = (p[offset + i] == 0xFFFFFFFF && p[offset + i + 1] == 0xFFFFFFFF);
+            bool zeros = (data[i] == 0 && data[i + 1] == 0);
+            if(!erased && !zeros){
+                prog_errors()++;
+                return Error;
+            }
+        }
+        for(uint32_t i = 0; i < words; i++){
+            p[offset + i] &= data[i];
+        }
+        return Success;
+    }
+
+    /** Nmero de borrados de una pgina, para comprobar el desgaste en el banco de pruebas */
+    static uint32_t erasures(uint32_t page){ return erase_count()[page]; }
+
+    /** Escrituras rechazadas por programar posiciones no borradas o sin alinear */
+    static uint32_t& prog_errors(){ static uint32_t n = 0; return n; }
+
+private:
+    static std::map<uint32_t, uint32_t>& erase_count(){ static std::map<uint32_t, uint32_t> c; return c; }
+    static std::map<uint32_t, std::vector<uint32_t> >& pages(){ static std::map<uint32_t, std::vector<uint32_t> > p; return p; }
+    static std::vector<uint32_t>& get(uint32_t page){
+        if(pages().find(page) == pages().end()){
+            pages()[page].assign(getPageSize() / sizeof(uint32_t), 0xFFFFFFFF);
+        }
+        return pages()[page];
+    }
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * PCA9685_ServoDrv.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Modelo del driver PCA9685_ServoDrv para el banco de pruebas bench_ServoManager. Mantiene el estado de cada servo
+ *  (ngulo, duty y rangos de calibracin) y, cuando se solicita una actualizacin inmediata, escribe los registros del
+ *  chip simulado (SimPCA9685.h) a travs del bus i2c simulado.
+ */
+
+#ifndef __PCA9685_ServoDrv__H
+#define __PCA9685_ServoDrv__H
+
+#include "mbed.h"
+#include "SimPCA9685.h"
+
+
+class PCA9685_ServoDrv{
+public:
+    static const uint8_t ServoCount = 16;
+    static const uint8_t DefaultAddress = 0;
+
+    enum ErrorResult{ Success = 0, InvalidServoError = -1, I2CError = -2 };
+    enum State{ Stopped, Ready };
+
+    PCA9685_ServoDrv(PinName sda, PinName scl, uint8_t num_servos, uint8_t addr = DefaultAddress) : _i2c(sda, scl){
+        _num = num_servos;
+        _addr = 0x80 | ((addr & 0x3f) << 1);
+        SimI2CBus::get(sda, scl)->attach(_addr);
+        _i2c.frequency(400000);
+        for(uint8_t i = 0; i < ServoCount; i++){
+            // 0.5ms..2.5ms a 50Hz
+            _ranges[i].min_ang = 0;
+            _ranges[i].max_ang = 180;
+            _ranges[i].min_duty = 102;
+            _ranges[i].max_duty = 512;
+            _duty[i] = 0;
+            _angle[i] = 0;
+        }
+    }
+
+    State getState(){ return Ready; }
+
+    ErrorResult setServoRanges(uint8_t servo, int16_t min_ang, int16_t max_ang, uint16_t min_duty, uint16_t max_duty){
+        if(servo >= _num || max_ang <= min_ang){
+            return InvalidServoError;
+        }
+        _ranges[servo].min_ang = min_ang;
+        _ranges[servo].max_ang = max_ang;
+        _ranges[servo].min_duty = min_duty;
+        _ranges[servo].max_duty = max_duty;
+        return Success;
+    }
+
+    void getServoRanges(uint8_t servo, int16_t* min_ang, int16_t* max_ang, uint16_t* min_duty, uint16_t* max_duty){
+        *min_ang = _ranges[servo].min_ang;
+        *max_ang = _ranges[servo].max_ang;
+        *min_duty = _ranges[servo].min_duty;
+        *max_duty = _ranges[servo].max_duty;
+    }
+
+    uint16_t getDutyFromAngle(uint8_t servo, uint8_t angle){
+        Range_t* r = &_ranges[servo];
+        int16_t a = (angle < r->min_ang)? r->min_ang : ((angle > r->max_ang)? r->max_ang : angle);
+        return r->min_duty + (((int32_t)(a - r->min_ang) * (r->max_duty - r->min_duty)) / (r->max_ang - r->min_ang));
+    }
+
+    uint8_t getAngleFromDuty(uint8_t servo, uint16_t duty){
+        Range_t* r = &_ranges[servo];
+        uint16_t d = (duty < r->min_duty)? r->min_duty : ((duty > r->max_duty)? r->max_duty : duty);
+        return r->min_ang + (((int32_t)(d - r->min_duty) * (r->max_ang - r->min_ang)) / (r->max_duty - r->min_duty));
+    }
+
+    ErrorResult setServoAngle(uint8_t servo, uint8_t angle, bool update = false){
+        if(servo >= _num){
+            return InvalidServoError;
+        }
+        _duty[servo] = getDutyFromAngle(servo, angle);
+        _angle[servo] = getAngleFromDuty(servo, _duty[servo]);
+        return (update)? writeChannel(servo) : Success;
+    }
+
+    ErrorResult setServoDuty(uint8_t servo, uint16_t duty, bool update = false){
+        if(servo >= _num){
+            return InvalidServoError;
+        }
+        _duty[servo] = duty;
+        _angle[servo] = getAngleFromDuty(servo, duty);
+        return (update)? writeChannel(servo) : Success;
+    }
+
+    uint8_t getServoAngle(uint8_t servo){ return _angle[servo]; }
+    uint16_t getServoDuty(uint8_t servo){ return _duty[servo]; }
+
+    ErrorResult readServoDuty(uint8_t servo, uint16_t* duty){
+        char reg = 0x08 + (4 * servo);
+        char data[2] = {0, 0};
+        if(servo >= _num || _i2c.write(_addr, &reg, 1, true) != 0 || _i2c.read(_addr, &data[0], 1, true) != 0){
+            return I2CError;
+        }
+        reg++;
+        if(_i2c.write(_addr, &reg, 1, true) != 0 || _i2c.read(_addr, &data[1], 1) != 0){
+            return I2CError;
+        }
+        *duty = (uint8_t)data[0] | (((uint8_t)data[1] & 0x0f) << 8);
+        return Success;
+    }
+
+    ErrorResult updateAll(){
+        for(uint8_t i = 0; i < _num; i++){
+            if(writeChannel(i) != Success){
+                return I2CError;
+            }
+        }
+        return Success;
+    }
+
+    /** Datos de calibracin: nmero de servos y dos palabras por servo (rangos de ngulo y de duty) */
+    int getNVData(uint32_t* data){
+        data[0] = NVMagic | _num;
+        for(uint8_t i = 0; i < _num; i++){
+            data[1 + (2 * i)] = ((uint32_t)(uint16_t)_ranges[i].min_ang << 16) | (uint16_t)_ranges[i].max_ang;
+            data[2 + (2 * i)] = ((uint32_t)_ranges[i].min_duty << 16) | _ranges[i].max_duty;
+        }
+        return 0;
+    }
+
+    int setNVData(uint32_t* data){
+        if((data[0] & 0xffffff00) != NVMagic || (data[0] & 0xff) != _num){
+            return -1;
+        }
+        for(uint8_t i = 0; i < _num; i++){
+            _ranges[i].min_ang = (int16_t)(data[1 + (2 * i)] >> 16);
+            _ranges[i].max_ang = (int16_t)(data[1 + (2 * i)] & 0xffff);
+            _ranges[i].min_duty = (uint16_t)(data[2 + (2 * i)] >> 16);
+            _ranges[i].max_duty = (uint16_t)(data[2 + (2 * i)] & 0xffff);
+        }
+        return 0;
+    }
+
+private:
+    static const uint32_t NVMagic = 0x53525600;
+
+    struct Range_t{
+        int16_t min_ang;
+        int16_t max_ang;
+        uint16_t min_duty;
+        uint16_t max_duty;
+    };
+
+    ErrorResult writeChannel(uint8_t servo){
+        char buf[5] = {(char)(0x06 + (4 * servo)), 0, 0, (char)(_duty[servo] & 0xff), (char)(_duty[servo] >> 8)};
+        char mode1 = 0;
+        char reg = 0x00;
+        // sin auto-incremento, el driver escribe registro a registro
+        if(_i2c.write(_addr, &reg, 1, true) != 0 || _i2c.read(_addr, &mode1, 1) != 0){
+            return I2CError;
+        }
+        if((mode1 & 0x20) != 0){
+            return (_i2c.write(_addr, buf, 5) == 0)? Success : I2CError;
+        }
+        for(uint8_t i = 1; i < 5; i++){
+            char cmd[2] = {(char)(buf[0] + i - 1), buf[i]};
+            if(_i2c.write(_addr, cmd, 2) != 0){
+                return I2CError;
+            }
+        }
+        return Success;
+    }
+
+    I2C _i2c;
+    uint8_t _num;
+    uint8_t _addr;
+    Range_t _ranges[ServoCount];
+    uint16_t _duty[ServoCount];
+    uint8_t _angle[ServoCount];
+};
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * SimPCA9685.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Modelo de bus i2c y de chip PCA9685 para el banco de pruebas bench_ServoManager.
+ *
+ *  SimI2CBus modela el tiempo de cada transaccin a partir de la frecuencia del bus: START (o START repetido) y STOP
+ *  cuentan 1 bit cada uno, y cada byte (direccin incluida) 9 bits (8 + ACK), por lo que a 400kHz un byte son 22.5us.
+ *  El tiempo simulado (SimClock) avanza lo que dura cada transaccin, y se acumulan las estadsticas de ocupacin.
+ *
+ *  SimPCA9685 modela el banco de registros del chip (MODE1.AI para el auto-incremento) y el momento en que cambian las
+ *  salidas: en el STOP si MODE2.OCH = 0 (valor por defecto) o al final de cada escritura si MODE2.OCH = 1. Cada cambio
+ *  de salida se registra en la lnea temporal del bus (SimOutput), que el banco de pruebas utiliza para medir
+ *  latencias y comprobar la correccin de las secuencias de duty.
+ */
+
+#ifndef __SimPCA9685__H
+#define __SimPCA9685__H
+
+#include "mbed.h"
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <mutex>
+
+
+/** Cambio en una salida de un chip */
+struct SimOutput{
+    uint64_t t;                 /// Instante (us) en que cambia la salida
+    int bus;                    /// Identificador del bus (pin sda)
+    uint8_t addr;               /// Direccin i2c (8 bits) del chip
+    uint8_t ch;                 /// Canal
+    uint16_t duty;              /// Nuevo duty (registro LEDn_OFF)
+};
+
+
+//------------------------------------------------------------------------------------
+class SimPCA9685{
+public:
+    static const uint8_t RegMode1 = 0x00;
+    static const uint8_t RegMode2 = 0x01;
+    static const uint8_t RegLed0 = 0x06;
+    static const uint8_t Mode1AI = (1<<5);
+    static const uint8_t Mode2OCH = (1<<3);
+    static const uint8_t Channels = 16;
+
+    SimPCA9685(){
+        memset(_regs, 0, sizeof(_regs));
+        memset(_out, 0, sizeof(_out));
+        // MODE1 tras la inicializacin del driver (oscilador activo, ALLCALL), MODE2 por defecto (OUTDRV, OCH=0)
+        _regs[RegMode1] = 0x01;
+        _regs[RegMode2] = 0x04;
+        _ptr = 0;
+    }
+
+    void setPointer(uint8_t reg){ _ptr = reg; }
+    void writeByte(uint8_t data){ _regs[_ptr] = data; advance(); }
+    uint8_t readByte(){ uint8_t data = _regs[_ptr]; advance(); return data; }
+    bool latchOnAck(){ return ((_regs[RegMode2] & Mode2OCH) != 0)? true : false; }
+    uint16_t output(uint8_t ch){ return _out[ch]; }
+
+    /** Actualiza las salidas con el contenido de los registros, registrando los cambios */
+    void latch(uint64_t t, int bus, uint8_t addr, std::vector<SimOutput>& timeline){
+        for(uint8_t ch = 0; ch < Channels; ch++){
+            uint8_t* r = &_regs[RegLed0 + (4 * ch)];
+            uint16_t off = r[2] | ((r[3] & 0x0f) << 8);
+            if(off != _out[ch]){
+                _out[ch] = off;
+                timeline.push_back({t, bus, addr, ch, off});
+            }
+        }
+    }
+
+private:
+    void advance(){
+        if((_regs[RegMode1] & Mode1AI) != 0){
+            _ptr = (_ptr == 0x45)? 0 : (_ptr + 1);
+        }
+    }
+    uint8_t _regs[256];
+    uint8_t _ptr;
+    uint16_t _out[Channels];
+};
+
+
+//------------------------------------------------------------------------------------
+class SimI2CBus{
+public:
+    /** Estadsticas de uso del bus */
+    struct Stats{
+        uint64_t transactions;      /// Transacciones finalizadas con STOP
+        uint64_t writes;            /// Llamadas a write/read
+        uint64_t bytes;             /// Bytes transferidos (incluida la direccin)
+        uint64_t busy_ns;           /// Tiempo de ocupacin
+        uint64_t nacks;             /// Direcciones sin respuesta
+    };
+
+    /** Obtiene el bus asociado a unos pines, crendolo si no existe */
+    static SimI2CBus* get(int sda, int scl){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        std::map<int, SimI2CBus*>& b = buses();
+        if(b.find(sda) == b.end()){
+            b[sda] = new SimI2CBus(sda);
+        }
+        return b[sda];
+    }
+
+    /** Lnea temporal de cambios de salida de todos los buses */
+    static std::vector<SimOutput>& timeline(){ static std::vector<SimOutput> t; return t; }
+    static std::recursive_mutex& mutex(){ static std::recursive_mutex m; return m; }
+    static std::map<int, SimI2CBus*>& buses(){ static std::map<int, SimI2CBus*> b; return b; }
+
+    /** Conecta un chip en la direccin (8 bits) indicada */
+    void attach(uint8_t addr){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        if(_chips.find(addr) == _chips.end()){
+            _chips[addr] = new SimPCA9685();
+        }
+    }
+    SimPCA9685* chip(uint8_t addr){
+        std::map<uint8_t, SimPCA9685*>::iterator it = _chips.find(addr & 0xfe);
+        return (it == _chips.end())? 0 : it->second;
+    }
+    int id(){ return _id; }
+    Stats& stats(){ return _stats; }
+    void resetStats(){ memset(&_stats, 0, sizeof(Stats)); }
+
+    int write(int address, const char* data, int length, bool repeated, int hz){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        SimPCA9685* c = chip(address);
+        // START (o repetido) + direccin
+        uint32_t bits = 1 + 9;
+        if(c){
+            if(length > 0){
+                c->setPointer(data[0]);
+            }
+            for(int i = 1; i < length; i++){
+                c->writeByte(data[i]);
+            }
+            bits += 9 * length;
+            if(c->latchOnAck()){
+                _touched.push_back(address & 0xfe);
+            }
+            else{
+                _pending.push_back(address & 0xfe);
+            }
+        }
+        return finish(c, bits, length, repeated, hz);
+    }
+
+    int read(int address, char* data, int length, bool repeated, int hz){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        SimPCA9685* c = chip(address);
+        uint32_t bits = 1 + 9;
+        if(c){
+            for(int i = 0; i < length; i++){
+                data[i] = c->readByte();
+            }
+            bits += 9 * length;
+        }
+        return finish(c, bits, length, repeated, hz);
+    }
+
+private:
+    SimI2CBus(int id) : _id(id), _frac_ns(0){ memset(&_stats, 0, sizeof(Stats)); }
+
+    int finish(SimPCA9685* c, uint32_t bits, int length, bool repeated, int hz){
+        // sin respuesta a la direccin, el maestro genera STOP
+        if(!c){
+            repeated = false;
+            _stats.nacks++;
+        }
+        if(!repeated){
+            bits += 1;
+            _stats.transactions++;
+        }
+        _stats.writes++;
+        _stats.bytes += 1 + ((c)? length : 0);
+        uint64_t ns = ((uint64_t)bits * 1000000000ULL) / hz;
+        _stats.busy_ns += ns;
+        _frac_ns += ns;
+        SimClock::advance(_frac_ns / 1000);
+        _frac_ns %= 1000;
+        uint64_t now = SimClock::now();
+        // salidas con OCH=1: cambian en el ACK de cada escritura
+        for(size_t i = 0; i < _touched.size(); i++){
+            _chips[_touched[i]]->latch(now, _id, _touched[i], timeline());
+        }
+        _touched.clear();
+        // salidas con OCH=0: cambian en el STOP, todas las del bus a la vez
+        if(!repeated){
+            for(size_t i = 0; i < _pending.size(); i++){
+                _chips[_pending[i]]->latch(now, _id, _pending[i], timeline());
+            }
+            _pending.clear();
+        }
+        return (c)? 0 : 1;
+    }
+
+    int _id;
+    uint64_t _frac_ns;
+    Stats _stats;
+    std::map<uint8_t, SimPCA9685*> _chips;
+    std::vector<uint8_t> _touched;
+    std::vector<uint8_t> _pending;
+};
+
+
+//------------------------------------------------------------------------------------
+//--- I2C ----------------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+inline I2C::I2C(PinName sda, PinName scl) : _bus(SimI2CBus::get(sda, scl)), _hz(100000){}
+inline int I2C::write(int address, const char* data, int length, bool repeated){
+    return _bus->write(address, data, length, repeated, _hz);
+}
+inline int I2C::read(int address, char* data, int length, bool repeated){
+    return _bus->read(address, data, length, repeated, _hz);
+}
+
+#endif
@@ -0,0 +1,688 @@
+/*
+ * bench_ServoManager.cpp (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Banco de pruebas de ServoManager en PC (Linux), sin hardware. Utiliza los sustitutos comunes de test/host (tiempo
+ *  simulado, ticker disparados desde el hilo principal) y los de este directorio: bus i2c con modelo de tiempos y
+ *  chips PCA9685 simulados que registran la lnea temporal de cambios en sus salidas.
+ *
+ *  Compilacin (desde la raz del repositorio):
+ *      g++ -std=gnu++11 -O2 -pthread -IServoManager/test/host -Itest/host -IServoManager \
+ *          ServoManager/test/host/bench_ServoManager.cpp ServoManager/ServoManager.cpp -o bench_ServoManager
+ *
+ *  Uso:
+ *      bench_ServoManager [escenario] [-t fichero.csv]
+ *
+ *  Sin escenario se ejecutan todos, cada uno en un proceso independiente. Con -t se vuelca la lnea temporal de
+ *  salidas (t_us,servo,duty) del escenario indicado. Escenarios:
+ *      move16      Movimiento senoidal en 16 servos de un controlador
+ *      move48      Movimiento senoidal en 48 servos: 2 controladores en un bus y 1 en otro
+ *      slider      Comandos /duty a 200Hz en 4 servos, escritura inmediata
+ *      coalesce    Igual que slider, con agrupacin de comandos cada 10ms
+ *      slew        Salto de duty con lmites de velocidad y aceleracin
+ *      record      Grabacin de comandos y reproduccin del fichero resultante
+ *      idle        Movimiento repetitivo con tramos constantes (suspensin del ticker) y comando durante la suspensin
+ *      direct      Escrituras con los setters heredados del driver y updateAll(), coherencia con la cach de duty
+ *      cal         Guardado repetido de la calibracin en NVFlash: escrituras descartadas sin cambios y borrados de pgina
+ *      publish     Solicitudes /info, /read, /snapshot y /stats: cada una se publica una vez y siempre desde la tarea
+ *
+ *  Para cada escenario se informa del tiempo de cpu de la tarea por activacin (en el PC, til para comparar
+ *  versiones), la ocupacin de cada bus y, segn el caso, la latencia de los comandos (desde la publicacin hasta el
+ *  cambio en la salida del chip, en tiempo simulado) y las comprobaciones de correccin. El proceso devuelve 1 si
+ *  alguna comprobacin falla.
+ */
+
+#include "mbed.h"
+#include "MQLib.h"
+#include "ServoManager.h"
+#include "NVFlash.h"
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+
+
+// **************************************************************************
+// *********** DEFINICIONES *************************************************
+// **************************************************************************
+
+/** Controlador registrado en el banco de pruebas, para traducir la lnea temporal a ndices globales */
+struct BenchCtrl{
+    int bus;
+    uint8_t addr;
+    uint8_t first;
+};
+
+/** Comando /duty publicado */
+struct BenchCmd{
+    uint64_t t;
+    uint8_t servo;
+    uint16_t duty;
+};
+
+
+// **************************************************************************
+// *********** OBJETOS  *****************************************************
+// **************************************************************************
+
+static ServoManager* servoman;
+static std::vector<BenchCtrl> ctrls;
+static std::vector<uint64_t> cmd_cpu_ns;
+static const char* timeline_file = 0;
+static int failures = 0;
+
+
+// **************************************************************************
+// *********** UTILIDADES ***************************************************
+// **************************************************************************
+
+//------------------------------------------------------------------------------------
+static uint64_t now(){
+    return SimClock::now();
+}
+
+
+//------------------------------------------------------------------------------------
+static void check(bool cond, const char* format, ...){
+    if(cond){
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    printf("    FALLO: ");
+    vprintf(format, args);
+    printf("\r\n");
+    va_end(args);
+    failures++;
+}
+
+
+//------------------------------------------------------------------------------------
+static uint64_t percentile(std::vector<uint64_t> v, double p){
+    if(v.empty()){
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))];
+}
+
+
+//------------------------------------------------------------------------------------
+static int servoOf(const SimOutput& o){
+    for(size_t i = 0; i < ctrls.size(); i++){
+        if(ctrls[i].bus == o.bus && ctrls[i].addr == o.addr){
+            return ctrls[i].first + o.ch;
+        }
+    }
+    return -1;
+}
+
+
+//------------------------------------------------------------------------------------
+/** Publica un comando en ${sub_topic}/name, midiendo la cpu consumida por el manejador */
+static void publish(const char* name, const char* format, ...){
+    char topic[64];
+    char msg[128];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(msg, sizeof(msg), format, args);
+    va_end(args);
+    snprintf(topic, sizeof(topic), "servo/%s", name);
+    uint64_t cpu = host_thread_cpu_ns();
+    MQ::MQClient::publish(topic, msg, strlen(msg) + 1, 0);
+    cmd_cpu_ns.push_back(host_thread_cpu_ns() - cpu);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Avanza el tiempo simulado hasta t, disparando los ticker vencidos y esperando a que la tarea los atienda */
+static void runUntil(uint64_t t, void (*on_tick)() = 0){
+    for(;;){
+        Thread::settleAll();
+        uint64_t due = Ticker::nextDue();
+        if(due > t){
+            break;
+        }
+        if(now() < due){
+            SimClock::now() = due;
+        }
+        Ticker::fire(now());
+        Thread::settleAll();
+        if(on_tick){
+            on_tick();
+        }
+    }
+    if(now() < t){
+        SimClock::now() = t;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+static void createManager(uint8_t num_servos){
+    servoman = new ServoManager(PB_7, PB_6, num_servos);
+    servoman->setSubscriptionBase("servo");
+    servoman->setPublicationBase("stat/servo");
+    ctrls.push_back({PB_7, 0x80, 0});
+    runUntil(now() + 1000);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Informe comn: cpu por activacin de la tarea, ocupacin de los buses y estadsticas de ServoManager */
+static void report(uint64_t t0){
+    std::vector<Thread::Wake> wakes = Thread::takeAllWakes();
+    std::vector<uint64_t> cpu;
+    for(size_t i = 0; i < wakes.size(); i++){
+        if(wakes[i].at_us >= t0){
+            cpu.push_back(wakes[i].cpu_ns);
+        }
+    }
+    uint64_t elapsed = now() - t0;
+    printf("    tarea: %u activaciones, cpu/activacin p50=%.1fus p99=%.1fus max=%.1fus (host)\r\n",
+            (unsigned)cpu.size(), percentile(cpu, 0.5) / 1000.0, percentile(cpu, 0.99) / 1000.0, percentile(cpu, 1.0) / 1000.0);
+    for(std::map<int, SimI2CBus*>::iterator it = SimI2CBus::buses().begin(); it != SimI2CBus::buses().end(); it++){
+        SimI2CBus::Stats& s = it->second->stats();
+        printf("    bus %d: %llu transacciones, %llu bytes, ocupacin %.2f%%, nacks %llu\r\n", it->first,
+                (unsigned long long)s.transactions, (unsigned long long)s.bytes, (100.0 * s.busy_ns) / (elapsed * 1000.0),
+                (unsigned long long)s.nacks);
+    }
+    ServoManager::BusStats bs;
+    servoman->getBusStats(&bs);
+    ServoManager::TickStats ts;
+    servoman->getTickStats(&ts);
+    printf("    ServoManager: updates=%u total_bytes=%u errors=%u coalesced=%u ticks=%u missed=%u\r\n",
+            bs.updates, bs.total_bytes, bs.errors, bs.coalesced, ts.ticks, ts.missed);
+}
+
+
+//------------------------------------------------------------------------------------
+static void resetMeasures(){
+    Thread::takeAllWakes();
+    cmd_cpu_ns.clear();
+    for(std::map<int, SimI2CBus*>::iterator it = SimI2CBus::buses().begin(); it != SimI2CBus::buses().end(); it++){
+        it->second->resetStats();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+/** Latencia de cada comando hasta que su duty aparece en la salida, antes del siguiente comando al mismo servo */
+static void reportLatency(const std::vector<BenchCmd>& cmds){
+    std::vector<SimOutput>& tl = SimI2CBus::timeline();
+    std::vector<uint64_t> lat;
+    uint32_t superseded = 0;
+    for(size_t c = 0; c < cmds.size(); c++){
+        uint64_t limit = UINT64_MAX;
+        for(size_t n = c + 1; n < cmds.size(); n++){
+            if(cmds[n].servo == cmds[c].servo){
+                limit = cmds[n].t;
+                break;
+            }
+        }
+        bool found = false;
+        for(size_t i = 0; i < tl.size() && tl[i].t <= limit; i++){
+            if(tl[i].t >= cmds[c].t && servoOf(tl[i]) == cmds[c].servo && tl[i].duty == cmds[c].duty){
+                lat.push_back(tl[i].t - cmds[c].t);
+                found = true;
+                break;
+            }
+        }
+        superseded += (found)? 0 : 1;
+    }
+    printf("    comandos: %u, aplicados %u, sustituidos %u\r\n", (unsigned)cmds.size(), (unsigned)lat.size(), superseded);
+    printf("    latencia p50=%lluus p90=%lluus p99=%lluus max=%lluus (simulado)\r\n", (unsigned long long)percentile(lat, 0.5),
+            (unsigned long long)percentile(lat, 0.9), (unsigned long long)percentile(lat, 0.99), (unsigned long long)percentile(lat, 1.0));
+    printf("    cpu/comando p50=%.1fus p99=%.1fus (host)\r\n", percentile(cmd_cpu_ns, 0.5) / 1000.0, percentile(cmd_cpu_ns, 0.99) / 1000.0);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Tras cada tick, la salida de cada chip debe coincidir con el duty que mantiene su driver */
+static uint32_t coherency_errors = 0;
+static void checkCoherency(){
+    for(size_t c = 0; c < ctrls.size(); c++){
+        SimPCA9685* chip = SimI2CBus::buses()[ctrls[c].bus]->chip(ctrls[c].addr);
+        for(uint8_t ch = 0; ch < PCA9685_ServoDrv::ServoCount; ch++){
+            uint8_t local;
+            PCA9685_ServoDrv* drv = servoman->getServoDriver(ctrls[c].first + ch, &local);
+            if(drv && drv->getServoDuty(local) != chip->output(ch)){
+                coherency_errors++;
+            }
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+static void dumpTimeline(){
+    if(!timeline_file){
+        return;
+    }
+    FILE* fd = fopen(timeline_file, "w");
+    if(!fd){
+        return;
+    }
+    fprintf(fd, "t_us,servo,duty\n");
+    std::vector<SimOutput>& tl = SimI2CBus::timeline();
+    for(size_t i = 0; i < tl.size(); i++){
+        fprintf(fd, "%llu,%d,%u\n", (unsigned long long)tl[i].t, servoOf(tl[i]), tl[i].duty);
+    }
+    fclose(fd);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Secuencia de duty de un servo en la lnea temporal, en el intervalo [from, to) */
+static std::vector<SimOutput> sequenceOf(int servo, uint64_t from, uint64_t to){
+    std::vector<SimOutput> seq;
+    std::vector<SimOutput>& tl = SimI2CBus::timeline();
+    for(size_t i = 0; i < tl.size(); i++){
+        if(tl[i].t >= from && tl[i].t < to && servoOf(tl[i]) == servo){
+            seq.push_back(tl[i]);
+        }
+    }
+    return seq;
+}
+
+
+// **************************************************************************
+// *********** ESCENARIOS ***************************************************
+// **************************************************************************
+
+
+//------------------------------------------------------------------------------------
+static void scenarioMove(uint8_t controllers){
+    createManager(16);
+    if(controllers > 1){
+        ctrls.push_back({PB_7, 0x82, (uint8_t)servoman->addController(PB_7, PB_6, 1, 16)});
+    }
+    if(controllers > 2){
+        ctrls.push_back({PB_9, 0x80, (uint8_t)servoman->addController(PB_9, PB_8, 0, 16)});
+    }
+    resetMeasures();
+    uint64_t t0 = now();
+    publish("move/start", "20000,40,0,2,0,180");
+    runUntil(t0 + 2000000, checkCoherency);
+    publish("move/stop", "0");
+    runUntil(now() + 100000);
+    report(t0);
+    printf("    coherencia chip/driver: %u discrepancias\r\n", coherency_errors);
+    check(coherency_errors == 0, "la salida de los chips no coincide con el estado de los drivers");
+
+    // todas las salidas de un mismo bus deben cambiar a la vez en cada tick
+    std::vector<SimOutput>& tl = SimI2CBus::timeline();
+    uint32_t split = 0;
+    for(size_t i = 1; i < tl.size(); i++){
+        if(tl[i].bus == tl[i-1].bus && tl[i].t != tl[i-1].t && (tl[i].t - tl[i-1].t) < 1000){
+            split++;
+        }
+    }
+    printf("    actualizaciones de un bus no simultneas: %u\r\n", split);
+    check(split == 0, "salidas de un mismo bus actualizadas en instantes distintos");
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioSlider(uint16_t coalesce_ms){
+    createManager(16);
+    if(coalesce_ms){
+        publish("coalesce", "%d", coalesce_ms);
+    }
+    srand(1);
+    uint16_t duty[4] = {300, 300, 300, 300};
+    std::vector<BenchCmd> cmds;
+    resetMeasures();
+    uint64_t t0 = now();
+    // cada servo recibe un comando cada 5ms, desfasados 1.25ms entre servos
+    for(uint32_t k = 0; k < 800; k++){
+        uint8_t servo = k % 4;
+        runUntil(t0 + (k * 1250));
+        int16_t d = (int16_t)duty[servo] + ((rand() % 21) - 10);
+        d = (d == duty[servo])? (d + 1) : d;
+        duty[servo] = (d < 102)? 102 : ((d > 512)? 512 : d);
+        cmds.push_back({now(), servo, duty[servo]});
+        publish("duty", "%d,%d", servo, duty[servo]);
+    }
+    runUntil(now() + 50000);
+    report(t0);
+    reportLatency(cmds);
+    // el ltimo comando de cada servo debe haberse aplicado
+    for(uint8_t s = 0; s < 4; s++){
+        SimPCA9685* chip = SimI2CBus::buses()[PB_7]->chip(0x80);
+        check(chip->output(s) == duty[s], "servo %d: salida %d, esperado %d", s, chip->output(s), duty[s]);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioSlew(){
+    createManager(16);
+    publish("slew", "0,2000,8000");
+    publish("duty", "0,102");
+    runUntil(now() + 10000);
+    resetMeasures();
+    uint64_t t0 = now();
+    publish("duty", "0,512");
+    // a mitad de la aproximacin se informa de la salida actual, no del destino
+    runUntil(t0 + 50000);
+    ServoManager::ServoInfo info;
+    SimPCA9685* chip = SimI2CBus::buses()[ctrls[0].bus]->chip(ctrls[0].addr);
+    check(servoman->getServoInfo(0, &info) && info.duty == chip->output(0) && info.duty < 512,
+            "info durante la aproximacin: duty %d, salida %d", info.duty, chip->output(0));
+    runUntil(t0 + 1000000);
+    report(t0);
+    std::vector<SimOutput> seq = sequenceOf(0, t0, now());
+    int max_step = 0;
+    bool monotonic = true;
+    uint16_t prev = 102;
+    for(size_t i = 0; i < seq.size(); i++){
+        max_step = std::max(max_step, (int)seq[i].duty - (int)prev);
+        monotonic = monotonic && (seq[i].duty >= prev);
+        prev = seq[i].duty;
+    }
+    uint64_t t_end = (seq.empty())? t0 : seq.back().t;
+    printf("    102->512: %u escrituras, %.1fms, paso mximo %d (lmite %d/tick)\r\n", (unsigned)seq.size(), (t_end - t0) / 1000.0,
+            max_step, (2000 * 5) / 1000);
+    check(!seq.empty() && seq.back().duty == 512, "el servo no alcanza el destino");
+    check(monotonic, "la aproximacin no es montona");
+    check(max_step <= ((2000 * 5) / 1000) + 1, "se supera la velocidad mxima");
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioDirect(){
+    createManager(16);
+    resetMeasures();
+    uint64_t t0 = now();
+    // setters heredados: se registran en la cach y updateAll() los escribe en una nica actualizacin
+    for(uint8_t i = 0; i < 16; i++){
+        check(servoman->setServoDuty(i, 200 + i) == PCA9685_ServoDrv::Success, "setServoDuty(%d)", i);
+    }
+    check(servoman->updateAll() == PCA9685_ServoDrv::Success, "updateAll");
+    checkCoherency();
+    // escritura inmediata de un servo
+    check(servoman->setServoDuty(3, 400, true) == PCA9685_ServoDrv::Success, "setServoDuty(3, update)");
+    checkCoherency();
+    // escritura directa en el driver: updateAll() la incorpora a la cach
+    uint8_t local = 0;
+    PCA9685_ServoDrv* drv = servoman->getServoDriver(5, &local);
+    drv->setServoDuty(local, 300);
+    check(servoman->updateAll() == PCA9685_ServoDrv::Success, "updateAll tras escritura directa");
+    checkCoherency();
+    // y las siguientes escrituras por la cach no quedan descartadas por un duty escrito obsoleto
+    check(servoman->setServoDuty(5, 200 + 5, true) == PCA9685_ServoDrv::Success, "setServoDuty(5, update)");
+    checkCoherency();
+    runUntil(now() + 10000);
+    // orden por ngulo con aproximacin: updateAll() antes del primer paso no la toma por una escritura directa
+    SimPCA9685* chip = SimI2CBus::buses()[ctrls[0].bus]->chip(ctrls[0].addr);
+    publish("slew", "8,2000,8000");
+    publish("servo", "8,0");
+    runUntil(now() + 1000000);
+    uint16_t start = chip->output(8);
+    publish("servo", "8,180");
+    check(servoman->updateAll() == PCA9685_ServoDrv::Success, "updateAll durante la aproximacin");
+    check(chip->output(8) == start, "updateAll salta al destino de la aproximacin (%d)", chip->output(8));
+    runUntil(now() + 1000000);
+    check(chip->output(8) == 512, "la aproximacin no alcanza el destino (%d)", chip->output(8));
+    report(t0);
+    check(chip->output(3) == 400 && chip->output(5) == 205, "salidas finales %d,%d", chip->output(3), chip->output(5));
+    check(coherency_errors == 0, "%u canales del chip difieren de su driver", (unsigned)coherency_errors);
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioCal(){
+    static const uint32_t Saves = 100;
+    createManager(16);
+    NVFlash::init();
+    uint8_t local = 0;
+    PCA9685_ServoDrv* drv = servoman->getServoDriver(0, &local);
+    uint32_t result[ServoManager::CalError + 1] = {0};
+    uint32_t unchanged_err = 0;
+    for(uint32_t i = 0; i < Saves; i++){
+        drv->setServoRanges(local, 0, 120 + (i % 60), 180, 480);
+        result[servoman->saveCalibration()]++;
+        // sin cambios no se escribe nada
+        uint32_t erasures = NVFlash::erasures(0);
+        if(servoman->saveCalibration() != ServoManager::CalUnchanged || NVFlash::erasures(0) != erasures){
+            unchanged_err++;
+        }
+    }
+    // la ltima versin guardada es la que se recupera
+    drv->setServoRanges(local, 0, 90, 100, 200);
+    ServoManager::CalResult restored = servoman->restoreCalibration();
+    uint32_t nvdata[1 + (2 * PCA9685_ServoDrv::ServoCount)];
+    drv->getNVData(nvdata);
+    // ranura: cabecera de 4 palabras y datos de 16 servos, completada a dobles palabras
+    uint32_t slots = (NVFlash::getPageSize() / sizeof(uint32_t)) / (((4 + 1 + (2 * 16)) + 1) & ~1);
+    printf("    %u guardados: %u en ranura libre, %u con borrado (%u borrados de pgina, %u ranuras/pgina)\r\n", Saves,
+            result[ServoManager::CalSaved], result[ServoManager::CalSavedErased], NVFlash::erasures(0), slots);
+    check(unchanged_err == 0, "%u guardados sin cambios escriben en NVFlash", unchanged_err);
+    check(result[ServoManager::CalError] == 0 && NVFlash::prog_errors() == 0, "errores de NVFlash (%u escrituras sobre "
+            "posiciones no borradas)", NVFlash::prog_errors());
+    check(NVFlash::erasures(0) <= (Saves / slots) + 1, "demasiados borrados de pgina");
+    check(restored == ServoManager::CalRestored && (nvdata[1] & 0xffff) == (120 + ((Saves - 1) % 60)),
+            "no se recupera la ltima ranura");
+}
+
+
+//------------------------------------------------------------------------------------
+/** Publicaciones de ServoManager recibidas: topic y si se han realizado fuera del hilo principal */
+static std::vector<std::pair<std::string, bool> > publications;
+static pthread_t main_thread;
+static void onPublication(const char* topic, void* msg, uint16_t msg_len){
+    publications.push_back(std::make_pair(std::string(topic), (pthread_equal(pthread_self(), main_thread) == 0)));
+}
+
+static void scenarioPublish(){
+    static MQ::SubscribeCallback subscr(&onPublication);
+    main_thread = pthread_self();
+    createManager(16);
+    MQ::MQClient::subscribe("stat/servo/#", &subscr);
+    publish("duty", "0,300");
+    runUntil(now() + 10000);
+    publications.clear();
+    publish("info", "0");
+    publish("read", "1");
+    publish("info", "2");
+    publish("snapshot", "0");
+    publish("stats", "0");
+    runUntil(now() + 10000);
+    const char* expected[] = {"stat/servo/info", "stat/servo/read", "stat/servo/info", "stat/servo/snapshot", "stat/servo/stats"};
+    uint32_t from_task = 0;
+    for(size_t i = 0; i < publications.size(); i++){
+        from_task += (publications[i].second)? 1 : 0;
+    }
+    printf("    %u publicaciones, %u desde la tarea\r\n", (unsigned)publications.size(), from_task);
+    check(publications.size() == (sizeof(expected) / sizeof(expected[0])), "publicaciones inesperadas");
+    check(from_task == publications.size(), "publicaciones fuera de la tarea");
+    for(size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++){
+        bool found = false;
+        for(size_t j = 0; j < publications.size() && !found; j++){
+            found = (publications[j].first == expected[i])? true : false;
+        }
+        check(found, "falta %s", expected[i]);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioRecord(){
+    static FSManager fs("fs", PA_0, PA_1, PB_10, PB_11, 1000000);
+    createManager(16);
+    servoman->setFileSystem(&fs);
+    for(uint8_t s = 0; s < 3; s++){
+        publish("duty", "%d,300", s);
+    }
+    runUntil(now() + 10000);
+    resetMeasures();
+
+    // graba comandos espaciados al menos dos pasos de grabacin por servo
+    uint64_t t_rec = now();
+    publish("record/start", "m1,20000");
+    srand(2);
+    for(uint32_t k = 0; k < 30; k++){
+        runUntil(t_rec + 30000 + (k * 40000));
+        publish("duty", "%d,%d", k % 3, 102 + (rand() % 410));
+    }
+    runUntil(now() + 40000);
+    uint64_t t_stop = now();
+    publish("record/stop", "0");
+    runUntil(now() + 100000);
+
+    // lleva los servos a otra posicin y reproduce
+    for(uint8_t s = 0; s < 3; s++){
+        publish("duty", "%d,200", s);
+    }
+    runUntil(now() + 10000);
+    uint64_t t_play = now();
+    publish("play", "m1");
+    runUntil(t_play + (t_stop - t_rec) + 200000);
+    report(t_rec);
+
+    // la reproduccin debe restaurar el estado inicial y repetir la secuencia grabada con el mismo ritmo
+    for(uint8_t s = 0; s < 3; s++){
+        std::vector<SimOutput> rec = sequenceOf(s, t_rec, t_stop);
+        std::vector<SimOutput> play = sequenceOf(s, t_play, now());
+        bool equal = (play.size() == rec.size() + 1 && !play.empty() && play[0].duty == 300)? true : false;
+        int64_t max_err = 0;
+        for(size_t i = 0; equal && i < rec.size(); i++){
+            equal = (rec[i].duty == play[i + 1].duty)? true : false;
+            int64_t err = ((int64_t)(play[i + 1].t - t_play)) - ((int64_t)(rec[i].t - t_rec));
+            max_err = std::max(max_err, (err < 0)? -err : err);
+        }
+        printf("    servo %d: grabados %u cambios, reproducidos %u, error temporal mximo %lldus\r\n", s,
+                (unsigned)rec.size(), (unsigned)play.size(), (long long)max_err);
+        check(equal, "servo %d: la secuencia reproducida no coincide con la grabada", s);
+        check(max_err <= 20000, "servo %d: error temporal superior a un paso", s);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioIdle(){
+    static const uint8_t Steps = 20;
+    static const uint32_t StepUs = 10000;
+    static const uint32_t Cycles = 10;
+    createManager(16);
+    // subida en 5 pasos, 10 pasos constantes y bajada en 5 pasos
+    uint16_t duty[Steps];
+    for(uint8_t i = 0; i < Steps; i++){
+        duty[i] = (i < 5)? (200 + (40 * i)) : ((i < 15)? 400 : (400 - (40 * (i - 14))));
+    }
+    resetMeasures();
+    uint64_t t0 = now();
+    servoman->startMovement(duty, Steps, StepUs, 0, 0);
+    runUntil(t0 + (Cycles * Steps * StepUs), checkCoherency);
+    uint64_t t1 = now();
+
+    // comando en mitad de un tramo constante: el movimiento lo sobrescribe en el siguiente paso
+    runUntil(t1 + (8 * StepUs) + (StepUs / 2));
+    uint64_t t_cmd = now();
+    publish("duty", "0,150");
+    runUntil(t_cmd + (4 * StepUs));
+    publish("move/stop", "0");
+    runUntil(now() + 100000);
+    report(t0);
+    ServoManager::TickStats ts;
+    servoman->getTickStats(&ts);
+    printf("    pasos suspendidos: %u de %u\r\n", ts.suspended, Cycles * Steps);
+    printf("    coherencia chip/driver: %u discrepancias\r\n", coherency_errors);
+    check(coherency_errors == 0, "la salida de los chips no coincide con el estado de los drivers");
+    check(ts.suspended >= (Cycles * 8), "el ticker no se suspende en los tramos constantes");
+
+    // cada cambio debe producirse en el instante de su paso, como si el ticker no se hubiera detenido
+    std::vector<SimOutput> seq = sequenceOf(0, t0, t1);
+    std::vector<uint64_t> exp_t;
+    std::vector<uint16_t> exp_duty;
+    uint16_t prev = 0;
+    for(uint32_t k = 0; k < (Cycles * Steps) - 1; k++){
+        if(duty[k % Steps] != prev){
+            prev = duty[k % Steps];
+            exp_t.push_back(t0 + ((k + 1) * StepUs));
+            exp_duty.push_back(prev);
+        }
+    }
+    bool equal = (seq.size() == exp_duty.size())? true : false;
+    uint64_t max_err = 0;
+    for(size_t i = 0; equal && i < seq.size(); i++){
+        equal = (seq[i].duty == exp_duty[i] && seq[i].t >= exp_t[i])? true : false;
+        max_err = std::max(max_err, seq[i].t - exp_t[i]);
+    }
+    printf("    servo 0: %u cambios, esperados %u, retardo mximo %lluus\r\n", (unsigned)seq.size(),
+            (unsigned)exp_duty.size(), (unsigned long long)max_err);
+    check(equal, "la secuencia con el ticker suspendido no coincide con la del movimiento");
+    check(max_err < 2000, "cambios fuera del instante de su paso");
+
+    // el comando se aplica y el movimiento lo sobrescribe en el siguiente lmite de paso
+    std::vector<SimOutput> ovr = sequenceOf(0, t_cmd, t_cmd + (4 * StepUs));
+    bool restored = (ovr.size() >= 2 && ovr[0].duty == 150 && ovr[1].duty == 400 && (ovr[1].t - t_cmd) <= (StepUs + 2000))? true : false;
+    check(restored, "el comando durante la suspensin no se sobrescribe en el siguiente paso");
+}
+
+
+// **************************************************************************
+// *********** MAIN *********************************************************
+// **************************************************************************
+
+//------------------------------------------------------------------------------------
+static const char* scenarios[] = {"move16", "move48", "slider", "coalesce", "slew", "record", "idle", "direct", "cal", "publish"};
+
+
+//------------------------------------------------------------------------------------
+static int runScenario(std::string name){
+    printf("\r\n[%s]\r\n", name.c_str());
+    if(name == "move16")        { scenarioMove(1); }
+    else if(name == "move48")   { scenarioMove(3); }
+    else if(name == "slider")   { scenarioSlider(0); }
+    else if(name == "coalesce") { scenarioSlider(10); }
+    else if(name == "slew")     { scenarioSlew(); }
+    else if(name == "record")   { scenarioRecord(); }
+    else if(name == "idle")     { scenarioIdle(); }
+    else if(name == "direct")   { scenarioDirect(); }
+    else if(name == "cal")      { scenarioCal(); }
+    else if(name == "publish")  { scenarioPublish(); }
+    else{
+        printf("    escenario desconocido\r\n");
+        return 1;
+    }
+    dumpTimeline();
+    printf("    %s\r\n", (failures)? "ERROR" : "OK");
+    fflush(stdout);
+    return (failures)? 1 : 0;
+}
+
+
+//------------------------------------------------------------------------------------
+int main(int argc, char** argv){
+    const char* name = 0;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-t") == 0 && (i + 1) < argc){
+            timeline_file = argv[++i];
+        }
+        else{
+            name = argv[i];
+        }
+    }
+    if(name){
+        // la tarea de ServoManager sigue bloqueada en su hilo, se finaliza sin destruir objetos
+        _exit(runScenario(name));
+    }
+
+    // cada escenario en un proceso independiente, con el tiempo y los chips simulados en su estado inicial
+    int result = 0;
+    for(size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++){
+        pid_t pid = fork();
+        if(pid == 0){
+            _exit(runScenario(scenarios[i]));
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        result |= (WIFEXITED(status))? WEXITSTATUS(status) : 1;
+    }
+    return result;
+}
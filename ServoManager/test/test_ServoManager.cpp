@@ -60,10 +60,8 @@ void test_ServoManager(){
     DEBUG_TRACE(" OK");
 
     // recupera parmetros de calibracin NV
-    uint32_t* caldata = (uint32_t*)Heap::memAlloc(NVFlash::getPageSize());
     NVFlash::init();
-    NVFlash::readPage(0, caldata);
-    if(servoman->setNVData(caldata) != 0){
+    if(servoman->restoreCalibration() == ServoManager::CalError){
         DEBUG_TRACE("\r\nERR_NVFLASH_READ, borrando...");
         NVFlash::erasePage(0);
         // establezco rangos de funcionamiento por defecto
@@ -73,14 +71,12 @@ void test_ServoManager(){
                 DEBUG_TRACE("ERR_servo_%d\r\n...", i);
             }            
         }
-        servoman->getNVData(caldata);
-        NVFlash::writePage(0, caldata);
+        servoman->saveCalibration();
         DEBUG_TRACE("OK");
     }
     else{
         DEBUG_TRACE("\r\nNVFLASH_RESTORE... OK!");
     }
-    Heap::memFree(caldata);
     
     // situo todos a 0 y doy la orden sincronizada
     DEBUG_TRACE("\r\nGirando servos a 0... ");
@@ -0,0 +1,142 @@
+/*
+ * TouchGroup.cpp
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ */
+
+#include "TouchGroup.h"
+
+
+//------------------------------------------------------------------------------------
+//--- PRIVATE TYPES ------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+#define DEBUG_TRACE(format, ...)    if(_debug){ _debug->printf(format, ##__VA_ARGS__);}
+
+
+//------------------------------------------------------------------------------------
+//-- PUBLIC METHODS IMPLEMENTATION ---------------------------------------------------
+//------------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------------
+TouchGroup::TouchGroup(PinName sda, PinName scl){
+    _debug = 0;
+    _count = 0;
+    _turn = 0;
+    memset((void*)_flags, 0, sizeof(_flags));
+    memset(_member, 0, sizeof(_member));
+    memset(&_stats, 0, sizeof(GroupStats));
+    _i2c = new I2C(sda, scl);
+    _th.start(callback(this, &TouchGroup::task));
+}
+
+
+//------------------------------------------------------------------------------------
+int8_t TouchGroup::add(TouchManager* tm){
+    // un manager con thread propio ejecutara sus trabajos tambin fuera del grupo
+    if(_count >= MaxMembers || tm->_group || tm->_own_thread){
+        return -1;
+    }
+    uint8_t id = _count;
+    _member[id] = tm;
+    tm->_ready = false;
+    if(!tm->_i2c){
+        tm->_i2c = _i2c;
+    }
+    tm->_group_id = id;
+    tm->_group = this;
+    _count = id + 1;
+    // la inicializacin (lectura del estado inicial) se realiza desde el thread del grupo
+    notify(id, InitFlag);
+    return id;
+}
+
+
+//------------------------------------------------------------------------------------
+bool TouchGroup::ready(){
+    for(uint8_t i = 0; i < _count; i++){
+        if(!_member[i]->ready()){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchGroup::notify(uint8_t id, uint32_t flags){
+    core_util_critical_section_enter();
+    _flags[id] |= flags;
+    core_util_critical_section_exit();
+    _th.signal_set(GroupFlag);
+}
+
+
+//------------------------------------------------------------------------------------
+//- PROTECTED CLASS IMPL. ------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+
+//------------------------------------------------------------------------------------
+void TouchGroup::task(){
+    for(;;){
+        osEvent evt = _th.signal_wait(0, osWaitForever);
+        if(evt.status != osEventSignal){
+            continue;
+        }
+        _stats.activations++;
+        uint8_t count = _count;
+
+        for(uint8_t i = 0; i < count; i++){
+            if(take(i, InitFlag)){
+                _member[i]->init();
+            }
+        }
+
+        // primero las interrupciones de todos los chips, despus el resto de trabajos de cada uno
+        serveIrqs();
+        for(uint8_t i = 0; i < count; i++){
+            uint32_t flags = take(i, ~((uint32_t)TouchManager::IrqFlag | InitFlag));
+            if(!flags){
+                continue;
+            }
+            if(serveIrqs()){
+                _stats.irq_first++;
+            }
+            _member[i]->job(flags);
+            _stats.timer_jobs++;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+uint32_t TouchGroup::take(uint8_t id, uint32_t mask){
+    core_util_critical_section_enter();
+    uint32_t flags = _flags[id] & mask;
+    _flags[id] &= ~flags;
+    core_util_critical_section_exit();
+    return flags;
+}
+
+
+//------------------------------------------------------------------------------------
+uint8_t TouchGroup::serveIrqs(){
+    uint8_t count = _count;
+    uint8_t served = 0;
+    for(uint8_t k = 0; k < count; k++){
+        uint8_t i = (_turn + k) % count;
+        if(take(i, TouchManager::IrqFlag)){
+            _member[i]->job(TouchManager::IrqFlag);
+            _stats.irq_jobs++;
+            served++;
+        }
+    }
+    if(served){
+        _turn = (_turn + 1) % count;
+    }
+    return served;
+}
+
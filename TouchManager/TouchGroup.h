@@ -0,0 +1,147 @@
+/*
+ * TouchGroup.h
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *	TouchGroup ejecuta varios TouchManager (varios MPR121 con distinta direccin en un mismo bus i2c) desde un nico
+ *  thread, de forma que N chips (hasta MaxMembers, 48 electrodos) comparten una sola pila en lugar de una por chip.
+ *
+ *  Los managers se crean sin thread propio (run_thread = false) y se aaden con add(). A partir de ese momento, sus
+ *  interrupciones y temporizaciones (filtro, gestos, sliders, etc...) se notifican al grupo indicando el ndice del
+ *  manager que las origina (notify), que acumula los flags pendientes de cada uno y despierta al thread del grupo.
+ *  Cada chip tiene su propia lnea irq, por lo que la interrupcin queda identificada (demultiplexada) sin accesos al
+ *  bus.
+ *
+ *  Planificacin:
+ *      En cada activacin, el thread atiende primero las interrupciones de todos los chips que las tengan pendientes,
+ *      empezando cada vez por un chip distinto (turno rotatorio) para que una rfaga en un chip no retrase siempre a los
+ *      dems. A continuacin atiende el resto de trabajos de cada chip, comprobando antes de cada uno si han llegado
+ *      nuevas interrupciones, que se adelantan a los trabajos an pendientes.
+ *
+ *  Bus i2c:
+ *      Todas las transacciones de los chips del grupo se realizan desde el mismo thread, por lo que no se pueden
+ *      solapar entre s. Adems, cada manager del grupo bloquea el bus (I2C::lock) durante sus accesos al chip 
+ *      (lectura de los electrodos o de sus datos filtrados y secuencia de la lnea base adaptativa), excluyendo a otros
+ *      threads que lo utilicen, pero no durante las callbacks de eventos ni las publicaciones. El grupo proporciona su
+ *      I2C a los managers que an no hayan creado el suyo (sliders y lnea base adaptativa).
+ *
+ *  Las estadsticas de planificacin (GroupStats) se obtienen con getStats().
+ */
+
+#ifndef __TouchGroup__H
+#define __TouchGroup__H
+
+#include "mbed.h"
+#include "TouchManager.h"
+
+
+
+class TouchGroup{
+  public:
+
+    /** Nmero mximo de managers en un grupo */
+    static const uint8_t MaxMembers = 4;
+
+
+    /** Estadsticas de planificacin */
+    struct GroupStats{
+        uint32_t activations;               /// Activaciones del thread del grupo
+        uint32_t irq_jobs;                  /// Trabajos de interrupcin atendidos
+        uint32_t timer_jobs;                /// Trabajos de temporizacin atendidos
+        uint32_t irq_first;                 /// Interrupciones adelantadas a trabajos de temporizacin pendientes
+    };
+
+
+    /** Constructor
+     *  Crea el bus i2c compartido y arranca el thread del grupo
+     *  @param sda Lnea sda del bus i2c
+     *  @param scl Lnea scl del bus i2c
+     */
+    TouchGroup(PinName sda, PinName scl);
+
+
+	/** add()
+     *  Aade un manager al grupo. Debe haberse creado sin thread propio (run_thread = false)
+     *  @param tm Manager a aadir
+     *  @return ndice en el grupo o -1 si el grupo est completo, el manager ya pertenece a un grupo o tiene thread
+     *          propio
+     */
+    int8_t add(TouchManager* tm);
+
+
+	/** ready()
+     *  Devuelve el estado de ejecucin
+     *  @return True si todos los managers aadidos estn inicializados
+     */
+    bool ready();
+
+
+	/** setDebugChannel()
+     *  Instala canal de depuracin
+     *  @param dbg Logger
+     */
+    void setDebugChannel(Logger* dbg){ _debug = dbg; }
+
+
+	/** getStats()
+     *  Obtiene las estadsticas de planificacin
+     *  @param stats Recibe las estadsticas
+     */
+    void getStats(GroupStats* stats){ *stats = _stats; }
+
+
+	/** notify()
+     *  Notifica flags de tarea de un manager del grupo. Se puede invocar desde ISR
+     *  @param id ndice del manager en el grupo
+     *  @param flags Flags de tarea del manager
+     */
+    void notify(uint8_t id, uint32_t flags);
+
+
+  protected:
+
+    /** Flags de tarea del grupo */
+    enum SigEventFlags{
+        GroupFlag       = (1<<0),       /// Flag para notificar trabajos pendientes en algn manager
+    };
+
+    /** Flag interno (fuera de los flags del manager) para solicitar su inicializacin */
+    static const uint32_t InitFlag = (1u<<31);
+
+    Thread      _th;                    /// Manejador del thread
+    I2C*        _i2c;                   /// Bus i2c compartido
+    TouchManager* _member[MaxMembers];  /// Managers del grupo
+    volatile uint8_t _count;            /// Nmero de managers
+    volatile uint32_t _flags[MaxMembers];   /// Flags pendientes de cada manager (escrito en ISR)
+    uint8_t     _turn;                  /// Primer manager en el turno de interrupciones
+    GroupStats  _stats;                 /// Estadsticas de planificacin
+    Logger*     _debug;                 /// Canal de depuracin
+
+	/** task()
+     *  Hilo de ejecucin del grupo
+     */
+    void task();
+
+
+	/** take()
+     *  Extrae los flags pendientes de un manager
+     *  @param id ndice del manager
+     *  @param mask Flags a extraer
+     *  @return Flags extrados
+     */
+    uint32_t take(uint8_t id, uint32_t mask);
+
+
+	/** serveIrqs()
+     *  Atiende las interrupciones pendientes de todos los managers, por turno rotatorio
+     *  @return Nmero de managers atendidos
+     */
+    uint8_t serveIrqs();
+};
+
+#endif /*__TouchGroup__H */
+
+/**** END OF FILE ****/
+
+
@@ -6,6 +6,7 @@
  */
 
 #include "TouchManager.h"
+#include "TouchGroup.h"
 
 
 //------------------------------------------------------------------------------------
@@ -29,7 +30,56 @@ TouchManager::TouchManager(PinName sda, PinName scl, PinName irq, uint16_t elec_
     _debug = 0;
     _ready = false;
     _pub_topic = 0;
+    _scan_topic = 0;
+    _pub_head = 0;
+    _pub_tail = 0;
+    _pub_drops = 0;
+    _pub_mode = PublishEvents;
+    _pub_mask = 0;
+    _scan_ts = 0;
+    memset(_edge_ts, 0, sizeof(_edge_ts));
+    memset(_cb_ts, 0, sizeof(_cb_ts));
+    memset(&_lat_stats, 0, sizeof(LatencyStats));
+    _stats_topic = 0;
     _curr_sns = 0;
+    _raw_sns = 0;
+    _pending = 0;
+    _ring_head = 0;
+    _ring_tail = 0;
+    _irq_seq = 0;
+    _ring_overflows = 0;
+    memset(&_irq_stats, 0, sizeof(IrqStats));
+    memset(_wheel, 0, sizeof(_wheel));
+    _wheel_pos = 0;
+    _wheel_ticks = 0;
+    _wheel_served = 0;
+    setDebounce((1 << MPR121_CapTouch::SensorCount) - 1, AntiGlitchTimeout);
+    memset(_gest, 0, sizeof(_gest));
+    _num_chords = 0;
+    _chord_ms = ChordWindowMs;
+    _chord_active = 0;
+    _chord_lock = 0;
+    _num_sliders = 0;
+    _slider_mask = 0;
+    _slider_active = false;
+    _i2c = 0;
+    _sda = sda;
+    _scl = scl;
+    _addr = addr;
+    _elec_mask = elec_mask;
+    _adapt_init = false;
+    memset(_adapt, 0, sizeof(_adapt));
+    _poll_us = 0;
+    _poll_votes = PollVotes;
+    _poll_idle_us = PollIdleMs * 1000;
+    _polling = false;
+    _poll_ts = 0;
+    _poll_active_ts = 0;
+    memset(_vote, 0, sizeof(_vote));
+    memset(&_poll_stats, 0, sizeof(PollStats));
+    _group = 0;
+    _group_id = 0;
+    _own_thread = run_thread;
     _evt_cb = callback(defaultCb);
                 
     // Carga callbacks estticas de publicacin/suscripcin
@@ -50,44 +100,213 @@ TouchManager::TouchManager(PinName sda, PinName scl, PinName irq, uint16_t elec_
 //------------------------------------------------------------------------------------
 void TouchManager::job(uint32_t signals){    
     if((signals & IrqFlag)!=0){
-        // lee el valor de los sensores
-        _sns = MPR121_CapTouch::touched();
-        // descarta eventos de electrodos no habilitados
-        if(_sns == _curr_sns){
-            return;
-        }
-        
-        // activa filtro antiglitch
-        _tick_glitch.attach_us(callback(this, &TouchManager::isrTickCb), AntiGlitchTimeout);
+        // lee el valor de los sensores por cada interrupcin registrada y procesa los flancos
+        irqDrain();
     }
     
+    if((signals & PollFlag)!=0){  
+        pollStep();
+    }  
+    
     if((signals & AntiGlitchFlag)!=0){  
-        uint16_t sns = MPR121_CapTouch::touched();        
-        // descarta glitches
-        if(sns != _sns){
-            return;
+        wheelStep();
+    }  
+    
+    if((signals & GestureFlag)!=0){  
+        gestureStep();
+    }  
+    
+    if((signals & SliderFlag)!=0){  
+        sliderStep();
+    }  
+    
+    // en modo exploracin, un nico mensaje con todos los cambios
+    if(_pub_mode == PublishScan && _curr_sns != _pub_mask){
+        publishScan();
+    }
+    
+    if((signals & StatsFlag)!=0){  
+        publishStats();
+    }  
+    
+    if((signals & AdaptFlag)!=0){  
+        // la secuencia de lectura y reescritura de umbrales no debe intercalarse con otros accesos al bus
+        busLock();
+        adaptStep();
+        busUnlock();
+    }  
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::setDebounce(uint16_t elec_mask, uint32_t time_us){
+    uint32_t ticks = (time_us + DebounceTickUs - 1) / DebounceTickUs;
+    ticks = (ticks > (WheelSlots - 2))? (WheelSlots - 2) : ticks;
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        if((elec_mask & ((uint16_t)1 << i)) != 0){
+            _debounce[i] = (uint8_t)ticks;
         }
-        // evala sensor a sensor
-        for(uint8_t i = 0; i< MPR121_CapTouch::SensorCount; i++){
-            if((_sns & ((uint16_t)1 << i)) != (_curr_sns & ((uint16_t)1 << i))){
-                TouchMsg msg = {i, (((_sns & ((uint16_t)1 << i)) != 0)? TouchedEvent : ReleasedEvent)};
-                // notifica evento en callback
-                _evt_cb.call(&msg);
-                // publica mensaje
-                if(_pub_topic){
-                    sprintf(_msg, "%d,%d", msg.elec, msg.evt);
-                    MQ::MQClient::publish(_pub_topic, _msg, strlen(_msg)+1 , &_publicationCb);
-                }
-            }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::getLatencyStats(LatencyStats* stats){
+    // la tarea actualiza las estadsticas en cada evento, la copia no debe intercalarse con una actualizacin
+    core_util_critical_section_enter();
+    *stats = _lat_stats;
+    core_util_critical_section_exit();
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::resetLatencyStats(){
+    core_util_critical_section_enter();
+    memset(&_lat_stats, 0, sizeof(LatencyStats));
+    core_util_critical_section_exit();
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::getIrqStats(IrqStats* stats){
+    // la tarea (y la ISR para los contadores) actualiza las estadsticas mientras se copian
+    core_util_critical_section_enter();
+    *stats = _irq_stats;
+    stats->irqs = _irq_seq;
+    stats->overflows = _ring_overflows;
+    core_util_critical_section_exit();
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::setPolling(uint32_t period_us, uint8_t votes, uint32_t idle_ms){
+    if(_polling){
+        _tick_poll.detach();
+        _polling = false;
+        _poll_stats.exits++;
+    }
+    votes = (votes < 1)? 1 : ((votes > MaxPollVotes)? MaxPollVotes : votes);
+    // nmero impar de lecturas para que no haya empates
+    _poll_votes = votes | 1;
+    _poll_idle_us = idle_ms * 1000;
+    _poll_us = period_us;
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::getPollStats(PollStats* stats){
+    // la tarea actualiza las estadsticas en cada sondeo, la copia no debe intercalarse con una actualizacin
+    core_util_critical_section_enter();
+    *stats = _poll_stats;
+    core_util_critical_section_exit();
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::setGestures(uint16_t elec_mask, uint16_t hold_ms, uint16_t repeat_ms, uint16_t dtap_ms){
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        if((elec_mask & ((uint16_t)1 << i)) != 0){
+            _gest[i].hold_ms = hold_ms;
+            _gest[i].repeat_ms = repeat_ms;
+            _gest[i].dtap_ms = dtap_ms;
+            _gest[i].state = GestureIdle;
+            _gest[i].tap = false;
         }
-        _curr_sns = _sns;
-    }  
+    }
+    gestureArm();
+}
+
+
+//------------------------------------------------------------------------------------
+int8_t TouchManager::addChord(uint16_t elec_mask){
+    elec_mask &= ((1 << MPR121_CapTouch::SensorCount) - 1);
+    // un acorde requiere al menos dos electrodos
+    if(_num_chords >= MaxChords || (elec_mask & (elec_mask - 1)) == 0){
+        return -1;
+    }
+    _chord[_num_chords] = elec_mask;
+    return _num_chords++;
+}
+
+
+//------------------------------------------------------------------------------------
+int8_t TouchManager::addSlider(uint16_t elec_mask, bool wheel, uint16_t move_thr){
+    elec_mask &= ((1 << MPR121_CapTouch::SensorCount) - 1);
+    if(_num_sliders >= MaxSliders || (elec_mask & (elec_mask - 1)) == 0){
+        return -1;
+    }
+    // el bus para la lectura de los datos de los electrodos se crea con el primer slider
+    if(!_i2c){
+        _i2c = new I2C(_sda, _scl);
+    }
+    Slider_t* sl = &_slider[_num_sliders];
+    sl->mask = elec_mask;
+    sl->num = 0;
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        if((elec_mask & ((uint16_t)1 << i)) != 0){
+            sl->elec[sl->num++] = i;
+        }
+    }
+    sl->wheel = wheel;
+    sl->touched = false;
+    sl->move_thr = move_thr;
+    sl->pos = SliderReleased;
+    _slider_mask |= elec_mask;
+    return _num_sliders++;
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::setAdaptive(uint32_t period_ms){
+    _tick_adapt.detach();
+    if(!period_ms){
+        return;
+    }
+    if(!_i2c){
+        _i2c = new I2C(_sda, _scl);
+    }
+    _tick_adapt.attach_us(callback(this, &TouchManager::isrAdaptCb), period_ms * 1000);
+}
+
+
+//------------------------------------------------------------------------------------
+bool TouchManager::getBaselineInfo(uint8_t elec, BaselineInfo* info){
+    if(elec >= MPR121_CapTouch::SensorCount || !_adapt_init){
+        return false;
+    }
+    *info = _adapt[elec];
+    return true;
 }
 
 
 //------------------------------------------------------------------------------------
 void TouchManager::setPublicationBase(const char* pub_topic) {
     _pub_topic = (char*)pub_topic; 
+    if(_scan_topic){
+        Heap::memFree(_scan_topic);
+    }
+    _scan_topic = (char*)Heap::memAlloc(strlen(pub_topic) + strlen("/scan") + 1);
+    if(_scan_topic){
+        sprintf(_scan_topic, "%s/scan", pub_topic);
+    }
+    if(_stats_topic){
+        Heap::memFree(_stats_topic);
+    }
+    _stats_topic = (char*)Heap::memAlloc(strlen(pub_topic) + strlen("/stats") + 1);
+    if(_stats_topic){
+        sprintf(_stats_topic, "%s/stats", pub_topic);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::setStatsPeriod(uint32_t period_ms){
+    _tick_stats.detach();
+    if(!period_ms){
+        publishStats();
+        return;
+    }
+    _tick_stats.attach_us(callback(this, &TouchManager::isrStatsCb), period_ms * 1000);
 }   
 
 
@@ -98,11 +317,7 @@ void TouchManager::setPublicationBase(const char* pub_topic) {
 
 //------------------------------------------------------------------------------------
 void TouchManager::task(){
-    while(MPR121_CapTouch::getState() != MPR121_CapTouch::Ready){
-        Thread::yield();
-    }
-    _curr_sns = MPR121_CapTouch::touched();
-    _ready = true;
+    init();
     
     // Arranca espera
     _timeout = osWaitForever;
@@ -116,19 +331,724 @@ void TouchManager::task(){
 }
     
 
+//------------------------------------------------------------------------------------
+void TouchManager::init(){
+    while(MPR121_CapTouch::getState() != MPR121_CapTouch::Ready){
+        Thread::yield();
+    }
+    _curr_sns = chipTouched();
+    _raw_sns = _curr_sns;
+    _pub_mask = _curr_sns;
+    _ready = true;
+}
+    
+
+//------------------------------------------------------------------------------------
+uint16_t TouchManager::chipTouched(){
+    busLock();
+    uint16_t sns = MPR121_CapTouch::touched();
+    busUnlock();
+    return sns;
+}
+    
+
+//------------------------------------------------------------------------------------
+void TouchManager::signal(uint32_t flags){
+    if(_group){
+        _group->notify(_group_id, flags);
+        return;
+    }
+    _th.signal_set(flags);   
+}
+    
+
 //------------------------------------------------------------------------------------
 void TouchManager::onIrqCb(){
-    _th.signal_set(IrqFlag);   
+    uint32_t seq = ++_irq_seq;
+    uint32_t head = _ring_head;
+    if((head - _ring_tail) >= IrqRingSize){
+        _ring_overflows++;
+    }
+    else{
+        // el evento se completa antes de publicarlo al consumidor
+        IrqEvent_t* ev = &_ring[head & (IrqRingSize - 1)];
+        ev->ts = us_ticker_read();
+        ev->seq = seq;
+        __DMB();
+        _ring_head = head + 1;
+    }
+    signal(IrqFlag);   
+}   
+    
+
+//------------------------------------------------------------------------------------
+void TouchManager::irqDrain(){
+    uint32_t tail = _ring_tail;
+    uint32_t head = _ring_head;
+    uint32_t depth = head - tail;
+    if(!depth){
+        return;
+    }
+    if(depth > _irq_stats.max_depth){
+        _irq_stats.max_depth = depth;
+    }
+    // la lectura i2c slo puede hacerse aqu y sera la misma para todos los eventos pendientes, as que se atienden
+    // juntos con el instante del ms antiguo. Las posiciones se liberan antes de la lectura, para que la ISR pueda
+    // registrar nuevas interrupciones, que se atienden en la siguiente activacin
+    // los eventos hasta head estn completos (la ISR los escribe antes de publicar head), y se copian antes de liberarlos
+    __DMB();
+    IrqEvent_t first = _ring[tail & (IrqRingSize - 1)];
+    IrqEvent_t last = _ring[(head - 1) & (IrqRingSize - 1)];
+    __DMB();
+    _ring_tail = head;
+    _irq_stats.seq = last.seq;
+    _irq_stats.drained += depth;
+    _irq_stats.batches++;
+    if(depth > _irq_stats.max_batch){
+        _irq_stats.max_batch = depth;
+    }
+    // en modo sondeo el estado del chip se lee en el siguiente tick
+    if(_polling){
+        return;
+    }
+    uint16_t sns = chipTouched();
+    if(_poll_us && sns){
+        pollStart();
+    }
+    sample(sns, first.ts);
 }   
     
 
 //------------------------------------------------------------------------------------
 void TouchManager::isrTickCb(){
+    _wheel_ticks++;
+    signal(AntiGlitchFlag);   
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::sample(uint16_t sns, uint32_t ts){
+    uint16_t edges = sns ^ _raw_sns;
+    _raw_sns = sns;
+    if(edges & sns & _slider_mask){
+        sliderArm();
+    }
+    if(_polling){
+        vote(sns, edges, ts);
+        return;
+    }
+    bool in_phase = false;
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        uint16_t mask = ((uint16_t)1 << i);
+        if((edges & mask) == 0){
+            continue;
+        }
+        _edge_ts[i] = ts;
+        // cada flanco cancela el filtro en curso del electrodo
+        if((_pending & mask) != 0){
+            _wheel[_slot[i]] &= ~mask;
+            _pending &= ~mask;
+        }
+        // si vuelve al estado notificado, era un glitch
+        if((sns & mask) == (_curr_sns & mask)){
+            continue;
+        }
+        if(!_debounce[i]){
+            _curr_sns ^= mask;
+            notify(i, ((sns & mask) != 0)? TouchedEvent : ReleasedEvent);
+            continue;
+        }
+        // arranca la rueda con el primer electrodo en filtrado, en fase con su flanco. Con la rueda en marcha, la
+        // ranura en curso ya ha comenzado y se aade un tick para no acortar el filtro (salvo si la ha arrancado un
+        // flanco de esta misma lectura)
+        uint8_t ticks = _debounce[i];
+        if(!_pending){
+            core_util_critical_section_enter();
+            _wheel_served = _wheel_ticks;
+            core_util_critical_section_exit();
+            _tick_glitch.attach_us(callback(this, &TouchManager::isrTickCb), DebounceTickUs);
+            in_phase = true;
+        }
+        else if(!in_phase){
+            ticks++;
+        }
+        _slot[i] = (_wheel_pos + ticks) % WheelSlots;
+        _wheel[_slot[i]] |= mask;
+        _pending |= mask;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::isrPollCb(){
+    _poll_ts = us_ticker_read();
+    signal(PollFlag);   
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::pollStart(){
+    // los filtros en curso se sustituyen por el voto, que parte del estado notificado de cada electrodo
     _tick_glitch.detach();
-    _th.signal_set(AntiGlitchFlag);   
+    memset(_wheel, 0, sizeof(_wheel));
+    _pending = 0;
+    uint16_t all = ((uint16_t)1 << _poll_votes) - 1;
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        _vote[i] = ((_curr_sns & ((uint16_t)1 << i)) != 0)? all : 0;
+    }
+    _polling = true;
+    _poll_active_ts = us_ticker_read();
+    _poll_stats.entries++;
+    _tick_poll.attach_us(callback(this, &TouchManager::isrPollCb), _poll_us);
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::pollStep(){
+    if(!_polling){
+        return;
+    }
+    _poll_stats.polls++;
+    uint32_t ts = _poll_ts;
+    sample(chipTouched(), ts);
+    if(_raw_sns || _curr_sns){
+        _poll_active_ts = ts;
+        return;
+    }
+    // sin pulsaciones durante el tiempo configurado, vuelve a esperar interrupciones
+    if((ts - _poll_active_ts) >= _poll_idle_us){
+        _tick_poll.detach();
+        _polling = false;
+        _poll_stats.exits++;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::vote(uint16_t sns, uint16_t edges, uint32_t ts){
+    uint16_t all = ((uint16_t)1 << _poll_votes) - 1;
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        uint16_t mask = ((uint16_t)1 << i);
+        if((edges & mask) != 0){
+            _edge_ts[i] = ts;
+        }
+        _vote[i] = ((_vote[i] << 1) | (((sns & mask) != 0)? 1 : 0)) & all;
+        uint8_t count = 0;
+        for(uint16_t v = _vote[i]; v; v &= (v - 1)){
+            count++;
+        }
+        bool touched = (count > (_poll_votes / 2))? true : false;
+        if(touched != ((_curr_sns & mask) != 0)){
+            _curr_sns ^= mask;
+            notify(i, (touched)? TouchedEvent : ReleasedEvent);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::wheelStep(){
+    core_util_critical_section_enter();
+    uint32_t pending = _wheel_ticks - _wheel_served;
+    _wheel_served = _wheel_ticks;
+    core_util_critical_section_exit();
+    if(!_pending || !pending){
+        return;
+    }
+    // avanza la rueda recogiendo los electrodos vencidos (con ms de una vuelta de retraso, vencen todos)
+    pending = (pending > WheelSlots)? WheelSlots : pending;
+    uint16_t expired = 0;
+    while(pending--){
+        _wheel_pos = (_wheel_pos + 1) % WheelSlots;
+        expired |= _wheel[_wheel_pos];
+        _wheel[_wheel_pos] = 0;
+    }
+    if(expired){
+        _pending &= ~expired;
+        // confirma el estado con una nueva lectura: los flancos no notificados reinician su filtro
+        sample(chipTouched(), us_ticker_read());
+        expired &= ~_pending;
+        for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+            uint16_t mask = ((uint16_t)1 << i);
+            if((expired & mask) != 0 && (_raw_sns & mask) != (_curr_sns & mask)){
+                _curr_sns ^= mask;
+                notify(i, ((_raw_sns & mask) != 0)? TouchedEvent : ReleasedEvent);
+            }
+        }
+    }
+    if(!_pending){
+        _tick_glitch.detach();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::isrGestureCb(){
+    signal(GestureFlag);   
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::gestureEdge(uint8_t elec, bool touched){
+    Gesture_t* g = &_gest[elec];
+    uint16_t mask = ((uint16_t)1 << elec);
+    uint32_t now = us_ticker_read();
+    
+    if(!touched){
+        // una pulsacin corta queda como candidata a doble pulsacin
+        g->tap = (g->state == GestureHold || (g->state == GestureIdle && !g->hold_ms))? ((_chord_lock & mask) == 0) : false;
+        g->state = GestureIdle;
+        g->release_ts = now;
+        _chord_lock &= ~mask;
+        for(uint8_t c = 0; c < _num_chords; c++){
+            if((_chord[c] & mask) != 0){
+                _chord_active &= ~(1 << c);
+            }
+        }
+        gestureArm();
+        return;
+    }
+    
+    g->touch_ts = now;
+    // acordes completados con esta pulsacin, dentro de su ventana
+    for(uint8_t c = 0; c < _num_chords; c++){
+        if((_chord[c] & mask) == 0 || (_curr_sns & _chord[c]) != _chord[c] || (_chord_active & (1 << c)) != 0){
+            continue;
+        }
+        bool in_window = true;
+        for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+            if((_chord[c] & ((uint16_t)1 << i)) != 0 && (now - _gest[i].touch_ts) > ((uint32_t)_chord_ms * 1000)){
+                in_window = false;
+            }
+        }
+        if(in_window){
+            _chord_active |= (1 << c);
+            _chord_lock |= _chord[c];
+            for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+                if((_chord[c] & ((uint16_t)1 << i)) != 0){
+                    _gest[i].state = GestureIdle;
+                    _gest[i].tap = false;
+                }
+            }
+            notify(c, ChordEvent);
+        }
+    }
+    if((_chord_lock & mask) != 0){
+        gestureArm();
+        return;
+    }
+    
+    if(g->tap && g->dtap_ms && (now - g->release_ts) <= ((uint32_t)g->dtap_ms * 1000)){
+        notify(elec, DoubleTapEvent);
+    }
+    g->tap = false;
+    if(g->hold_ms){
+        g->state = GestureHold;
+        g->due = now + ((uint32_t)g->hold_ms * 1000);
+    }
+    gestureArm();
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::gestureStep(){
+    uint32_t now = us_ticker_read();
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        Gesture_t* g = &_gest[i];
+        if(g->state == GestureIdle || (int32_t)(g->due - now) > 0){
+            continue;
+        }
+        if(g->state == GestureHold){
+            notify(i, HoldEvent);
+        }
+        else{
+            notify(i, RepeatEvent);
+        }
+        // las repeticiones mantienen su cadencia aunque la tarea se retrase
+        if(g->repeat_ms){
+            g->state = GestureRepeat;
+            g->due += ((uint32_t)g->repeat_ms * 1000);
+            if((int32_t)(g->due - now) <= 0){
+                g->due = now + ((uint32_t)g->repeat_ms * 1000);
+            }
+        }
+        else{
+            g->state = GestureIdle;
+        }
+    }
+    gestureArm();
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::gestureArm(){
+    uint32_t now = us_ticker_read();
+    int32_t next = INT32_MAX;
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        if(_gest[i].state != GestureIdle && (int32_t)(_gest[i].due - now) < next){
+            next = (int32_t)(_gest[i].due - now);
+        }
+    }
+    _tick_gesture.detach();
+    if(next != INT32_MAX){
+        _tick_gesture.attach_us(callback(this, &TouchManager::isrGestureCb), (next > 0)? next : 1);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::isrSliderCb(){
+    signal(SliderFlag);   
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::sliderArm(){
+    if(_slider_active || (_raw_sns & _slider_mask) == 0){
+        return;
+    }
+    _slider_active = true;
+    _tick_slider.attach_us(callback(this, &TouchManager::isrSliderCb), SliderTickUs);
+    // primera lectura inmediata, sin esperar al filtro anti-glitch
+    sliderStep();
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::sliderStep(){
+    if(!_slider_active){
+        return;
+    }
+    uint16_t filtered[MPR121_CapTouch::SensorCount];
+    uint8_t baseline[MPR121_CapTouch::SensorCount];
+    if(!readElectrodes(filtered, baseline)){
+        DEBUG_TRACE("\r\nTouchManager: ERR_SLIDER, lectura i2c\r\n");
+        return;
+    }
+    uint16_t delta[MPR121_CapTouch::SensorCount];
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        int32_t base = (int32_t)baseline[i] << 2;
+        delta[i] = (base > filtered[i])? (uint16_t)(base - filtered[i]) : 0;
+    }
+    
+    bool touched = false;
+    for(uint8_t s = 0; s < _num_sliders; s++){
+        Slider_t* sl = &_slider[s];
+        uint32_t total;
+        uint16_t pos = sliderPosition(sl, delta, &total);
+        // histresis de pulsacin: pulsado por encima de SliderTouchDelta, liberado por debajo de la mitad
+        if(!sl->touched && total >= SliderTouchDelta){
+            sl->touched = true;
+            sl->pos = pos;
+            notify(s, SliderEvent, pos);
+        }
+        else if(sl->touched && total < (SliderTouchDelta / 2)){
+            sl->touched = false;
+            sl->pos = SliderReleased;
+            notify(s, SliderEvent, SliderReleased);
+        }
+        else if(sl->touched){
+            // desplazamiento respecto de la ltima posicin notificada (por el camino ms corto en una rueda)
+            int32_t dist = (int32_t)pos - (int32_t)sl->pos;
+            dist = (dist < 0)? -dist : dist;
+            if(sl->wheel && dist > ((sl->num * SliderScale) / 2)){
+                dist = (sl->num * SliderScale) - dist;
+            }
+            if(dist >= sl->move_thr){
+                sl->pos = pos;
+                notify(s, SliderEvent, pos);
+            }
+        }
+        touched = (sl->touched)? true : touched;
+    }
+    
+    // sin sliders pulsados ni electrodos activos, detiene la lectura peridica
+    if(!touched && (_raw_sns & _slider_mask) == 0){
+        _tick_slider.detach();
+        _slider_active = false;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+bool TouchManager::readElectrodes(uint16_t* filtered, uint8_t* baseline){
+    // datos filtrados y lnea base de todos los electrodos en una nica transaccin
+    char buf[SliderReadLen];
+    char reg = RegFilteredData;
+    uint8_t addr = (_addr << 1);
+    busLock();
+    bool ok = (_i2c->write(addr, &reg, 1, true) == 0 && _i2c->read(addr, buf, SliderReadLen) == 0)? true : false;
+    busUnlock();
+    if(!ok){
+        return false;
+    }
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        filtered[i] = (uint8_t)buf[2 * i] | (((uint8_t)buf[(2 * i) + 1] & 0x03) << 8);
+        baseline[i] = (uint8_t)buf[(RegBaseline - RegFilteredData) + i];
+    }
+    return true;
+}
+
+
+//------------------------------------------------------------------------------------
+bool TouchManager::writeRegs(uint8_t reg, const uint8_t* data, uint8_t len){
+    char buf[(2 * MPR121_CapTouch::SensorCount) + 1];
+    buf[0] = reg;
+    memcpy(&buf[1], data, len);
+    return (_i2c->write(_addr << 1, buf, len + 1) == 0)? true : false;
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::isrAdaptCb(){
+    signal(AdaptFlag);   
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::adaptStep(){
+    // sin trfico i2c adicional durante las pulsaciones
+    if(_raw_sns || _pending || _slider_active || _polling){
+        return;
+    }
+    uint16_t filtered[MPR121_CapTouch::SensorCount];
+    uint8_t baseline[MPR121_CapTouch::SensorCount];
+    if(!readElectrodes(filtered, baseline)){
+        DEBUG_TRACE("\r\nTouchManager: ERR_ADAPT, lectura i2c\r\n");
+        return;
+    }
+    // en el primer muestreo, toma como referencia los umbrales configurados en el chip
+    uint8_t addr = (_addr << 1);
+    if(!_adapt_init){
+        char reg = RegThresholds;
+        if(_i2c->write(addr, &reg, 1, true) != 0 || _i2c->read(addr, (char*)_thr_base, sizeof(_thr_base)) != 0){
+            return;
+        }
+        memcpy(_thr, _thr_base, sizeof(_thr));
+        _adapt_init = true;
+    }
+    
+    bool retune = false;
+    bool rebase = false;
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        if((_elec_mask & ((uint16_t)1 << i)) == 0){
+            continue;
+        }
+        BaselineInfo* a = &_adapt[i];
+        a->baseline = (uint16_t)baseline[i] << 2;
+        a->filtered = filtered[i];
+        // desviacin y ruido medios en Q4
+        int32_t delta = ((int32_t)a->baseline - (int32_t)filtered[i]) << 4;
+        a->offset += (int16_t)((delta - a->offset) / 8);
+        int32_t dev = delta - a->offset;
+        dev = (dev < 0)? -dev : dev;
+        a->noise += (int16_t)((dev - (int32_t)a->noise) / 8);
+        
+        // umbrales objetivo: los iniciales ms el margen de ruido, aproximndose 1 cuenta por muestreo
+        uint8_t* thr = &_thr[2 * i];
+        int32_t margin = (a->noise * AdaptNoiseGain) >> 4;
+        int32_t target[2] = {_thr_base[2 * i] + margin, _thr_base[(2 * i) + 1] + (margin / 2)};
+        for(uint8_t k = 0; k < 2; k++){
+            target[k] = (target[k] > 255)? 255 : target[k];
+            if(thr[k] < target[k]){
+                thr[k]++;
+                retune = true;
+            }
+            else if(thr[k] > target[k]){
+                thr[k]--;
+                retune = true;
+            }
+        }
+        // la liberacin siempre por debajo de la pulsacin
+        if(thr[1] >= thr[0] && thr[0] > 0){
+            thr[1] = thr[0] - 1;
+        }
+        a->touch_thr = thr[0];
+        a->release_thr = thr[1];
+        
+        // deriva no compensada por el chip: recarga la lnea base con el valor filtrado
+        int32_t offset = (a->offset < 0)? -a->offset : a->offset;
+        if((offset >> 4) > (thr[0] / 2)){
+            baseline[i] = (uint8_t)(filtered[i] >> 2);
+            a->offset = 0;
+            a->recal++;
+            rebase = true;
+        }
+    }
+    if(!retune && !rebase){
+        return;
+    }
+    
+    // los registros de configuracin slo se pueden escribir en modo Stop
+    char reg = RegECR;
+    char ecr;
+    if(_i2c->write(addr, &reg, 1, true) != 0 || _i2c->read(addr, &ecr, 1) != 0){
+        return;
+    }
+    uint8_t stop = 0;
+    if(!writeRegs(RegECR, &stop, 1)){
+        return;
+    }
+    if(retune && !writeRegs(RegThresholds, _thr, sizeof(_thr))){
+        DEBUG_TRACE("\r\nTouchManager: ERR_ADAPT, escritura de umbrales\r\n");
+    }
+    if(rebase && !writeRegs(RegBaseline, baseline, MPR121_CapTouch::SensorCount)){
+        DEBUG_TRACE("\r\nTouchManager: ERR_ADAPT, escritura de lnea base\r\n");
+    }
+    // restaura la configuracin: con CL = 00 el chip contina desde la lnea base escrita (salvo seguimiento desactivado)
+    uint8_t run = (((uint8_t)ecr & 0xC0) == 0x40)? (uint8_t)ecr : ((uint8_t)ecr & 0x3F);
+    writeRegs(RegECR, &run, 1);
+}
+
+
+//------------------------------------------------------------------------------------
+uint16_t TouchManager::sliderPosition(Slider_t* sl, const uint16_t* delta, uint32_t* total){
+    // electrodo con mayor seal
+    uint8_t peak = 0;
+    *total = 0;
+    for(uint8_t k = 0; k < sl->num; k++){
+        *total += delta[sl->elec[k]];
+        if(delta[sl->elec[k]] > delta[sl->elec[peak]]){
+            peak = k;
+        }
+    }
+    // centroide con sus vecinos, en los extremos de un slider slo con el vecino existente
+    int32_t prev = 0, next = 0;
+    if(peak > 0 || sl->wheel){
+        prev = delta[sl->elec[(peak + sl->num - 1) % sl->num]];
+    }
+    if(peak < (sl->num - 1) || sl->wheel){
+        next = delta[sl->elec[(peak + 1) % sl->num]];
+    }
+    int32_t sum = prev + delta[sl->elec[peak]] + next;
+    int32_t pos = (int32_t)peak * SliderScale;
+    if(sum){
+        pos += ((next - prev) * SliderScale) / sum;
+    }
+    int32_t range = sl->num * SliderScale;
+    if(sl->wheel){
+        pos = (pos + range) % range;
+    }
+    else{
+        pos = (pos < 0)? 0 : ((pos > (range - SliderScale))? (range - SliderScale) : pos);
+    }
+    return (uint16_t)pos;
+}
+
+
+//------------------------------------------------------------------------------------
+char* TouchManager::pubAlloc(){
+    if((_pub_head - _pub_tail) >= PubPoolSize){
+        _pub_drops++;
+        return 0;
+    }
+    return (char*)_pub_pool[(_pub_head++) % PubPoolSize];
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::publishScan(){
+    if(!_scan_topic){
+        return;
+    }
+    char* buf = pubAlloc();
+    if(!buf){
+        return;
+    }
+    TouchScan* scan = (TouchScan*)buf;
+    scan->ts = _scan_ts;
+    scan->prev = _pub_mask;
+    scan->curr = _curr_sns;
+    uint16_t changed = _pub_mask ^ _curr_sns;
+    _pub_mask = _curr_sns;
+    MQ::MQClient::publish(_scan_topic, scan, sizeof(TouchScan), &_publicationCb);
+    // latencia de publicacin de cada cambio incluido en el mensaje
+    uint32_t now = us_ticker_read();
+    for(uint8_t i = 0; i < MPR121_CapTouch::SensorCount; i++){
+        if((changed & ((uint16_t)1 << i)) != 0){
+            latencyUpdate(&_lat_stats.publish, now - _cb_ts[i]);
+            latencyUpdate(&_lat_stats.total, now - _edge_ts[i]);
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::latencyUpdate(LatencyStage* st, uint32_t us){
+    st->last_us = us;
+    st->avg_us = (_lat_stats.events > 1)? (st->avg_us + (((int32_t)us - (int32_t)st->avg_us) / 8)) : us;
+    if(us > st->max_us){
+        st->max_us = us;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::isrStatsCb(){
+    signal(StatsFlag);   
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::publishStats(){
+    if(!_stats_topic){
+        return;
+    }
+    _lat_msg = _lat_stats;
+    MQ::MQClient::publish(_stats_topic, &_lat_msg, sizeof(LatencyStats), &_publicationCb);
+}
+
+
+//------------------------------------------------------------------------------------
+void TouchManager::notify(uint8_t elec, TouchEvent evt, uint16_t pos){
+    // los eventos de un electrodo se originan en la interrupcin del flanco, el resto en el momento actual
+    bool edge = (evt == TouchedEvent || evt == ReleasedEvent)? true : false;
+    uint32_t t_deb = us_ticker_read();
+    TouchMsg msg = {elec, evt, pos, (edge || evt == DoubleTapEvent)? _edge_ts[elec] : t_deb};
+    // notifica evento en callback
+    _evt_cb.call(&msg);
+    uint32_t t_cb = us_ticker_read();
+    if(edge){
+        _lat_stats.events++;
+        latencyUpdate(&_lat_stats.debounce, t_deb - msg.ts);
+        latencyUpdate(&_lat_stats.callback, t_cb - t_deb);
+        _cb_ts[elec] = t_cb;
+        _scan_ts = msg.ts;
+    }
+    // publica mensaje (en modo exploracin, las pulsaciones y liberaciones se publican agrupadas)
+    bool scan = (_pub_mode == PublishScan && edge)? true : false;
+    if(_pub_topic && !scan){
+        char* buf = pubAlloc();
+        if(buf){
+            if(evt == SliderEvent){
+                sprintf(buf, "%d,%d,%d,%lu", msg.elec, msg.evt, msg.pos, (unsigned long)msg.ts);
+            }
+            else{
+                sprintf(buf, "%d,%d,%lu", msg.elec, msg.evt, (unsigned long)msg.ts);
+            }
+            MQ::MQClient::publish(_pub_topic, buf, strlen(buf)+1 , &_publicationCb);
+            if(edge){
+                uint32_t t_pub = us_ticker_read();
+                latencyUpdate(&_lat_stats.publish, t_pub - t_cb);
+                latencyUpdate(&_lat_stats.total, t_pub - msg.ts);
+            }
+        }
+    }
+    // actualiza los gestos con las pulsaciones y liberaciones
+    if(evt == TouchedEvent || evt == ReleasedEvent){
+        gestureEdge(elec, (evt == TouchedEvent)? true : false);
+    }
 }
 
 
 //------------------------------------------------------------------------------------
 void TouchManager::publicationCb(const char* topic, int32_t result){
+    // las estadsticas no utilizan los buffers de publicacin
+    if(_stats_topic && strcmp(topic, _stats_topic) == 0){
+        return;
+    }
+    // las publicaciones finalizan en orden, libera el buffer ms antiguo
+    if(_pub_tail != _pub_head){
+        _pub_tail++;
+    }
 }
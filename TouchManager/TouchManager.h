@@ -13,8 +13,97 @@
  *  El uso de este manager a ms alto nivel puede ser, mediante la librera MQLib, mediante la instalacin de los topics
  *  de publicacin correspondientes y/o por medio de callbacks dedicadas. As la publicacin de topics ser:
  *
- *      $(pub_topic) ELEC,1     // Para notificar pulsacin en nodo ELEC
- *      $(pub_topic) ELEC,0     // Para notificar liberacin en nodo ELEC
+ *      $(pub_topic) ELEC,1,TS      // Para notificar pulsacin en nodo ELEC
+ *      $(pub_topic) ELEC,0,TS      // Para notificar liberacin en nodo ELEC
+ *      $(pub_topic) ELEC,2,TS      // Para notificar pulsacin mantenida (HOLD) en nodo ELEC
+ *      $(pub_topic) ELEC,3,TS      // Para notificar repeticin de la pulsacin mantenida en nodo ELEC
+ *      $(pub_topic) ELEC,4,TS      // Para notificar doble pulsacin en nodo ELEC
+ *      $(pub_topic) IDX,5,TS       // Para notificar la pulsacin del acorde IDX (registrado con addChord)
+ *      $(pub_topic) IDX,6,POS,TS   // Para notificar la posicin POS del slider/rueda IDX (65535 al liberarlo)
+ *
+ *  TS es el instante (us, us_ticker_read) en que se origin el evento: la interrupcin del chip que detect el flanco
+ *  en pulsaciones, liberaciones y dobles pulsaciones, y el momento de su generacin en el resto. El mismo instante se
+ *  entrega en TouchMsg::ts.
+ *
+ *  Latencias:
+ *      Para cada pulsacin y liberacin se mide el tiempo desde la interrupcin hasta su confirmacin por el filtro
+ *      (incluye el tiempo de filtro y la espera en la cola), la duracin de la callback, el tiempo hasta su publicacin
+ *      y el total. Las estadsticas (LatencyStats) se obtienen con getLatencyStats() o se publican peridicamente con
+ *      setStatsPeriod() en $(pub_topic)/stats:
+ *          msg = (TouchManager::LatencyStats*)
+ *          msg_len = sizeof(TouchManager::LatencyStats)
+ *
+ *  Modo de publicacin por exploracin (setPublishMode(PublishScan)):
+ *      En lugar de un mensaje por electrodo, cada exploracin filtrada que modifica el estado de los electrodos publica
+ *      un nico mensaje binario en $(pub_topic)/scan, con las mscaras anterior y nueva y su instante:
+ *          msg = (TouchManager::TouchScan*)
+ *          msg_len = sizeof(TouchManager::TouchScan)
+ *      Los eventos de gestos y sliders se siguen publicando en $(pub_topic). En ambos modos, los mensajes se construyen
+ *      en un conjunto de PubPoolSize buffers que permanecen vlidos hasta que finaliza su publicacin (publicationCb).
+ *      Si no hay buffers libres el mensaje se descarta y se contabiliza; en modo exploracin el siguiente mensaje parte
+ *      de la ltima mscara publicada, por lo que el estado de los electrodos no se pierde.
+ *
+ *  Lnea base adaptativa (setAdaptive):
+ *      Una tarea de baja frecuencia lee la lnea base y los datos filtrados de los electrodos habilitados, slo mientras
+ *      no hay electrodos pulsados, en filtrado ni sliders en lectura, para no aadir trfico i2c durante las pulsaciones.
+ *      Para cada electrodo estima la desviacin media (base - filtrado) y su ruido (filtros exponenciales 1/8 en punto
+ *      fijo Q4), y ajusta los umbrales de pulsacin y liberacin del chip de forma incremental (1 cuenta por periodo) 
+ *      hacia los umbrales iniciales ms una proporcin del ruido (AdaptNoiseGain). Si la desviacin supera la mitad del
+ *      umbral de pulsacin (deriva que el seguimiento del chip no compensa), recarga la lnea base con el valor filtrado.
+ *      Las escrituras se realizan en una nica transaccin por bloque de registros, con el chip en modo Stop (ECR = 0) y
+ *      restaurando despus su configuracin. El estado de cada electrodo se obtiene con getBaselineInfo().
+ *
+ *  Grupos de chips (TouchGroup):
+ *      Varios TouchManager creados sin thread propio (run_thread = false) pueden aadirse a un TouchGroup, que los 
+ *      ejecuta a todos desde un nico thread y comparte entre ellos el bus i2c. En ese caso, las interrupciones y 
+ *      temporizaciones de cada manager se notifican al grupo (signal) en lugar de a su propio thread.
+ *
+ *  Interrupciones:
+ *      Cada interrupcin del chip se registra en la propia ISR, con su instante y nmero de secuencia, en una cola 
+ *      circular sin bloqueos (un productor, la ISR, y un consumidor, la tarea) de IrqRingSize eventos. El estado de los
+ *      electrodos no puede leerse en la ISR (acceso i2c), sino en la tarea al vaciar la cola: todos los eventos
+ *      pendientes en ese instante obtendran la misma lectura, por lo que se atienden con una nica lectura del chip,
+ *      con el instante del ms antiguo como origen de la latencia. Los estados intermedios de una rfaga de
+ *      interrupciones ms rpida que la tarea no son recuperables, y slo se notifica el estado final. La cola admite
+ *      rfagas de hasta IrqRingSize interrupciones sin atender; si aun as se llena, los eventos se descartan (su
+ *      lectura queda cubierta por la de los pendientes) y se contabilizan en las estadsticas (getIrqStats).
+ *
+ *  Modo de sondeo (setPolling):
+ *      Para paneles que requieren baja latencia, mientras algn electrodo est activo el manager puede cambiar del
+ *      filtrado por interrupciones al sondeo peridico del chip. La primera lectura por interrupcin con electrodos
+ *      pulsados arranca un ticker de periodo period_us, cuyas lecturas sustituyen a las de las interrupciones (que
+ *      slo se extraen de la cola). El filtro es entonces un voto por mayora sobre las ltimas N lecturas de cada 
+ *      electrodo (N impar, hasta MaxPollVotes), por lo que un flanco se confirma en (N+1)/2 lecturas y un glitch de 
+ *      menos de (N+1)/2 lecturas se descarta. Tras idle_ms sin electrodos pulsados, el ticker se detiene y el manager 
+ *      vuelve a esperar interrupciones. Las estadsticas (PollStats) se obtienen con getPollStats().
+ *
+ *  Gestos:
+ *      Sobre los eventos filtrados de cada electrodo se generan, segn la configuracin de setGestures():
+ *          - HOLD al mantener la pulsacin hold_ms, y a continuacin REPEAT cada repeat_ms hasta la liberacin.
+ *          - DOUBLE_TAP si una pulsacin comienza antes de dtap_ms desde la liberacin de una pulsacin corta (sin HOLD).
+ *      Adems, un acorde (addChord) se notifica cuando todos sus electrodos estn pulsados y sus pulsaciones se han 
+ *      producido dentro de una ventana de ChordWindowMs (setChordWindow). Mientras el acorde se mantiene, sus 
+ *      electrodos no generan HOLD, REPEAT ni DOUBLE_TAP. Todos los gestos se temporizan con un nico Timeout, armado
+ *      al vencimiento ms prximo, sin muestreo peridico: sin electrodos pulsados no hay ninguna temporizacin activa.
+ *
+ *  Sliders y ruedas:
+ *      Un slider (o rueda, si es circular) es un grupo de electrodos adyacentes registrado con addSlider(), ordenados
+ *      segn su ndice. Mientras alguno de sus electrodos est pulsado, un ticker (SliderTickUs) lee del chip en una
+ *      nica transaccin los datos filtrados y la lnea base de todos los electrodos, y calcula la seal de cada uno
+ *      (base - filtrado). La posicin es el centroide del electrodo de mayor seal y sus dos vecinos, en punto fijo
+ *      de 1/SliderScale de electrodo: [0, (n-1)*SliderScale] en un slider y [0, n*SliderScale) en una rueda. El 
+ *      slider se considera pulsado cuando la suma de seales supera SliderTouchDelta y liberado cuando baja de la
+ *      mitad (histresis). La posicin slo se notifica al pulsarlo, cuando se desplaza al menos el umbral indicado 
+ *      en addSlider() respecto de la ltima notificada y al liberarlo (SliderReleased).
+ *
+ *  Filtro anti-glitch:
+ *      Cada electrodo tiene su propio filtro, con un tiempo configurable mediante setDebounce() (AntiGlitchTimeout por
+ *      defecto). Cada flanco en un electrodo (re)inicia su filtro, y el evento se notifica si al vencer el electrodo 
+ *      mantiene el nuevo estado, sin que los cambios en otros electrodos lo descarten. Todos los filtros comparten una 
+ *      rueda de temporizacin (WheelSlots ranuras de DebounceTickUs, con la mscara de electrodos que vencen en cada
+ *      una), movida por un nico ticker que slo est activo mientras hay electrodos en filtrado y que arranca con el
+ *      primer flanco, de forma que el retardo aadido es el tiempo de filtro (ms un tick como mximo si ya haba otro
+ *      electrodo en filtrado). Con un tiempo de filtro 0, el evento se notifica en la propia lectura del chip.
  */
  
 #ifndef __TouchManager__H
@@ -25,9 +114,12 @@
 /** Libreras relativas a mdulos software */
 #include "MQLib.h"
 #include "Logger.h"
+#include "Heap.h"
 #include "MPR121_CapTouch.h"
 
 
+class TouchGroup;
+
    
 class TouchManager : public MPR121_CapTouch{
   public:
@@ -39,6 +131,11 @@ class TouchManager : public MPR121_CapTouch{
     enum TouchEvent{
         ReleasedEvent,
         TouchedEvent,
+        HoldEvent,
+        RepeatEvent,
+        DoubleTapEvent,
+        ChordEvent,
+        SliderEvent,
     };
     
   
@@ -48,7 +145,15 @@ class TouchManager : public MPR121_CapTouch{
     struct TouchMsg{
         uint8_t elec;
         TouchEvent evt;
+        uint16_t pos;       /// Posicin del slider (slo SliderEvent)
+        uint32_t ts;        /// Instante (us) en que se origin el evento
     };
+    
+    /** Posicin notificada al liberar un slider */
+    static const uint16_t SliderReleased = 0xFFFF;
+    
+    /** Resolucin de la posicin de un slider: unidades por electrodo */
+    static const uint16_t SliderScale = 256;
 		
     /** Callback definida para la notificacin de eventos */
     typedef Callback<void(TouchMsg*)> TouchEventCallback;
@@ -99,6 +204,185 @@ class TouchManager : public MPR121_CapTouch{
     void attachCallback(TouchEventCallback onEventCb) { _evt_cb = onEventCb; }
     
   
+	/** setDebounce()
+     *  Establece el tiempo de filtro anti-glitch de uno o varios electrodos
+     *  @param elec_mask Mscara de bits de los electrodos a configurar
+     *  @param time_us Tiempo de filtro en us (0: sin filtro), limitado a (WheelSlots-2) * DebounceTickUs
+     */
+    void setDebounce(uint16_t elec_mask, uint32_t time_us);
+    
+  
+    /** Modos de publicacin */
+    enum PublishMode{
+        PublishEvents,                      /// Un mensaje de texto por evento de electrodo (ELEC,EVT)
+        PublishScan,                        /// Un mensaje binario (TouchScan) por exploracin con cambios
+    };
+    
+    /** Mensaje de exploracin ($(pub_topic)/scan) */
+    struct TouchScan{
+        uint32_t ts;                        /// Instante (us) de la interrupcin del ltimo cambio
+        uint16_t prev;                      /// Mscara de electrodos pulsados publicada anteriormente
+        uint16_t curr;                      /// Mscara de electrodos pulsados actual
+    };
+    
+  
+	/** setPublishMode()
+     *  Establece el modo de publicacin de los eventos de los electrodos
+     *  @param mode Modo de publicacin
+     */
+    void setPublishMode(PublishMode mode){ _pub_mode = mode; }
+    
+  
+	/** getPublishDrops()
+     *  Obtiene el nmero de mensajes descartados por falta de buffers de publicacin
+     *  @return Mensajes descartados
+     */
+    uint32_t getPublishDrops(){ return _pub_drops; }
+    
+    
+    /** Latencia de una etapa del procesado de eventos */
+    struct LatencyStage{
+        uint32_t last_us;                   /// ltima latencia
+        uint32_t avg_us;                    /// Latencia media (filtro exponencial 1/8)
+        uint32_t max_us;                    /// Latencia mxima
+    };
+    
+    /** Estadsticas de latencia de pulsaciones y liberaciones */
+    struct LatencyStats{
+        uint32_t events;                    /// Eventos medidos
+        LatencyStage debounce;              /// Interrupcin -> confirmacin por el filtro
+        LatencyStage callback;              /// Duracin de la callback
+        LatencyStage publish;               /// Fin de la callback -> publicacin
+        LatencyStage total;                 /// Interrupcin -> publicacin
+    };
+    
+  
+	/** getLatencyStats()
+     *  Obtiene una copia de las estadsticas de latencia
+     *  @param stats Recibe las estadsticas
+     */
+    void getLatencyStats(LatencyStats* stats);
+    
+  
+	/** resetLatencyStats()
+     *  Reinicia las estadsticas de latencia
+     */
+    void resetLatencyStats();
+    
+  
+	/** setStatsPeriod()
+     *  Establece el periodo de publicacin de las estadsticas de latencia en $(pub_topic)/stats
+     *  @param period_ms Periodo en ms (0: publica una nica vez y desactiva la publicacin peridica)
+     */
+    void setStatsPeriod(uint32_t period_ms);
+    
+    
+    /** Estado de la lnea base adaptativa de un electrodo */
+    struct BaselineInfo{
+        uint16_t baseline;                  /// ltima lnea base leda (10 bits)
+        uint16_t filtered;                  /// ltimo dato filtrado ledo (10 bits)
+        int16_t offset;                     /// Desviacin media base - filtrado (Q4)
+        uint16_t noise;                     /// Ruido medio (Q4)
+        uint8_t touch_thr;                  /// Umbral de pulsacin en uso
+        uint8_t release_thr;                /// Umbral de liberacin en uso
+        uint16_t recal;                     /// Recargas de la lnea base por deriva
+    };
+    
+  
+	/** setAdaptive()
+     *  Activa o desactiva la lnea base adaptativa
+     *  @param period_ms Periodo de muestreo en ms (0: desactivada)
+     */
+    void setAdaptive(uint32_t period_ms);
+    
+  
+	/** getBaselineInfo()
+     *  Obtiene el estado de la lnea base adaptativa de un electrodo
+     *  @param elec Electrodo
+     *  @param info Recibe el estado
+     *  @return True si el electrodo existe y la lnea base adaptativa ha realizado al menos un muestreo
+     */
+    bool getBaselineInfo(uint8_t elec, BaselineInfo* info);
+    
+    
+    /** Estadsticas de la cola de interrupciones */
+    struct IrqStats{
+        uint32_t irqs;                      /// Interrupciones recibidas
+        uint32_t drained;                   /// Eventos extrados por la tarea
+        uint32_t overflows;                 /// Eventos descartados por cola llena
+        uint32_t batches;                   /// Lotes procesados (una lectura del chip por lote)
+        uint32_t seq;                       /// Nmero de secuencia del ltimo evento extrado
+        uint16_t max_batch;                 /// Mximo de eventos atendidos con una misma lectura
+        uint16_t max_depth;                 /// Ocupacin mxima de la cola
+    };
+    
+  
+	/** getIrqStats()
+     *  Obtiene una copia de las estadsticas de la cola de interrupciones
+     *  @param stats Recibe las estadsticas
+     */
+    void getIrqStats(IrqStats* stats);
+    
+  
+    /** Estadsticas del modo de sondeo */
+    struct PollStats{
+        uint32_t polls;                     /// Lecturas de sondeo
+        uint32_t entries;                   /// Cambios a modo sondeo
+        uint32_t exits;                     /// Vueltas a modo interrupcin
+    };
+    
+  
+	/** setPolling()
+     *  Configura el modo de sondeo mientras hay electrodos activos
+     *  @param period_us Periodo de sondeo en us (0: desactivado, slo interrupciones)
+     *  @param votes Lecturas consideradas en el voto por mayora (impar, hasta MaxPollVotes)
+     *  @param idle_ms Tiempo sin electrodos pulsados para volver al modo interrupcin
+     */
+    void setPolling(uint32_t period_us, uint8_t votes = PollVotes, uint32_t idle_ms = PollIdleMs);
+    
+  
+	/** getPollStats()
+     *  Obtiene una copia de las estadsticas del modo de sondeo
+     *  @param stats Recibe las estadsticas
+     */
+    void getPollStats(PollStats* stats);
+    
+  
+	/** setGestures()
+     *  Configura los gestos de uno o varios electrodos
+     *  @param elec_mask Mscara de bits de los electrodos a configurar
+     *  @param hold_ms Tiempo de pulsacin para el evento HOLD (0: desactivado)
+     *  @param repeat_ms Periodo de los eventos REPEAT tras el HOLD (0: desactivado)
+     *  @param dtap_ms Tiempo mximo entre la liberacin y la segunda pulsacin de un DOUBLE_TAP (0: desactivado)
+     */
+    void setGestures(uint16_t elec_mask, uint16_t hold_ms, uint16_t repeat_ms, uint16_t dtap_ms);
+    
+  
+	/** addChord()
+     *  Registra un acorde (combinacin de electrodos pulsados a la vez)
+     *  @param elec_mask Mscara de bits de los electrodos del acorde (al menos dos)
+     *  @return ndice del acorde o -1 si no se puede registrar
+     */
+    int8_t addChord(uint16_t elec_mask);
+    
+  
+	/** setChordWindow()
+     *  Establece la ventana de tiempo en la que deben producirse las pulsaciones de un acorde
+     *  @param window_ms Ventana en ms
+     */
+    void setChordWindow(uint16_t window_ms){ _chord_ms = window_ms; }
+    
+  
+	/** addSlider()
+     *  Registra un slider o rueda formado por electrodos adyacentes
+     *  @param elec_mask Mscara de bits de los electrodos, ordenados por su ndice (al menos dos)
+     *  @param wheel True si es una rueda (el ltimo electrodo es adyacente al primero)
+     *  @param move_thr Desplazamiento mnimo para notificar una nueva posicin, en 1/SliderScale de electrodo
+     *  @return ndice del slider o -1 si no se puede registrar
+     */
+    int8_t addSlider(uint16_t elec_mask, bool wheel, uint16_t move_thr);
+    
+  
 	/** setPublicationBase()
      *  Registra el topic base a los que publicar el mdulo
      *  @param pub_topic Topic base para la publicacin
@@ -107,22 +391,146 @@ class TouchManager : public MPR121_CapTouch{
 
     
   protected:
-    static const uint32_t AntiGlitchTimeout = 30000;    /// Filtro anti-glitch de 30ms
+    friend class TouchGroup;
+    
+    static const uint32_t AntiGlitchTimeout = 30000;    /// Filtro anti-glitch por defecto de 30ms
+    static const uint32_t DebounceTickUs = 2000;        /// Resolucin de la rueda de temporizacin (2ms)
+    static const uint8_t  WheelSlots = 64;              /// Ranuras de la rueda (filtro mximo de 124ms)
+    static const uint8_t  IrqRingSize = 64;             /// Eventos de la cola de interrupciones (potencia de 2)
+    static const uint8_t  PubPoolSize = 4;              /// Buffers de publicacin
+    static const uint8_t  PubMsgLen = 24;               /// Tamao de cada buffer de publicacin
+    static const uint8_t  MaxChords = 4;                /// Nmero mximo de acordes
+    static const uint16_t ChordWindowMs = 100;          /// Ventana por defecto de las pulsaciones de un acorde
+    static const uint8_t  MaxSliders = 2;               /// Nmero mximo de sliders
+    static const uint32_t SliderTickUs = 20000;         /// Periodo de lectura de los sliders pulsados (20ms)
+    static const uint16_t SliderTouchDelta = 24;        /// Seal total mnima de un slider pulsado
+    static const uint8_t  PollVotes = 3;                /// Lecturas por defecto del voto por mayora
+    static const uint8_t  MaxPollVotes = 15;            /// Lecturas mximas del voto por mayora
+    static const uint32_t PollIdleMs = 200;             /// Tiempo por defecto sin pulsaciones para volver a interrupciones
+    
+    /** Registros del MPR121 ledos en los sliders */
+    static const uint8_t  RegFilteredData = 0x04;       /// Datos filtrados (10 bits, 2 bytes por electrodo)
+    static const uint8_t  RegBaseline = 0x1E;           /// Lnea base (8 bits ms significativos, 1 byte por electrodo)
+    static const uint8_t  SliderReadLen = (RegBaseline - RegFilteredData) + MPR121_CapTouch::SensorCount;
+    static const uint8_t  RegThresholds = 0x41;         /// Umbrales de pulsacin y liberacin (2 bytes por electrodo)
+    static const uint8_t  RegECR = 0x5E;                /// Registro de configuracin de electrodos (0 = modo Stop)
+    static const uint8_t  AdaptNoiseGain = 3;           /// Margen de los umbrales sobre el ruido medido
   
     /** Flags de tarea (asociados a la mquina de estados) */
     enum SigEventFlags{
         IrqFlag         = (1<<0),       /// Flag para notificar interrupcin del driver
-        AntiGlitchFlag  = (1<<1),       /// Flag para notificar interrupcin del filtro anti-glitch
+        AntiGlitchFlag  = (1<<1),       /// Flag para notificar un tick de la rueda del filtro anti-glitch
+        GestureFlag     = (1<<2),       /// Flag para notificar el vencimiento de la temporizacin de gestos
+        SliderFlag      = (1<<3),       /// Flag para notificar la lectura peridica de los sliders
+        StatsFlag       = (1<<4),       /// Flag para notificar la publicacin peridica de estadsticas
+        AdaptFlag       = (1<<5),       /// Flag para notificar el muestreo de la lnea base adaptativa
+        PollFlag        = (1<<6),       /// Flag para notificar una lectura del modo de sondeo
+    };
+    
+    /** Slider o rueda */
+    struct Slider_t{
+        uint16_t mask;                  /// Electrodos del slider
+        uint8_t elec[MPR121_CapTouch::SensorCount]; /// Electrodos en orden de posicin
+        uint8_t num;                    /// Nmero de electrodos
+        bool wheel;                     /// Flag de rueda (circular)
+        bool touched;                   /// Flag de slider pulsado
+        uint16_t move_thr;              /// Desplazamiento mnimo para notificar
+        uint16_t pos;                   /// ltima posicin notificada
+    };
+    
+    /** Evento de interrupcin registrado en la ISR */
+    struct IrqEvent_t{
+        uint32_t ts;                    /// Instante (us) de la interrupcin
+        uint32_t seq;                   /// Nmero de secuencia
+    };
+    
+    /** Estados de la temporizacin de gestos de un electrodo */
+    enum GestureState{
+        GestureIdle,                    /// Sin temporizacin
+        GestureHold,                    /// Pulsado, a la espera del HOLD
+        GestureRepeat,                  /// HOLD notificado, generando REPEAT
+    };
+    
+    /** Gestos de un electrodo */
+    struct Gesture_t{
+        uint32_t due;                   /// Instante (us) del siguiente evento temporizado
+        uint32_t touch_ts;              /// Instante de la ltima pulsacin
+        uint32_t release_ts;            /// Instante de la ltima liberacin
+        uint16_t hold_ms;               /// Tiempo de HOLD (0: desactivado)
+        uint16_t repeat_ms;             /// Periodo de REPEAT (0: desactivado)
+        uint16_t dtap_ms;               /// Ventana de DOUBLE_TAP (0: desactivado)
+        uint8_t state;                  /// Estado de la temporizacin (GestureState)
+        bool tap;                       /// Pulsacin corta previa, candidata a DOUBLE_TAP
     };
     
     Thread      _th;                    /// Manejador del thread
-    Ticker      _tick_glitch;           /// Ticker del filtro anti-glitch
+    Ticker      _tick_glitch;           /// Ticker de la rueda del filtro anti-glitch
+    Ticker      _tick_slider;           /// Ticker de lectura de los sliders pulsados
     uint32_t    _timeout;               /// Manejador de timming en la tarea
     char*       _pub_topic;             /// Topic base para la publicacin
-    char        _msg[8];                /// Mensaje a publicar
+    char*       _scan_topic;            /// Topic de publicacin por exploracin
+    uint32_t    _pub_pool[PubPoolSize][PubMsgLen / 4];  /// Buffers de publicacin (alineados para TouchScan)
+    uint32_t    _pub_head;              /// Buffers ocupados
+    uint32_t    _pub_tail;              /// Buffers liberados al finalizar su publicacin
+    uint32_t    _pub_drops;             /// Mensajes descartados por falta de buffers
+    PublishMode _pub_mode;              /// Modo de publicacin
+    uint16_t    _pub_mask;              /// ltima mscara publicada en modo exploracin
+    uint32_t    _scan_ts;               /// Instante de la interrupcin del ltimo cambio, en modo exploracin
+    uint32_t    _edge_ts[MPR121_CapTouch::SensorCount];    /// Instante de la interrupcin del ltimo flanco
+    uint32_t    _cb_ts[MPR121_CapTouch::SensorCount];      /// Fin de la callback del ltimo evento, en modo exploracin
+    LatencyStats _lat_stats;            /// Estadsticas de latencia
+    LatencyStats _lat_msg;              /// Copia de las estadsticas para su publicacin
+    char*       _stats_topic;           /// Topic de publicacin de estadsticas
+    Ticker      _tick_stats;            /// Ticker de publicacin de estadsticas
     Logger*     _debug;                 /// Canal de depuracin
-    uint16_t    _curr_sns;              /// Valor actual de los sensores
-    uint16_t    _sns;                   /// Valor de la medida en curso
+    uint16_t    _curr_sns;              /// Valor actual (filtrado) de los sensores
+    uint16_t    _raw_sns;               /// ltimo valor ledo del chip
+    uint16_t    _pending;               /// Electrodos con el filtro en curso
+    IrqEvent_t  _ring[IrqRingSize];     /// Cola de interrupciones
+    volatile uint32_t _ring_head;       /// Eventos insertados (slo escrito en ISR)
+    volatile uint32_t _ring_tail;       /// Eventos extrados (slo escrito en la tarea)
+    volatile uint32_t _irq_seq;         /// Nmero de secuencia de interrupcin (slo escrito en ISR)
+    volatile uint32_t _ring_overflows;  /// Eventos descartados (slo escrito en ISR)
+    IrqStats    _irq_stats;             /// Estadsticas de la cola de interrupciones
+    uint16_t    _wheel[WheelSlots];     /// Electrodos que vencen en cada ranura de la rueda
+    uint8_t     _wheel_pos;             /// Ranura en curso
+    volatile uint32_t _wheel_ticks;     /// Ticks generados (actualizado en ISR)
+    uint32_t    _wheel_served;          /// Ticks atendidos
+    uint8_t     _slot[MPR121_CapTouch::SensorCount];       /// Ranura de vencimiento de cada electrodo en filtrado
+    uint8_t     _debounce[MPR121_CapTouch::SensorCount];   /// Tiempo de filtro de cada electrodo, en ticks de la rueda
+    Gesture_t   _gest[MPR121_CapTouch::SensorCount];       /// Gestos de cada electrodo
+    Timeout     _tick_gesture;          /// Temporizacin del gesto ms prximo
+    uint16_t    _chord[MaxChords];      /// Electrodos de cada acorde
+    uint8_t     _num_chords;            /// Nmero de acordes registrados
+    uint16_t    _chord_ms;              /// Ventana de las pulsaciones de un acorde
+    uint8_t     _chord_active;          /// Mscara de acordes notificados y an pulsados
+    uint16_t    _chord_lock;            /// Electrodos de acordes activos (sin gestos propios)
+    Slider_t    _slider[MaxSliders];    /// Sliders registrados
+    uint8_t     _num_sliders;           /// Nmero de sliders
+    uint16_t    _slider_mask;           /// Electrodos de todos los sliders
+    bool        _slider_active;         /// Flag de lectura peridica de sliders en curso
+    I2C*        _i2c;                   /// Bus i2c para la lectura de los datos de los electrodos
+    PinName     _sda;                   /// Pines y direccin del chip
+    PinName     _scl;
+    uint8_t     _addr;
+    uint16_t    _elec_mask;             /// Electrodos habilitados
+    Ticker      _tick_adapt;            /// Ticker de la lnea base adaptativa
+    bool        _adapt_init;            /// Flag de umbrales iniciales ledos del chip
+    uint8_t     _thr_base[2 * MPR121_CapTouch::SensorCount];   /// Umbrales iniciales (pulsacin, liberacin)
+    uint8_t     _thr[2 * MPR121_CapTouch::SensorCount];        /// Umbrales en uso
+    BaselineInfo _adapt[MPR121_CapTouch::SensorCount];         /// Estado de la lnea base adaptativa
+    Ticker      _tick_poll;             /// Ticker del modo de sondeo
+    uint32_t    _poll_us;               /// Periodo de sondeo (0: desactivado)
+    uint8_t     _poll_votes;            /// Lecturas del voto por mayora
+    uint32_t    _poll_idle_us;          /// Tiempo sin pulsaciones para volver a interrupciones
+    bool        _polling;               /// Flag de modo sondeo en curso
+    volatile uint32_t _poll_ts;         /// Instante del ltimo tick de sondeo (escrito en ISR)
+    uint32_t    _poll_active_ts;        /// Instante de la ltima lectura con electrodos pulsados
+    uint16_t    _vote[MPR121_CapTouch::SensorCount];       /// ltimas lecturas de cada electrodo (1 bit por lectura)
+    PollStats   _poll_stats;            /// Estadsticas del modo de sondeo
+    TouchGroup* _group;                 /// Grupo que ejecuta este manager (0: thread propio o job externo)
+    uint8_t     _group_id;              /// ndice en el grupo
+    bool        _own_thread;            /// Flag de ejecucin en thread propio (no puede aadirse a un grupo)
     bool   _ready;                      /// Flag de estado disponible    
 
     TouchEventCallback _evt_cb;         /// Callback a invocar para la notificacin de eventos
@@ -134,16 +542,225 @@ class TouchManager : public MPR121_CapTouch{
     void task();
   
     
+	/** init()
+     *  Espera a que el chip est operativo y carga el estado inicial de los electrodos
+     */
+    void init();
+  
+    
+	/** busLock()
+     *  En un grupo, reserva el bus i2c compartido durante un acceso al chip. Las callbacks y publicaciones se realizan
+     *  con el bus libre
+     */
+    void busLock(){ if(_group){ _i2c->lock(); } }
+  
+    
+	/** busUnlock()
+     *  Libera el bus reservado con busLock()
+     */
+    void busUnlock(){ if(_group){ _i2c->unlock(); } }
+  
+    
+	/** chipTouched()
+     *  Lee del chip el estado de los electrodos, con el bus reservado si forma parte de un grupo
+     *  @return Mscara de electrodos activos
+     */
+    uint16_t chipTouched();
+  
+    
+	/** signal()
+     *  Notifica flags de tarea al thread propio o, si forma parte de un grupo, al thread del grupo
+     *  @param flags Flags a notificar
+     */
+    void signal(uint32_t flags);
+  
+    
 	/** onIrqCb()
      *  Callback invocada tras recibir un evento del chip en la lnea irq
      */
     void onIrqCb();        
   
     
+	/** irqDrain()
+     *  Extrae todos los eventos pendientes de la cola de interrupciones y los atiende con una nica lectura del chip
+     */
+    void irqDrain();        
+  
+    
 	/** isrTickCb()
-     *  Callback invocada tras la temporizacin del filtro antiglitch
+     *  Callback invocada en cada tick de la rueda del filtro antiglitch
      */
     void isrTickCb();        
+  
+    
+	/** isrPollCb()
+     *  Callback invocada en cada tick del modo de sondeo
+     */
+    void isrPollCb();        
+  
+    
+	/** pollStart()
+     *  Cambia a modo sondeo: descarta los filtros en curso e inicia el voto desde el estado notificado
+     */
+    void pollStart();        
+  
+    
+	/** pollStep()
+     *  Realiza una lectura de sondeo y vuelve a modo interrupcin si no hay pulsaciones durante el tiempo configurado
+     */
+    void pollStep();        
+  
+    
+	/** vote()
+     *  Procesa una lectura en modo sondeo: actualiza el voto de cada electrodo y notifica los cambios de la mayora
+     *  @param sns Valor ledo de los sensores
+     *  @param edges Electrodos con flanco respecto de la lectura anterior
+     *  @param ts Instante de la lectura
+     */
+    void vote(uint16_t sns, uint16_t edges, uint32_t ts);        
+  
+    
+	/** sample()
+     *  Procesa una lectura del chip: (re)inicia el filtro de los electrodos con flancos o los notifica directamente si
+     *  no tienen filtro
+     *  @param sns Valor ledo de los sensores
+     *  @param ts Instante de la interrupcin que origin la lectura
+     */
+    void sample(uint16_t sns, uint32_t ts);        
+  
+    
+	/** wheelStep()
+     *  Avanza la rueda los ticks generados y notifica los electrodos vencidos que mantienen su nuevo estado
+     */
+    void wheelStep();        
+  
+    
+	/** isrGestureCb()
+     *  Callback invocada al vencer la temporizacin de gestos
+     */
+    void isrGestureCb();        
+  
+    
+	/** gestureEdge()
+     *  Actualiza los gestos de un electrodo tras una pulsacin o liberacin filtrada
+     *  @param elec Electrodo
+     *  @param touched True si se ha pulsado, False si se ha liberado
+     */
+    void gestureEdge(uint8_t elec, bool touched);        
+  
+    
+	/** gestureStep()
+     *  Genera los eventos HOLD y REPEAT vencidos y rearma la temporizacin
+     */
+    void gestureStep();        
+  
+    
+	/** gestureArm()
+     *  Arma la temporizacin de gestos al vencimiento ms prximo, o la detiene si no hay ninguno
+     */
+    void gestureArm();        
+  
+    
+	/** isrSliderCb()
+     *  Callback invocada peridicamente para leer los sliders pulsados
+     */
+    void isrSliderCb();        
+  
+    
+	/** sliderArm()
+     *  Arranca la lectura peridica de los sliders si alguno de sus electrodos est pulsado
+     */
+    void sliderArm();        
+  
+    
+	/** sliderStep()
+     *  Lee los datos de los electrodos y actualiza la posicin de los sliders, deteniendo la lectura peridica si 
+     *  todos estn liberados
+     */
+    void sliderStep();        
+  
+    
+	/** sliderPosition()
+     *  Calcula la posicin de un slider a partir de la seal de sus electrodos
+     *  @param sl Slider
+     *  @param delta Seal de cada electrodo del chip
+     *  @param total Recibe la seal total del slider
+     *  @return Posicin en 1/SliderScale de electrodo
+     */
+    uint16_t sliderPosition(Slider_t* sl, const uint16_t* delta, uint32_t* total);        
+  
+    
+	/** pubAlloc()
+     *  Obtiene un buffer de publicacin libre. Los buffers se liberan en orden al finalizar su publicacin
+     *  @return Buffer o 0 si no hay ninguno libre
+     */
+    char* pubAlloc();        
+  
+    
+	/** publishScan()
+     *  Publica el estado de los electrodos si ha cambiado respecto del ltimo publicado (modo exploracin)
+     */
+    void publishScan();        
+  
+    
+	/** latencyUpdate()
+     *  Actualiza las estadsticas de una etapa
+     *  @param st Etapa
+     *  @param us Latencia medida
+     */
+    void latencyUpdate(LatencyStage* st, uint32_t us);        
+  
+    
+	/** isrStatsCb()
+     *  Callback invocada peridicamente para publicar las estadsticas
+     */
+    void isrStatsCb();        
+  
+    
+	/** publishStats()
+     *  Publica una copia de las estadsticas de latencia en $(pub_topic)/stats
+     */
+    void publishStats();        
+  
+    
+	/** readElectrodes()
+     *  Lee del chip los datos filtrados y la lnea base de todos los electrodos en una nica transaccin
+     *  @param filtered Recibe los datos filtrados (10 bits)
+     *  @param baseline Recibe la lnea base (8 bits ms significativos)
+     *  @return True si la lectura es correcta
+     */
+    bool readElectrodes(uint16_t* filtered, uint8_t* baseline);        
+  
+    
+	/** writeRegs()
+     *  Escribe un bloque de registros consecutivos del chip en una nica transaccin
+     *  @param reg Primer registro
+     *  @param data Datos a escribir
+     *  @param len Nmero de registros
+     *  @return True si la escritura es correcta
+     */
+    bool writeRegs(uint8_t reg, const uint8_t* data, uint8_t len);        
+  
+    
+	/** isrAdaptCb()
+     *  Callback invocada peridicamente para el muestreo de la lnea base adaptativa
+     */
+    void isrAdaptCb();        
+  
+    
+	/** adaptStep()
+     *  Muestrea la lnea base y los datos filtrados, y reajusta umbrales y lnea base si es necesario
+     */
+    void adaptStep();        
+  
+    
+	/** notify()
+     *  Notifica un evento de un electrodo mediante la callback instalada y en el topic de publicacin
+     *  @param elec Electrodo
+     *  @param evt Evento
+     *  @param pos Posicin (slo SliderEvent)
+     */
+    void notify(uint8_t elec, TouchEvent evt, uint16_t pos = 0);        
     
 
 	/** publicationCb()
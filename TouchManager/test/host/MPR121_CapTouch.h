@@ -0,0 +1,64 @@
+/*
+ * MPR121_CapTouch.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Modelo del driver MPR121_CapTouch para el banco de pruebas bench_TouchManager. Conecta un chip simulado
+ *  (SimMPR121.h) al bus i2c simulado y lee su estado de pulsacin a travs de l, de forma que cada lectura consume
+ *  el tiempo de bus correspondiente. La lnea irq la activa el banco de pruebas con simIrq(), que invoca la callback
+ *  instalada en el contexto de interrupcin simulado.
+ */
+
+#ifndef __MPR121_CapTouch__H
+#define __MPR121_CapTouch__H
+
+#include "mbed.h"
+#include "SimMPR121.h"
+
+
+class MPR121_CapTouch{
+public:
+    static const uint8_t SensorCount = 12;
+    static const uint8_t DefaultAddress = 0x5A;
+
+    enum State{ Stopped, Ready };
+
+    MPR121_CapTouch(PinName sda, PinName scl, PinName irq, uint16_t elec_mask, uint8_t addr = DefaultAddress) : _i2c(sda, scl){
+        _addr = (addr << 1);
+        _bus = SimI2CBus::get(sda, scl);
+        _bus->attach(_addr);
+        _i2c.frequency(400000);
+    }
+
+    State getState(){ return Ready; }
+
+    uint16_t touched(){
+        char reg = SimMPR121::RegTouchStatus;
+        char buf[2] = {0, 0};
+        if(_i2c.write(_addr, &reg, 1, true) != 0 || _i2c.read(_addr, buf, 2) != 0){
+            return 0;
+        }
+        return ((uint8_t)buf[0] | ((uint8_t)buf[1] << 8)) & 0x0fff;
+    }
+
+    void attachIrqCb(Callback<void()> cb){ _irq_cb = cb; }
+
+    /** Chip simulado asociado a este driver (slo en el banco de pruebas) */
+    SimMPR121* sim(){ return _bus->chip(_addr); }
+
+    /** Activa la lnea irq (slo en el banco de pruebas) */
+    void simIrq(){
+        if(_irq_cb){
+            _irq_cb();
+        }
+    }
+
+private:
+    I2C _i2c;
+    SimI2CBus* _bus;
+    uint8_t _addr;
+    Callback<void()> _irq_cb;
+};
+
+#endif
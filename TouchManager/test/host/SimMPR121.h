@@ -0,0 +1,230 @@
+/*
+ * SimMPR121.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Modelo de bus i2c y de chip MPR121 para el banco de pruebas bench_TouchManager.
+ *
+ *  SimI2CBus modela el tiempo de cada transaccin a partir de la frecuencia del bus: START (o START repetido) y STOP
+ *  cuentan 1 bit cada uno, y cada byte (direccin incluida) 9 bits (8 + ACK), por lo que a 400kHz un byte son 22.5us.
+ *  El tiempo simulado (SimClock) avanza lo que dura cada transaccin, y se acumulan las estadsticas de ocupacin.
+ *
+ *  SimMPR121 modela el banco de registros del chip (con auto-incremento del puntero) que utilizan el driver y
+ *  TouchManager: estado de pulsacin (0x00), datos filtrados (0x04), lnea base (0x1E), umbrales (0x41) y ECR (0x5E).
+ *  La seal de cada electrodo (base - filtrado) la fija el banco de pruebas, bien directamente con la mscara de
+ *  electrodos pulsados (setTouched), bien con la seal de cada electrodo (setSignal), en cuyo caso el estado de
+ *  pulsacin se obtiene de los umbrales con histresis, como en el chip. Las escrituras en los registros de
+ *  configuracin fuera del modo Stop (ECR = 0) se ignoran, como en el chip, y se contabilizan.
+ */
+
+#ifndef __SimMPR121__H
+#define __SimMPR121__H
+
+#include "mbed.h"
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <mutex>
+
+
+//------------------------------------------------------------------------------------
+class SimMPR121{
+public:
+    static const uint8_t RegTouchStatus = 0x00;
+    static const uint8_t RegFilteredData = 0x04;
+    static const uint8_t RegBaseline = 0x1E;
+    static const uint8_t RegThresholds = 0x41;
+    static const uint8_t RegECR = 0x5E;
+    static const uint8_t RegConfigFirst = 0x2B;         /// Primer registro que slo se puede escribir en modo Stop
+    static const uint8_t Electrodes = 12;
+    static const uint16_t DefaultBaseline = 720;        /// Lnea base inicial (10 bits)
+    static const uint16_t TouchDelta = 40;              /// Seal de un electrodo pulsado con setTouched()
+
+    SimMPR121(){
+        memset(_regs, 0, sizeof(_regs));
+        memset(_signal, 0, sizeof(_signal));
+        // configuracin tras la inicializacin del driver: umbrales 12/6 y 12 electrodos en marcha (CL = 10)
+        for(uint8_t i = 0; i < Electrodes; i++){
+            _regs[RegBaseline + i] = (uint8_t)(DefaultBaseline >> 2);
+            _regs[RegThresholds + (2 * i)] = 12;
+            _regs[RegThresholds + (2 * i) + 1] = 6;
+        }
+        _regs[RegECR] = 0x80 | Electrodes;
+        _ptr = 0;
+        _stop_violations = 0;
+        update();
+    }
+
+    void setPointer(uint8_t reg){ _ptr = reg; }
+    void writeByte(uint8_t data){
+        if(_ptr >= RegConfigFirst && _ptr != RegECR && _regs[RegECR] != 0){
+            _stop_violations++;
+        }
+        else{
+            _regs[_ptr] = data;
+        }
+        _ptr++;
+    }
+    uint8_t readByte(){ return _regs[_ptr++]; }
+
+    /** Fija los electrodos pulsados, con una seal TouchDelta en cada uno */
+    void setTouched(uint16_t mask){
+        for(uint8_t i = 0; i < Electrodes; i++){
+            _signal[i] = ((mask & (1 << i)) != 0)? TouchDelta : 0;
+        }
+        _status = mask & 0x0fff;
+        update();
+    }
+
+    /** Fija la seal de un electrodo, actualizando su estado segn los umbrales */
+    void setSignal(uint8_t elec, uint16_t signal){
+        _signal[elec] = signal;
+        if(signal >= _regs[RegThresholds + (2 * elec)]){
+            _status |= (1 << elec);
+        }
+        else if(signal <= _regs[RegThresholds + (2 * elec) + 1]){
+            _status &= ~(1 << elec);
+        }
+        update();
+    }
+
+    uint16_t status(){ return _status; }
+    uint8_t touchThreshold(uint8_t elec){ return _regs[RegThresholds + (2 * elec)]; }
+    uint32_t stopViolations(){ return _stop_violations; }
+
+private:
+    /** Actualiza los registros de estado y datos filtrados a partir de la seal y la lnea base actual */
+    void update(){
+        _regs[RegTouchStatus] = _status & 0xff;
+        _regs[RegTouchStatus + 1] = (_status >> 8) & 0x0f;
+        for(uint8_t i = 0; i < Electrodes; i++){
+            int32_t base = (int32_t)_regs[RegBaseline + i] << 2;
+            int32_t filtered = base - _signal[i];
+            filtered = (filtered < 0)? 0 : filtered;
+            _regs[RegFilteredData + (2 * i)] = filtered & 0xff;
+            _regs[RegFilteredData + (2 * i) + 1] = (filtered >> 8) & 0x03;
+        }
+    }
+    uint8_t _regs[256];
+    uint8_t _ptr;
+    uint16_t _status = 0;
+    uint16_t _signal[Electrodes];
+    uint32_t _stop_violations;
+};
+
+
+//------------------------------------------------------------------------------------
+class SimI2CBus{
+public:
+    /** Estadsticas de uso del bus */
+    struct Stats{
+        uint64_t transactions;      /// Transacciones finalizadas con STOP
+        uint64_t writes;            /// Llamadas a write/read
+        uint64_t bytes;             /// Bytes transferidos (incluida la direccin)
+        uint64_t busy_ns;           /// Tiempo de ocupacin
+        uint64_t nacks;             /// Direcciones sin respuesta
+    };
+
+    /** Obtiene el bus asociado a unos pines, crendolo si no existe */
+    static SimI2CBus* get(int sda, int scl){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        std::map<int, SimI2CBus*>& b = buses();
+        if(b.find(sda) == b.end()){
+            b[sda] = new SimI2CBus(sda);
+        }
+        return b[sda];
+    }
+
+    static std::recursive_mutex& mutex(){ static std::recursive_mutex m; return m; }
+    static std::map<int, SimI2CBus*>& buses(){ static std::map<int, SimI2CBus*> b; return b; }
+
+    /** Conecta un chip en la direccin (8 bits) indicada */
+    void attach(uint8_t addr){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        if(_chips.find(addr) == _chips.end()){
+            _chips[addr] = new SimMPR121();
+        }
+    }
+    SimMPR121* chip(uint8_t addr){
+        std::map<uint8_t, SimMPR121*>::iterator it = _chips.find(addr & 0xfe);
+        return (it == _chips.end())? 0 : it->second;
+    }
+    int id(){ return _id; }
+    Stats& stats(){ return _stats; }
+    void resetStats(){ memset(&_stats, 0, sizeof(Stats)); }
+
+    int write(int address, const char* data, int length, bool repeated, int hz){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        SimMPR121* c = chip(address);
+        // START (o repetido) + direccin
+        uint32_t bits = 1 + 9;
+        if(c){
+            if(length > 0){
+                c->setPointer(data[0]);
+            }
+            for(int i = 1; i < length; i++){
+                c->writeByte(data[i]);
+            }
+            bits += 9 * length;
+        }
+        return finish(c, bits, length, repeated, hz);
+    }
+
+    int read(int address, char* data, int length, bool repeated, int hz){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        SimMPR121* c = chip(address);
+        uint32_t bits = 1 + 9;
+        if(c){
+            for(int i = 0; i < length; i++){
+                data[i] = c->readByte();
+            }
+            bits += 9 * length;
+        }
+        return finish(c, bits, length, repeated, hz);
+    }
+
+private:
+    SimI2CBus(int id) : _id(id), _frac_ns(0){ memset(&_stats, 0, sizeof(Stats)); }
+
+    int finish(SimMPR121* c, uint32_t bits, int length, bool repeated, int hz){
+        // sin respuesta a la direccin, el maestro genera STOP
+        if(!c){
+            repeated = false;
+            _stats.nacks++;
+        }
+        if(!repeated){
+            bits += 1;
+            _stats.transactions++;
+        }
+        _stats.writes++;
+        _stats.bytes += 1 + ((c)? length : 0);
+        uint64_t ns = ((uint64_t)bits * 1000000000ULL) / hz;
+        _stats.busy_ns += ns;
+        _frac_ns += ns;
+        SimClock::advance(_frac_ns / 1000);
+        _frac_ns %= 1000;
+        return (c)? 0 : 1;
+    }
+
+    int _id;
+    uint64_t _frac_ns;
+    Stats _stats;
+    std::map<uint8_t, SimMPR121*> _chips;
+};
+
+
+//------------------------------------------------------------------------------------
+//--- I2C ----------------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+inline I2C::I2C(PinName sda, PinName scl) : _bus(SimI2CBus::get(sda, scl)), _hz(100000){}
+inline int I2C::write(int address, const char* data, int length, bool repeated){
+    return _bus->write(address, data, length, repeated, _hz);
+}
+inline int I2C::read(int address, char* data, int length, bool repeated){
+    return _bus->read(address, data, length, repeated, _hz);
+}
+
+#endif
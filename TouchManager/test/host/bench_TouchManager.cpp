@@ -0,0 +1,740 @@
+/*
+ * bench_TouchManager.cpp (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Banco de pruebas de TouchManager en PC (Linux), sin hardware. Utiliza los sustitutos comunes de test/host (tiempo
+ *  simulado, ticker disparados desde el hilo principal) y los de este directorio: bus i2c con modelo de tiempos y
+ *  chips MPR121 simulados cuyo estado de pulsacin fija el banco de pruebas antes de activar su lnea irq.
+ *
+ *  Compilacin (desde la raz del repositorio):
+ *      g++ -std=gnu++11 -O2 -pthread -ITouchManager/test/host -Itest/host -ITouchManager \
+ *          TouchManager/test/host/bench_TouchManager.cpp TouchManager/TouchManager.cpp TouchManager/TouchGroup.cpp \
+ *          -o bench_TouchManager
+ *
+ *  Uso:
+ *      bench_TouchManager [escenario] [-o eventos.csv]
+ *      bench_TouchManager replay -r traza.csv [-e esperados.csv] [-w tolerancia_us] [-o eventos.csv]
+ *
+ *  Sin escenario se ejecutan todos los sintticos, cada uno en un proceso independiente. Con -o se vuelcan los eventos
+ *  emitidos (t_us,elec,evt,pos, instantes relativos al inicio de las medidas) del escenario indicado. Escenarios:
+ *      press       Pulsaciones limpias en un electrodo
+ *      bounce      Pulsacin y liberacin con rebotes ms cortos que el filtro
+ *      multi       Pulsaciones solapadas en dos electrodos con distinto tiempo de filtro
+ *      gestures    HOLD, REPEAT, DOUBLE_TAP y acorde
+ *      burst       Rfaga de interrupciones sin dar paso a la tarea, atendida sin descartes y con una lectura por lote
+ *      slider      Desplazamiento de un dedo a lo largo de un slider de 4 electrodos
+ *      group       Dos chips en un mismo bus atendidos por un TouchGroup
+ *      poll        Modo de sondeo a 1kHz con voto por mayora y vuelta a interrupciones en reposo
+ *      replay      Reproduce una traza grabada: lneas t_us,mscara (mscara en hexadecimal 0x... o decimal). Con -e
+ *                  compara los eventos emitidos con los esperados (lneas t_us,elec,evt), en orden y con la tolerancia
+ *                  indicada (2000us por defecto). Las lneas que empiezan por '#' se ignoran.
+ *
+ *  Para cada escenario se informa del tiempo de cpu de la tarea por activacin y por evento emitido (en el PC, til
+ *  para comparar versiones), la latencia de los eventos de pulsacin desde la interrupcin hasta su emisin (en tiempo
+ *  simulado), la ocupacin del bus y las comprobaciones del flujo de eventos. El proceso devuelve 1 si alguna
+ *  comprobacin falla.
+ */
+
+#include "mbed.h"
+#include "MQLib.h"
+#include "TouchManager.h"
+#include "TouchGroup.h"
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+
+
+// **************************************************************************
+// *********** DEFINICIONES *************************************************
+// **************************************************************************
+
+/** Evento emitido por un manager */
+struct BenchEvt{
+    uint64_t t;
+    uint8_t chip;
+    uint8_t elec;
+    uint8_t evt;
+    uint16_t pos;
+    uint32_t ts;
+};
+
+/** Evento esperado, en una ventana de tiempo */
+struct BenchExpect{
+    uint8_t elec;
+    uint8_t evt;
+    uint64_t t_from;
+    uint64_t t_to;
+};
+
+/** Paso de una traza: mscara de electrodos pulsados a partir del instante t */
+struct BenchStep{
+    uint64_t t;
+    uint16_t mask;
+};
+
+/** Tolerancia por defecto sobre el tiempo de filtro: un tick de la rueda ms las lecturas del chip */
+static const uint32_t Slack = 3000;
+
+/** Tiempo de filtro por defecto de TouchManager */
+static const uint32_t Debounce = 30000;
+
+
+// **************************************************************************
+// *********** OBJETOS  *****************************************************
+// **************************************************************************
+
+static TouchManager* touchman;
+static std::vector<BenchEvt> events;
+static const char* events_file = 0;
+static const char* trace_file = 0;
+static const char* expected_file = 0;
+static uint32_t tolerance = 2000;
+static uint32_t publications = 0;
+static uint64_t t_base = 0;
+static int failures = 0;
+
+
+// **************************************************************************
+// *********** UTILIDADES ***************************************************
+// **************************************************************************
+
+//------------------------------------------------------------------------------------
+static uint64_t now(){
+    return SimClock::now();
+}
+
+
+//------------------------------------------------------------------------------------
+static void check(bool cond, const char* format, ...){
+    if(cond){
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    printf("    FALLO: ");
+    vprintf(format, args);
+    printf("\r\n");
+    va_end(args);
+    failures++;
+}
+
+
+//------------------------------------------------------------------------------------
+static uint64_t percentile(std::vector<uint64_t> v, double p){
+    if(v.empty()){
+        return 0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[(size_t)(p * (v.size() - 1))];
+}
+
+
+//------------------------------------------------------------------------------------
+/** Callbacks de eventos, una por chip */
+static void record(uint8_t chip, TouchManager::TouchMsg* msg){
+    events.push_back({now(), chip, msg->elec, (uint8_t)msg->evt, msg->pos, msg->ts});
+}
+static void onEvent(TouchManager::TouchMsg* msg){ record(0, msg); }
+static void onEventChip1(TouchManager::TouchMsg* msg){ record(1, msg); }
+
+
+//------------------------------------------------------------------------------------
+static void onPublication(const char* topic, void* msg, uint16_t msg_len){
+    publications++;
+}
+
+
+//------------------------------------------------------------------------------------
+/** Avanza el tiempo simulado hasta t, disparando los ticker vencidos y esperando a que la tarea los atienda */
+static void runUntil(uint64_t t){
+    for(;;){
+        Thread::settleAll();
+        uint64_t due = Ticker::nextDue();
+        if(due > t){
+            break;
+        }
+        if(now() < due){
+            SimClock::now() = due;
+        }
+        Ticker::fire(now());
+    }
+    Thread::settleAll();
+    if(now() < t){
+        SimClock::now() = t;
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+static void createManager(){
+    touchman = new TouchManager(PB_7, PB_6, PB_1, 0x0fff);
+    touchman->attachCallback(callback(onEvent));
+    touchman->setPublicationBase("touch");
+    MQ::MQClient::subscribe("touch#", new MQ::SubscribeCallback(onPublication));
+    runUntil(now() + 1000);
+}
+
+
+//------------------------------------------------------------------------------------
+/** En el instante t fija los electrodos pulsados del chip y activa su lnea irq */
+static void touch(TouchManager* tm, uint64_t t, uint16_t mask){
+    runUntil(t);
+    tm->sim()->setTouched(mask);
+    tm->simIrq();
+}
+
+
+//------------------------------------------------------------------------------------
+static void replay(TouchManager* tm, const std::vector<BenchStep>& trace){
+    for(size_t i = 0; i < trace.size(); i++){
+        touch(tm, trace[i].t, trace[i].mask);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+static void resetMeasures(){
+    Thread::takeAllWakes();
+    events.clear();
+    publications = 0;
+    t_base = now();
+    for(std::map<int, SimI2CBus*>::iterator it = SimI2CBus::buses().begin(); it != SimI2CBus::buses().end(); it++){
+        it->second->resetStats();
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+/** Informe comn: cpu por activacin y por evento, latencia de los eventos de pulsacin y ocupacin del bus */
+static void report(uint64_t t0){
+    std::vector<Thread::Wake> wakes = Thread::takeAllWakes();
+    std::vector<uint64_t> cpu;
+    uint64_t cpu_total = 0;
+    for(size_t i = 0; i < wakes.size(); i++){
+        if(wakes[i].at_us >= t0){
+            cpu.push_back(wakes[i].cpu_ns);
+            cpu_total += wakes[i].cpu_ns;
+        }
+    }
+    uint64_t elapsed = now() - t0;
+    printf("    tarea: %u activaciones, cpu/activacin p50=%.1fus p99=%.1fus max=%.1fus (host)\r\n",
+            (unsigned)cpu.size(), percentile(cpu, 0.5) / 1000.0, percentile(cpu, 0.99) / 1000.0, percentile(cpu, 1.0) / 1000.0);
+    printf("    eventos: %u, cpu/evento %.1fus (host), publicaciones %u\r\n", (unsigned)events.size(),
+            (events.empty())? 0.0 : (cpu_total / 1000.0) / events.size(), publications);
+
+    // latencia interrupcin -> emisin de pulsaciones, liberaciones y dobles pulsaciones (incluye el filtro)
+    std::vector<uint64_t> lat;
+    for(size_t i = 0; i < events.size(); i++){
+        uint8_t evt = events[i].evt;
+        if(evt == TouchManager::TouchedEvent || evt == TouchManager::ReleasedEvent || evt == TouchManager::DoubleTapEvent){
+            lat.push_back(events[i].t - events[i].ts);
+        }
+    }
+    printf("    latencia irq->evento p50=%lluus p99=%lluus max=%lluus (simulado)\r\n", (unsigned long long)percentile(lat, 0.5),
+            (unsigned long long)percentile(lat, 0.99), (unsigned long long)percentile(lat, 1.0));
+    for(std::map<int, SimI2CBus*>::iterator it = SimI2CBus::buses().begin(); it != SimI2CBus::buses().end(); it++){
+        SimI2CBus::Stats& s = it->second->stats();
+        printf("    bus %d: %llu transacciones, %llu bytes, ocupacin %.2f%%, nacks %llu\r\n", it->first,
+                (unsigned long long)s.transactions, (unsigned long long)s.bytes, (100.0 * s.busy_ns) / (elapsed * 1000.0),
+                (unsigned long long)s.nacks);
+    }
+    if(touchman){
+        TouchManager::LatencyStats ls;
+        touchman->getLatencyStats(&ls);
+        TouchManager::IrqStats is;
+        touchman->getIrqStats(&is);
+        printf("    TouchManager: filtro max=%uus callback max=%uus total max=%uus, irqs=%u overflows=%u lote max=%u\r\n",
+                ls.debounce.max_us, ls.callback.max_us, ls.total.max_us, is.irqs, is.overflows, is.max_batch);
+    }
+}
+
+
+//------------------------------------------------------------------------------------
+static void dumpEvents(){
+    if(!events_file){
+        return;
+    }
+    FILE* fd = fopen(events_file, "w");
+    if(!fd){
+        return;
+    }
+    fprintf(fd, "t_us,elec,evt,pos\n");
+    for(size_t i = 0; i < events.size(); i++){
+        fprintf(fd, "%llu,%u,%u,%u\n", (unsigned long long)(events[i].t - t_base), events[i].elec, events[i].evt, events[i].pos);
+    }
+    fclose(fd);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Compara, en orden, los eventos emitidos de un chip (opcionalmente slo de un tipo) con los esperados */
+static void expect(const std::vector<BenchExpect>& exp, uint8_t chip = 0, int only_evt = -1){
+    std::vector<BenchEvt> got;
+    for(size_t i = 0; i < events.size(); i++){
+        if(events[i].chip == chip && (only_evt < 0 || events[i].evt == only_evt)){
+            got.push_back(events[i]);
+        }
+    }
+    size_t n = std::max(got.size(), exp.size());
+    uint32_t errors = 0;
+    for(size_t i = 0; i < n; i++){
+        if(i >= got.size()){
+            printf("    falta   #%u: elec=%u evt=%u en [%llu, %llu]\r\n", (unsigned)i, exp[i].elec, exp[i].evt,
+                    (unsigned long long)exp[i].t_from, (unsigned long long)exp[i].t_to);
+            errors++;
+        }
+        else if(i >= exp.size()){
+            printf("    sobra   #%u: elec=%u evt=%u t=%llu\r\n", (unsigned)i, got[i].elec, got[i].evt, (unsigned long long)got[i].t);
+            errors++;
+        }
+        else if(got[i].elec != exp[i].elec || got[i].evt != exp[i].evt || got[i].t < exp[i].t_from || got[i].t > exp[i].t_to){
+            printf("    difiere #%u: elec=%u evt=%u t=%llu, esperado elec=%u evt=%u en [%llu, %llu]\r\n", (unsigned)i,
+                    got[i].elec, got[i].evt, (unsigned long long)got[i].t, exp[i].elec, exp[i].evt,
+                    (unsigned long long)exp[i].t_from, (unsigned long long)exp[i].t_to);
+            errors++;
+        }
+    }
+    printf("    chip %u: %u eventos, esperados %u, discrepancias %u\r\n", chip, (unsigned)got.size(), (unsigned)exp.size(), errors);
+    check(errors == 0, "el flujo de eventos del chip %u no coincide con el esperado", chip);
+}
+
+
+//------------------------------------------------------------------------------------
+/** Evento esperado a 'delay' us del instante t, con la tolerancia indicada */
+static BenchExpect at(uint64_t t, uint32_t delay, uint8_t elec, uint8_t evt, uint32_t slack = Slack){
+    return {elec, evt, t + delay, t + delay + slack};
+}
+
+
+//------------------------------------------------------------------------------------
+/** Lee un fichero csv de enteros (mscaras en hexadecimal 0x... o decimal), ignorando cabeceras y comentarios */
+static std::vector<std::vector<uint64_t> > readCsv(const char* file){
+    std::vector<std::vector<uint64_t> > rows;
+    FILE* fd = fopen(file, "r");
+    if(!fd){
+        printf("    no se puede abrir %s\r\n", file);
+        return rows;
+    }
+    char line[128];
+    while(fgets(line, sizeof(line), fd)){
+        if(line[0] == '#' || line[0] < '0' || line[0] > '9'){
+            continue;
+        }
+        std::vector<uint64_t> row;
+        char* p = line;
+        char* end;
+        for(;;){
+            uint64_t v = strtoull(p, &end, 0);
+            if(end == p){
+                break;
+            }
+            row.push_back(v);
+            p = (*end == ',')? (end + 1) : end;
+        }
+        rows.push_back(row);
+    }
+    fclose(fd);
+    return rows;
+}
+
+
+// **************************************************************************
+// *********** ESCENARIOS ***************************************************
+// **************************************************************************
+
+
+//------------------------------------------------------------------------------------
+static void scenarioPress(){
+    createManager();
+    resetMeasures();
+    uint64_t t0 = now();
+    std::vector<BenchExpect> exp;
+    for(uint8_t i = 0; i < 3; i++){
+        uint64_t t = t0 + (i * 200000);
+        touch(touchman, t, 0x001);
+        touch(touchman, t + 100000, 0x000);
+        exp.push_back(at(t, Debounce, 0, TouchManager::TouchedEvent));
+        exp.push_back(at(t + 100000, Debounce, 0, TouchManager::ReleasedEvent));
+    }
+    // flancos de dos electrodos en una misma lectura: ambos se confirman en el mismo tick de la rueda
+    uint64_t t = t0 + 600000;
+    touch(touchman, t, 0x003);
+    touch(touchman, t + 100000, 0x000);
+    exp.push_back(at(t, Debounce, 0, TouchManager::TouchedEvent, 1000));
+    exp.push_back(at(t, Debounce, 1, TouchManager::TouchedEvent, 1000));
+    exp.push_back(at(t + 100000, Debounce, 0, TouchManager::ReleasedEvent, 1000));
+    exp.push_back(at(t + 100000, Debounce, 1, TouchManager::ReleasedEvent, 1000));
+    runUntil(now() + 100000);
+    report(t0);
+    expect(exp);
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioBounce(){
+    createManager();
+    resetMeasures();
+    uint64_t t0 = now();
+    // 5 rebotes de 3ms hasta quedar pulsado, 100ms pulsado y 5 rebotes hasta quedar liberado
+    uint64_t t = t0;
+    for(uint8_t i = 0; i < 5; i++, t += 3000){
+        touch(touchman, t, (i & 1)? 0x000 : 0x002);
+    }
+    uint64_t t_touch = t - 3000;
+    t += 100000;
+    for(uint8_t i = 0; i < 5; i++, t += 3000){
+        touch(touchman, t, (i & 1)? 0x002 : 0x000);
+    }
+    uint64_t t_release = t - 3000;
+    runUntil(now() + 100000);
+    report(t0);
+    std::vector<BenchExpect> exp;
+    exp.push_back(at(t_touch, Debounce, 1, TouchManager::TouchedEvent));
+    exp.push_back(at(t_release, Debounce, 1, TouchManager::ReleasedEvent));
+    expect(exp);
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioMulti(){
+    static const uint32_t ShortDebounce = 10000;
+    createManager();
+    touchman->setDebounce(0x008, ShortDebounce);
+    resetMeasures();
+    uint64_t t0 = now();
+    // e2 (30ms) y e3 (10ms) solapados: cada uno se confirma con su propio filtro
+    touch(touchman, t0, 0x004);
+    touch(touchman, t0 + 4000, 0x00c);
+    touch(touchman, t0 + 50000, 0x008);
+    touch(touchman, t0 + 80000, 0x000);
+    runUntil(now() + 100000);
+    report(t0);
+    std::vector<BenchExpect> exp;
+    exp.push_back(at(t0 + 4000, ShortDebounce, 3, TouchManager::TouchedEvent));
+    exp.push_back(at(t0, Debounce, 2, TouchManager::TouchedEvent));
+    exp.push_back(at(t0 + 50000, Debounce, 2, TouchManager::ReleasedEvent));
+    exp.push_back(at(t0 + 80000, ShortDebounce, 3, TouchManager::ReleasedEvent));
+    expect(exp);
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioGestures(){
+    static const uint16_t HoldMs = 300;
+    static const uint16_t RepeatMs = 100;
+    static const uint16_t DoubleTapMs = 250;
+    createManager();
+    touchman->setGestures(0x001, HoldMs, RepeatMs, DoubleTapMs);
+    touchman->addChord(0x030);
+    resetMeasures();
+    uint64_t t0 = now();
+    std::vector<BenchExpect> exp;
+    // pulsacin larga: HOLD y un REPEAT antes de la liberacin
+    touch(touchman, t0, 0x001);
+    touch(touchman, t0 + 450000, 0x000);
+    exp.push_back(at(t0, Debounce, 0, TouchManager::TouchedEvent));
+    exp.push_back(at(t0, Debounce + (HoldMs * 1000), 0, TouchManager::HoldEvent));
+    exp.push_back(at(t0, Debounce + ((HoldMs + RepeatMs) * 1000), 0, TouchManager::RepeatEvent));
+    exp.push_back(at(t0 + 450000, Debounce, 0, TouchManager::ReleasedEvent));
+    // doble pulsacin: dos pulsaciones cortas separadas menos de DoubleTapMs
+    uint64_t t1 = t0 + 600000;
+    touch(touchman, t1, 0x001);
+    touch(touchman, t1 + 50000, 0x000);
+    touch(touchman, t1 + 150000, 0x001);
+    touch(touchman, t1 + 200000, 0x000);
+    exp.push_back(at(t1, Debounce, 0, TouchManager::TouchedEvent));
+    exp.push_back(at(t1 + 50000, Debounce, 0, TouchManager::ReleasedEvent));
+    exp.push_back(at(t1 + 150000, Debounce, 0, TouchManager::TouchedEvent));
+    exp.push_back(at(t1 + 150000, Debounce, 0, TouchManager::DoubleTapEvent));
+    exp.push_back(at(t1 + 200000, Debounce, 0, TouchManager::ReleasedEvent));
+    // acorde e4+e5, pulsados con 20ms de diferencia
+    uint64_t t2 = t1 + 500000;
+    touch(touchman, t2, 0x010);
+    touch(touchman, t2 + 20000, 0x030);
+    touch(touchman, t2 + 200000, 0x000);
+    exp.push_back(at(t2, Debounce, 4, TouchManager::TouchedEvent));
+    exp.push_back(at(t2 + 20000, Debounce, 5, TouchManager::TouchedEvent));
+    exp.push_back(at(t2 + 20000, Debounce, 0, TouchManager::ChordEvent));
+    exp.push_back(at(t2 + 200000, Debounce, 4, TouchManager::ReleasedEvent));
+    exp.push_back(at(t2 + 200000, Debounce, 5, TouchManager::ReleasedEvent));
+    runUntil(now() + 500000);
+    report(t0);
+    expect(exp);
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioBurst(){
+    static const uint32_t Irqs = 40;
+    createManager();
+    TouchManager::IrqStats before;
+    touchman->getIrqStats(&before);
+    resetMeasures();
+    uint64_t t0 = now();
+    // rfaga de interrupciones sin esperar a la tarea, terminando con e6 pulsado
+    for(uint32_t i = 0; i < Irqs; i++){
+        touchman->sim()->setTouched((i & 1)? 0x040 : 0x000);
+        touchman->simIrq();
+    }
+    uint64_t t_end = now();
+    touch(touchman, t_end + 100000, 0x000);
+    runUntil(now() + 100000);
+    report(t0);
+    TouchManager::IrqStats is;
+    touchman->getIrqStats(&is);
+    uint32_t irqs = is.irqs - before.irqs;
+    uint32_t handled = (is.drained - before.drained) + (is.overflows - before.overflows);
+    uint32_t reads = is.batches - before.batches;
+    printf("    irqs: %u, extradas %u, descartadas %u, lecturas del chip %u\r\n", irqs, is.drained - before.drained,
+            is.overflows - before.overflows, reads);
+    check(irqs == Irqs + 1, "interrupciones no registradas");
+    check(handled == irqs, "interrupciones perdidas sin contabilizar");
+    check(is.overflows == before.overflows, "interrupciones descartadas por cola llena");
+    // el estado final de la rfaga se notifica una nica vez, aunque se hayan descartado interrupciones
+    std::vector<BenchExpect> exp;
+    exp.push_back({6, TouchManager::TouchedEvent, t0 + Debounce, t_end + Debounce + Slack});
+    exp.push_back(at(t_end + 100000, Debounce, 6, TouchManager::ReleasedEvent));
+    expect(exp);
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioSlider(){
+    static const uint32_t StepUs = 10000;
+    static const uint8_t Steps = 31;
+    createManager();
+    touchman->addSlider(0x0f0, false, 32);
+    resetMeasures();
+    uint64_t t0 = now();
+    // dedo desplazndose de e4 a e7: seal triangular centrada en la posicin, 1/10 de electrodo por paso
+    for(uint8_t s = 0; s < Steps; s++){
+        runUntil(t0 + (s * StepUs));
+        int32_t pos = s * 10;
+        for(uint8_t i = 0; i < 4; i++){
+            int32_t d = (pos > (i * 100))? (pos - (i * 100)) : ((i * 100) - pos);
+            touchman->sim()->setSignal(4 + i, (d < 100)? (uint16_t)(60 - ((60 * d) / 100)) : 0);
+        }
+        touchman->simIrq();
+    }
+    uint64_t t_release = t0 + (Steps * StepUs);
+    runUntil(t_release);
+    touchman->sim()->setTouched(0);
+    touchman->simIrq();
+    runUntil(now() + 100000);
+    report(t0);
+
+    std::vector<uint16_t> pos;
+    for(size_t i = 0; i < events.size(); i++){
+        if(events[i].evt == TouchManager::SliderEvent){
+            pos.push_back(events[i].pos);
+        }
+    }
+    bool monotonic = (pos.size() >= 3)? true : false;
+    for(size_t i = 1; monotonic && i + 1 < pos.size(); i++){
+        monotonic = (pos[i] > pos[i - 1])? true : false;
+    }
+    printf("    slider: %u posiciones, primera %u, ltima %u\r\n", (unsigned)pos.size(), (pos.empty())? 0 : pos[0],
+            (pos.size() < 2)? 0 : pos[pos.size() - 2]);
+    check(monotonic, "las posiciones del slider no son crecientes");
+    check(!pos.empty() && pos.back() == TouchManager::SliderReleased, "no se notifica la liberacin del slider");
+    check(pos.size() >= 2 && pos[0] < TouchManager::SliderScale && pos[pos.size() - 2] > (2 * TouchManager::SliderScale),
+            "el recorrido del slider no cubre sus electrodos");
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioGroup(){
+    TouchGroup* group = new TouchGroup(PB_7, PB_6);
+    touchman = new TouchManager(PB_7, PB_6, PB_1, 0x0fff, 0x5A, false);
+    TouchManager* chip1 = new TouchManager(PB_7, PB_6, PB_2, 0x0fff, 0x5B, false);
+    touchman->attachCallback(callback(onEvent));
+    chip1->attachCallback(callback(onEventChip1));
+    check(group->add(touchman) == 0 && group->add(chip1) == 1, "no se pueden aadir los managers al grupo");
+    check(group->add(chip1) < 0, "un manager se aade dos veces al grupo");
+    TouchManager* own = new TouchManager(PB_7, PB_6, PC_3, 0x0fff, 0x5C);
+    check(group->add(own) < 0, "se aade al grupo un manager con thread propio");
+    runUntil(now() + 1000);
+    check(group->ready(), "el grupo no inicializa sus managers");
+    resetMeasures();
+    uint64_t t0 = now();
+    // pulsaciones simultneas en ambos chips y una pulsacin en cada uno por separado
+    runUntil(t0);
+    touchman->sim()->setTouched(0x001);
+    chip1->sim()->setTouched(0x001);
+    touchman->simIrq();
+    chip1->simIrq();
+    touch(touchman, t0 + 100000, 0x000);
+    touch(chip1, t0 + 100000, 0x000);
+    touch(chip1, t0 + 200000, 0x100);
+    touch(chip1, t0 + 300000, 0x000);
+    runUntil(now() + 100000);
+    report(t0);
+    TouchGroup::GroupStats gs;
+    group->getStats(&gs);
+    printf("    grupo: %u activaciones, %u trabajos irq, %u de temporizacin, %u irq adelantadas\r\n", gs.activations,
+            gs.irq_jobs, gs.timer_jobs, gs.irq_first);
+    std::vector<BenchExpect> exp0;
+    exp0.push_back(at(t0, Debounce, 0, TouchManager::TouchedEvent));
+    exp0.push_back(at(t0 + 100000, Debounce, 0, TouchManager::ReleasedEvent));
+    expect(exp0, 0);
+    std::vector<BenchExpect> exp1;
+    exp1.push_back(at(t0, Debounce, 0, TouchManager::TouchedEvent));
+    exp1.push_back(at(t0 + 100000, Debounce, 0, TouchManager::ReleasedEvent));
+    exp1.push_back(at(t0 + 200000, Debounce, 8, TouchManager::TouchedEvent));
+    exp1.push_back(at(t0 + 300000, Debounce, 8, TouchManager::ReleasedEvent));
+    expect(exp1, 1);
+    check(gs.irq_jobs >= 6, "interrupciones no atendidas por el grupo");
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioPoll(){
+    static const uint32_t PollUs = 1000;
+    static const uint32_t IdleMs = 50;
+    createManager();
+    touchman->setPolling(PollUs, 3, IdleMs);
+    resetMeasures();
+    uint64_t t0 = now();
+    std::vector<BenchExpect> exp;
+    // pulsacin con un glitch de una lectura: la mayora (2 de 3) confirma cada flanco en el segundo sondeo
+    touch(touchman, t0, 0x001);
+    touch(touchman, t0 + 20500, 0x000);
+    touch(touchman, t0 + 21500, 0x001);
+    touch(touchman, t0 + 50000, 0x000);
+    exp.push_back(at(t0, PollUs, 0, TouchManager::TouchedEvent, 1000));
+    exp.push_back(at(t0 + 50000, PollUs, 0, TouchManager::ReleasedEvent, 1500));
+    // tras el reposo vuelve a interrupciones, y la siguiente pulsacin vuelve a sondeo
+    uint64_t t1 = t0 + 300000;
+    runUntil(t1);
+    TouchManager::PollStats idle;
+    touchman->getPollStats(&idle);
+    touch(touchman, t1, 0x002);
+    touch(touchman, t1 + 30000, 0x000);
+    exp.push_back(at(t1, PollUs, 1, TouchManager::TouchedEvent, 1000));
+    exp.push_back(at(t1 + 30000, PollUs, 1, TouchManager::ReleasedEvent, 1500));
+    runUntil(now() + 500000);
+    report(t0);
+    TouchManager::PollStats ps;
+    touchman->getPollStats(&ps);
+    printf("    sondeo: %u lecturas, %u entradas, %u salidas\r\n", ps.polls, ps.entries, ps.exits);
+    check(idle.exits == 1 && ps.entries == 2 && ps.exits == 2, "no vuelve a modo interrupcin en reposo");
+    // slo se sondea mientras hay pulsaciones y durante el tiempo de reposo posterior
+    uint32_t active_ms = 50 + 30 + (2 * (IdleMs + 2));
+    check(ps.polls <= active_ms, "lecturas de sondeo en reposo (%u > %u)", ps.polls, active_ms);
+    expect(exp);
+}
+
+
+//------------------------------------------------------------------------------------
+static void scenarioReplay(){
+    if(!trace_file){
+        printf("    falta la traza (-r fichero)\r\n");
+        failures++;
+        return;
+    }
+    std::vector<std::vector<uint64_t> > rows = readCsv(trace_file);
+    std::vector<BenchStep> trace;
+    for(size_t i = 0; i < rows.size(); i++){
+        if(rows[i].size() >= 2){
+            trace.push_back({rows[i][0], (uint16_t)rows[i][1]});
+        }
+    }
+    createManager();
+    resetMeasures();
+    // los instantes de la traza son relativos al inicio de la reproduccin
+    uint64_t t0 = now();
+    for(size_t i = 0; i < trace.size(); i++){
+        trace[i].t += t0;
+    }
+    replay(touchman, trace);
+    runUntil(now() + 500000);
+    printf("    traza: %u pasos, %.3fs\r\n", (unsigned)trace.size(), (now() - t0) / 1000000.0);
+    report(t0);
+    if(!expected_file){
+        return;
+    }
+    rows = readCsv(expected_file);
+    std::vector<BenchExpect> exp;
+    for(size_t i = 0; i < rows.size(); i++){
+        if(rows[i].size() >= 3){
+            uint64_t t = t0 + rows[i][0];
+            exp.push_back({(uint8_t)rows[i][1], (uint8_t)rows[i][2], (t > tolerance)? (t - tolerance) : 0, t + tolerance});
+        }
+    }
+    expect(exp);
+}
+
+
+// **************************************************************************
+// *********** MAIN *********************************************************
+// **************************************************************************
+
+//------------------------------------------------------------------------------------
+static const char* scenarios[] = {"press", "bounce", "multi", "gestures", "burst", "slider", "group", "poll"};
+
+
+//------------------------------------------------------------------------------------
+static int runScenario(std::string name){
+    printf("\r\n[%s]\r\n", name.c_str());
+    if(name == "press")         { scenarioPress(); }
+    else if(name == "bounce")   { scenarioBounce(); }
+    else if(name == "multi")    { scenarioMulti(); }
+    else if(name == "gestures") { scenarioGestures(); }
+    else if(name == "burst")    { scenarioBurst(); }
+    else if(name == "slider")   { scenarioSlider(); }
+    else if(name == "group")    { scenarioGroup(); }
+    else if(name == "poll")     { scenarioPoll(); }
+    else if(name == "replay")   { scenarioReplay(); }
+    else{
+        printf("    escenario desconocido\r\n");
+        return 1;
+    }
+    dumpEvents();
+    printf("    %s\r\n", (failures)? "ERROR" : "OK");
+    fflush(stdout);
+    return (failures)? 1 : 0;
+}
+
+
+//------------------------------------------------------------------------------------
+int main(int argc, char** argv){
+    const char* name = 0;
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-o") == 0 && (i + 1) < argc){
+            events_file = argv[++i];
+        }
+        else if(strcmp(argv[i], "-r") == 0 && (i + 1) < argc){
+            trace_file = argv[++i];
+        }
+        else if(strcmp(argv[i], "-e") == 0 && (i + 1) < argc){
+            expected_file = argv[++i];
+        }
+        else if(strcmp(argv[i], "-w") == 0 && (i + 1) < argc){
+            tolerance = atoi(argv[++i]);
+        }
+        else{
+            name = argv[i];
+        }
+    }
+    if(name){
+        // la tarea de TouchManager sigue bloqueada en su hilo, se finaliza sin destruir objetos
+        _exit(runScenario(name));
+    }
+
+    // cada escenario en un proceso independiente, con el tiempo y los chips simulados en su estado inicial
+    int result = 0;
+    for(size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++){
+        pid_t pid = fork();
+        if(pid == 0){
+            _exit(runScenario(scenarios[i]));
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+        result |= (WIFEXITED(status))? WEXITSTATUS(status) : 1;
+    }
+    return result;
+}
@@ -0,0 +1,22 @@
+/*
+ * Heap.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Gestin de memoria dinmica para los bancos de pruebas de los managers en PC.
+ */
+
+#ifndef __Heap__H
+#define __Heap__H
+
+#include <stdlib.h>
+
+
+class Heap{
+public:
+    static void* memAlloc(size_t size){ return malloc(size); }
+    static void memFree(void* ptr){ free(ptr); }
+};
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ * Logger.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Canal de depuracin para los bancos de pruebas de los managers en PC, imprime en la salida estndar.
+ */
+
+#ifndef __Logger__H
+#define __Logger__H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+
+class Logger{
+public:
+    void printf(const char* format, ...){
+        va_list args;
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+    }
+};
+
+#endif
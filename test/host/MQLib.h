@@ -0,0 +1,63 @@
+/*
+ * MQLib.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Modelo de MQLib para los bancos de pruebas de los managers en PC. La publicacin entrega el mensaje de forma sncrona,
+ *  en el contexto del publicador, a todas las suscripciones cuyo topic coincide (con comodn final '#').
+ */
+
+#ifndef __MQLib__H
+#define __MQLib__H
+
+#include "mbed.h"
+#include <string>
+#include <vector>
+
+
+namespace MQ{
+
+typedef Callback<void(const char*, void*, uint16_t)> SubscribeCallback;
+typedef Callback<void(const char*, int32_t)> PublishCallback;
+
+class MQClient{
+public:
+    static int32_t subscribe(const char* topic, SubscribeCallback* cb){
+        subscriptions().push_back(Subscription_t(std::string(topic), cb));
+        return 0;
+    }
+
+    static int32_t publish(const char* topic, void* data, uint32_t size, PublishCallback* cb){
+        for(size_t i = 0; i < subscriptions().size(); i++){
+            if(match(subscriptions()[i].first, topic)){
+                subscriptions()[i].second->call(topic, data, (uint16_t)size);
+            }
+        }
+        if(cb){
+            cb->call(topic, 0);
+        }
+        return 0;
+    }
+
+    static bool isTopicToken(const char* topic, const char* token){
+        return (strstr(topic, token) != 0)? true : false;
+    }
+
+    static uint8_t getMaxTopicLen(){ return 64; }
+
+private:
+    typedef std::pair<std::string, SubscribeCallback*> Subscription_t;
+    static std::vector<Subscription_t>& subscriptions(){ static std::vector<Subscription_t> s; return s; }
+    static bool match(const std::string& filter, const char* topic){
+        size_t wild = filter.find('#');
+        if(wild == std::string::npos){
+            return (filter == topic)? true : false;
+        }
+        return (strncmp(filter.c_str(), topic, wild) == 0)? true : false;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,358 @@
+/*
+ * mbed.h (host)
+ *
+ *  Created on: Oct 2026
+ *      Author: raulMrello
+ *
+ *  Sustituto mnimo de mbed OS para compilar y ejecutar los managers en un PC (Linux), comn a los bancos de pruebas
+ *  de cada mdulo (<Modulo>/test/host). No pretende ser completo: implementa nicamente lo que utilizan los managers.
+ *
+ *  El tiempo es simulado (SimClock): slo avanza cuando el banco de pruebas lo indica y durante las transferencias
+ *  i2c. El modelo del bus (SimI2CBus) depende del chip simulado, por lo que la implementacin de I2C la aporta el
+ *  simulador de cada banco de pruebas (SimPCA9685.h, SimMPR121.h), incluido por el sustituto de su driver. Las
+ *  salidas digitales notifican cada escritura al simulador instalado (DigitalOut::onWrite) y las entradas de
+ *  interrupcin se activan con InterruptIn::simEdge. Los Ticker y Timeout se disparan desde el hilo del banco de
+ *  pruebas, que hace las veces de contexto de interrupcin, y Thread ejecuta la tarea en un hilo real del sistema, de
+ *  forma que el banco de pruebas puede esperar a que la tarea quede inactiva (Thread::settle) antes de avanzar el
+ *  tiempo.
+ */
+
+#ifndef __MBED_HOST__H
+#define __MBED_HOST__H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+
+//------------------------------------------------------------------------------------
+//--- PINES --------------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+enum PinName{ PA_0, PA_1, PB_0, PB_1, PB_2, PB_6, PB_7, PB_8, PB_9, PB_10, PB_11, PC_0, PC_1, PC_2, PC_3, PC_4, PC_5, PC_6,
+               PC_7, USBTX, USBRX, NC };
+
+
+//------------------------------------------------------------------------------------
+//--- CALLBACKS ----------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+template<typename F> class Callback;
+template<typename R, typename... A> class Callback<R(A...)>{
+public:
+    Callback(){}
+    Callback(R (*f)(A...)) : _f(f){}
+    template<typename T> Callback(T* obj, R (T::*method)(A...)){
+        _f = [obj, method](A... a) -> R { return (obj->*method)(a...); };
+    }
+    R call(A... a){ return _f(a...); }
+    R operator()(A... a){ return _f(a...); }
+    operator bool() const { return (_f)? true : false; }
+private:
+    std::function<R(A...)> _f;
+};
+
+template<typename T, typename R, typename... A> Callback<R(A...)> callback(T* obj, R (T::*method)(A...)){
+    return Callback<R(A...)>(obj, method);
+}
+template<typename R, typename... A> Callback<R(A...)> callback(R (*f)(A...)){
+    return Callback<R(A...)>(f);
+}
+
+
+//------------------------------------------------------------------------------------
+//--- TIEMPO SIMULADO ----------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+class SimClock{
+public:
+    static std::atomic<uint64_t>& now(){ static std::atomic<uint64_t> t(0); return t; }
+    static void advance(uint64_t us){ now() += us; }
+};
+
+inline uint32_t us_ticker_read(){ return (uint32_t)SimClock::now().load(); }
+inline void wait_us(int us){ SimClock::advance(us); }
+
+/** Tiempo de cpu consumido por el hilo actual (ns) */
+inline uint64_t host_thread_cpu_ns(){
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/** Las secciones crticas protegen los datos compartidos entre la tarea y el contexto de interrupcin simulado */
+inline std::recursive_mutex& host_critical_mutex(){ static std::recursive_mutex m; return m; }
+inline void core_util_critical_section_enter(){ host_critical_mutex().lock(); }
+inline void core_util_critical_section_exit(){ host_critical_mutex().unlock(); }
+
+/** Barrera de memoria de CMSIS: ordena los accesos a las colas sin bloqueos entre la tarea y el contexto de interrupcin
+ *  simulado, que se ejecutan en hilos distintos */
+inline void __DMB(){ std::atomic_thread_fence(std::memory_order_seq_cst); }
+
+
+//------------------------------------------------------------------------------------
+//--- TICKER / TIMEOUT ---------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+class Ticker{
+public:
+    Ticker() : _active(false), _oneshot(false), _period(0), _due(0){ registry().push_back(this); }
+    virtual ~Ticker(){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        std::vector<Ticker*>& r = registry();
+        for(size_t i = 0; i < r.size(); i++){ if(r[i] == this){ r.erase(r.begin() + i); break; } }
+    }
+    void attach_us(Callback<void()> cb, uint32_t us){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        _cb = cb; _period = us; _due = SimClock::now() + us; _active = true;
+    }
+    void detach(){ std::lock_guard<std::recursive_mutex> lock(mutex()); _active = false; }
+
+    /** Obtiene el prximo vencimiento de todos los ticker activos (UINT64_MAX si ninguno) */
+    static uint64_t nextDue(){
+        std::lock_guard<std::recursive_mutex> lock(mutex());
+        uint64_t due = UINT64_MAX;
+        for(Ticker* t : registry()){ if(t->_active && t->_due < due){ due = t->_due; } }
+        return due;
+    }
+
+    /** Dispara los ticker vencidos en 'now' (contexto de interrupcin simulado), devuelve el nmero de disparos */
+    static int fire(uint64_t now){
+        int count = 0;
+        std::vector<Ticker*> r;
+        { std::lock_guard<std::recursive_mutex> lock(mutex()); r = registry(); }
+        for(Ticker* t : r){
+            Callback<void()> cb;
+            {
+                std::lock_guard<std::recursive_mutex> lock(mutex());
+                if(!t->_active || t->_due > now){ continue; }
+                cb = t->_cb;
+                if(t->_oneshot){ t->_active = false; }
+                else{ t->_due += t->_period; }
+            }
+            cb();
+            count++;
+        }
+        return count;
+    }
+
+protected:
+    static std::vector<Ticker*>& registry(){ static std::vector<Ticker*> r; return r; }
+    static std::recursive_mutex& mutex(){ static std::recursive_mutex m; return m; }
+    Callback<void()> _cb;
+    bool _active;
+    bool _oneshot;
+    uint32_t _period;
+    uint64_t _due;
+};
+
+class Timeout : public Ticker{
+public:
+    Timeout(){ _oneshot = true; }
+};
+
+
+//------------------------------------------------------------------------------------
+//--- GPIO ---------------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+class DigitalOut{
+public:
+    DigitalOut(PinName pin, int value = 0) : _pin(pin), _value(value){}
+    void write(int value){
+        _value = value;
+        if(onWrite()){ onWrite()(_pin, value); }
+    }
+    int read(){ return _value; }
+    DigitalOut& operator=(int value){ write(value); return *this; }
+    operator int(){ return _value; }
+
+    /** Callback del simulador invocada en cada escritura (pin, valor), en el contexto del que escribe */
+    static Callback<void(PinName, int)>& onWrite(){ static Callback<void(PinName, int)> cb; return cb; }
+private:
+    PinName _pin;
+    int _value;
+};
+
+
+class InterruptIn{
+public:
+    InterruptIn(PinName pin) : _pin(pin), _level(0){ registry().push_back(this); }
+    void rise(Callback<void()> cb){ _rise = cb; }
+    void fall(Callback<void()> cb){ _fall = cb; }
+    int read(){ return _level; }
+
+    /** Genera un flanco en la entrada (1: subida, 0: bajada) desde el contexto de interrupcin simulado */
+    void simEdge(int level){
+        _level = level;
+        Callback<void()> cb = (level)? _rise : _fall;
+        if(cb){ cb(); }
+    }
+
+    /** Obtiene la entrada asociada a un pin (0 si no existe) */
+    static InterruptIn* get(PinName pin){
+        for(InterruptIn* i : registry()){ if(i->_pin == pin){ return i; } }
+        return 0;
+    }
+private:
+    static std::vector<InterruptIn*>& registry(){ static std::vector<InterruptIn*> r; return r; }
+    PinName _pin;
+    int _level;
+    Callback<void()> _rise;
+    Callback<void()> _fall;
+};
+
+
+//------------------------------------------------------------------------------------
+//--- RTOS ---------------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+#define osWaitForever 0xFFFFFFFFu
+enum osStatus{ osOK = 0, osEventSignal = 0x08, osEventTimeout = 0x40 };
+struct osEvent{ osStatus status; union{ int32_t signals; } value; };
+
+
+class Mutex{
+public:
+    void lock(){ _m.lock(); }
+    void unlock(){ _m.unlock(); }
+private:
+    std::recursive_mutex _m;
+};
+
+
+class Thread{
+public:
+    /** Muestra de actividad de la tarea: seales recibidas y tiempo de cpu hasta volver a esperar */
+    struct Wake{ int32_t signals; uint64_t at_us; uint64_t cpu_ns; };
+
+    Thread() : _flags(0), _waiting(false), _th(0){ all().push_back(this); }
+    void start(Callback<void()> task){
+        _task = task;
+        _th = new std::thread([this](){ _task(); });
+        _th->detach();
+    }
+
+    int32_t signal_set(int32_t flags){
+        std::lock_guard<std::mutex> lock(_m);
+        _flags |= flags;
+        _cv.notify_all();
+        return _flags;
+    }
+
+    osEvent signal_wait(int32_t signals, uint32_t millisec){
+        std::unique_lock<std::mutex> lock(_m);
+        if(_wake_cpu){
+            _wakes.push_back({_wake_signals, _wake_at, host_thread_cpu_ns() - _wake_cpu});
+        }
+        _waiting = true;
+        _cv.notify_all();
+        osEvent evt;
+        auto ready = [this, signals](){ return (signals)? ((_flags & signals) == signals) : (_flags != 0); };
+        if(millisec == osWaitForever){
+            _cv.wait(lock, ready);
+        }
+        else if(!_cv.wait_for(lock, std::chrono::milliseconds(millisec), ready)){
+            _waiting = false;
+            _wake_cpu = 0;
+            evt.status = osEventTimeout;
+            return evt;
+        }
+        _waiting = false;
+        evt.status = osEventSignal;
+        evt.value.signals = (signals)? signals : _flags;
+        _flags &= ~evt.value.signals;
+        _wake_signals = evt.value.signals;
+        _wake_at = SimClock::now();
+        _wake_cpu = host_thread_cpu_ns();
+        return evt;
+    }
+
+    /** Espera a que la tarea haya atendido todas sus seales y est bloqueada a la espera de otras */
+    void settle(){
+        std::unique_lock<std::mutex> lock(_m);
+        _cv.wait(lock, [this](){ return (_waiting && _flags == 0); });
+    }
+
+    /** Extrae las muestras de actividad registradas */
+    std::vector<Wake> takeWakes(){
+        std::lock_guard<std::mutex> lock(_m);
+        std::vector<Wake> w;
+        w.swap(_wakes);
+        return w;
+    }
+
+    /** Espera a que todas las tareas arrancadas queden inactivas */
+    static void settleAll(){
+        for(size_t i = 0; i < all().size(); i++){
+            if(all()[i]->_th){
+                all()[i]->settle();
+            }
+        }
+    }
+
+    /** Extrae las muestras de actividad de todas las tareas */
+    static std::vector<Wake> takeAllWakes(){
+        std::vector<Wake> w;
+        for(size_t i = 0; i < all().size(); i++){
+            std::vector<Wake> t = all()[i]->takeWakes();
+            w.insert(w.end(), t.begin(), t.end());
+        }
+        return w;
+    }
+
+    static void yield(){ std::this_thread::yield(); }
+    static void wait(uint32_t ms){ SimClock::advance(ms * 1000); }
+
+private:
+    static std::vector<Thread*>& all(){ static std::vector<Thread*> t; return t; }
+    Callback<void()> _task;
+    int32_t _flags;
+    bool _waiting;
+    std::mutex _m;
+    std::condition_variable _cv;
+    std::thread* _th;
+    std::vector<Wake> _wakes;
+    int32_t _wake_signals = 0;
+    uint64_t _wake_at = 0;
+    uint64_t _wake_cpu = 0;
+};
+
+
+//------------------------------------------------------------------------------------
+//--- I2C ----------------------------------------------------------------------------
+//------------------------------------------------------------------------------------
+
+class SimI2CBus;
+
+/** El constructor, write y read los define el simulador del banco de pruebas, junto con su SimI2CBus */
+class I2C{
+public:
+    I2C(PinName sda, PinName scl);
+    void frequency(int hz){ _hz = hz; }
+    int write(int address, const char* data, int length, bool repeated = false);
+    int read(int address, char* data, int length, bool repeated = false);
+
+    /** Los simuladores generan el STOP tras una direccin sin respuesta, no queda transaccin abierta que cerrar */
+    void stop(){}
+
+    /** Como en mbed, el mutex de reserva del bus es comn a todos los objetos I2C */
+    void lock(){ mutex().lock(); }
+    void unlock(){ mutex().unlock(); }
+private:
+    static std::recursive_mutex& mutex(){ static std::recursive_mutex m; return m; }
+    SimI2CBus* _bus;
+    int _hz;
+};
+
+
+#endif